@@ -78,6 +78,10 @@
 #define HASP_USE_MQTT_ASYNC (HASP_TARGET_PC)
 #endif
 
+#ifndef HASP_USE_MQTT_V5
+#define HASP_USE_MQTT_V5 0 // MQTT v5 with topic aliases, requires a v5 capable client library and broker
+#endif
+
 #ifndef HASP_USE_WIREGUARD
 #define HASP_USE_WIREGUARD 0
 #endif
@@ -102,6 +106,10 @@
 #define HASP_USE_HTTP_ASYNC 0 //(HASP_HAS_NETWORK)
 #endif
 
+#ifndef HASP_USE_WEBSOCKET
+#define HASP_USE_WEBSOCKET 0 // ESP32 only
+#endif
+
 #ifndef HASP_START_HTTP
 #define HASP_START_HTTP 1
 #endif
@@ -169,6 +177,18 @@
 #define HASP_USE_PNGDECODE 0
 #endif
 
+#ifndef HASP_USE_PNG_STREAM
+#define HASP_USE_PNG_STREAM 0
+#endif
+
+#ifndef HASP_USE_SHADOW_CACHE
+#define HASP_USE_SHADOW_CACHE 0
+#endif
+
+#ifndef HASP_USE_LABEL_CACHE
+#define HASP_USE_LABEL_CACHE 0
+#endif
+
 #ifndef HASP_USE_BMPDECODE
 #define HASP_USE_BMPDECODE 0
 #endif
@@ -355,6 +375,10 @@ static WiFiSpiClass WiFi;
 #include "sys/svc/hasp_http.h"
 #endif
 
+#if HASP_USE_WEBSOCKET > 0
+#include "sys/svc/hasp_websocket.h"
+#endif
+
 #if HASP_USE_CONSOLE > 0
 #include "sys/svc/hasp_console.h"
 #endif
@@ -189,6 +189,20 @@ void hasp_get_sleep_payload(uint8_t state, char* payload)
  */
 static lv_task_t* antiburn_task;
 
+/* The screen is filled with random pixels band by band, a task tick only flushes for HASP_ANTIBURN_SLICE ms so touch,
+ * mqtt and the other lvgl tasks keep running. A new pass starts `period` ms after the previous one started. */
+static struct
+{
+    int32_t repeat;   // passes left, negative runs until stopped
+    uint32_t period;  // ms between the start of two passes
+    uint32_t started; // lv_tick_get() at the start of the current pass
+    uint32_t enabled; // lv_tick_get() when antiburn was switched on
+    uint32_t elapsed; // ms antiburn has been on, updated each tick
+    uint32_t busy;    // ms spent flushing pixels
+    lv_area_t area;   // next area to flush
+    lv_coord_t w;     // width of the areas in the current band
+} antiburn;
+
 bool hasp_stop_antiburn()
 {
     bool changed = false;
@@ -204,6 +218,7 @@ bool hasp_stop_antiburn()
         lv_task_del(antiburn_task);
         lv_obj_invalidate(lv_scr_act());
         changed = true;
+        LOG_VERBOSE(TAG_HASP, F("Antiburn duty cycle %d%%"), hasp_get_antiburn_duty());
     }
     antiburn_task = NULL;
     hasp_set_wakeup_touch(haspDevice.get_backlight_power() == false); // enabled if backlight is OFF
@@ -215,56 +230,71 @@ bool hasp_stop_antiburn()
 void hasp_antiburn_cb(lv_task_t* task)
 {
     lv_obj_t* layer = lv_disp_get_layer_sys(NULL);
-    if(layer) {
-        // Fill a buffer with random colors
-        lv_color_t color[1223];
-        size_t len = sizeof(color) / sizeof(color[0]);
-        for(size_t x = 0; x < len; x++) {
-            color[x].full = HASP_RANDOM(UINT16_MAX);
-        }
-
-        // list of possible draw widths; prime numbers combat recurring patterns on the screen
-        uint8_t prime[] = {61,  67,  73,  79,  83,  89,  97,  103, 109, 113, 127, 131, 137, 139, 149,
-                           157, 163, 167, 173, 179, 181, 191, 197, 211, 223, 227, 229, 233, 251};
-
-        lv_disp_t* disp         = lv_disp_get_default();
-        lv_disp_drv_t* disp_drv = &disp->driver;
-
-        lv_coord_t scr_h = lv_obj_get_height(layer) - 1;
-        lv_coord_t scr_w = lv_obj_get_width(layer) - 1;
-        lv_coord_t w     = 487; // first prime larger than 480
-        lv_area_t area;
+    if(!layer) return;
 
-        area.y1 = 0;
-        while(area.y1 <= scr_h) {
-            if(w > scr_w) w = scr_w; // limit to the actual screenwidth
-            if(w > len) w = len;     // don't overrun the buffer
-            lv_coord_t h    = len / w;
-            size_t headroom = len % w; // additional bytes in the buffer that can be used for a random offset
+    uint32_t start = lv_tick_get();
+    if(antiburn.area.y1 == 0 && antiburn.area.x1 == 0) antiburn.started = start; // new pass
 
-            area.y2 = area.y1 + h - 1;
-            if(area.y2 > scr_h) area.y2 = scr_h;
+    // Fill a buffer with random colors
+    lv_color_t color[1223];
+    size_t len = sizeof(color) / sizeof(color[0]);
+    for(size_t x = 0; x < len; x++) {
+        color[x].full = HASP_RANDOM(UINT16_MAX);
+    }
 
-            area.x1 = 0;
-            while(area.x1 <= scr_w) {
-                area.x2 = area.x1 + w - 1;
-                if(area.x2 > scr_w) area.x2 = scr_w;
+    // list of possible draw widths; prime numbers combat recurring patterns on the screen
+    uint8_t prime[] = {61,  67,  73,  79,  83,  89,  97,  103, 109, 113, 127, 131, 137, 139, 149,
+                       157, 163, 167, 173, 179, 181, 191, 197, 211, 223, 227, 229, 233, 251};
+
+    lv_disp_t* disp         = lv_disp_get_default();
+    lv_disp_drv_t* disp_drv = &disp->driver;
+
+    lv_coord_t scr_h = lv_obj_get_height(layer) - 1;
+    lv_coord_t scr_w = lv_obj_get_width(layer) - 1;
+    lv_area_t* area  = &antiburn.area;
+
+    do {
+        lv_coord_t w = antiburn.w;
+        if(w > scr_w) w = scr_w; // limit to the actual screenwidth
+        if(w > len) w = len;     // don't overrun the buffer
+        lv_coord_t h    = len / w;
+        size_t headroom = len % w; // additional bytes in the buffer that can be used for a random offset
+
+        area->y2 = area->y1 + h - 1;
+        if(area->y2 > scr_h) area->y2 = scr_h;
+        area->x2 = area->x1 + w - 1;
+        if(area->x2 > scr_w) area->x2 = scr_w;
+
+        size_t offset = headroom ? HASP_RANDOM(headroom) : 0;
+        haspTft.flush_pixels(disp_drv, area, color + offset);
+
+        area->x1 += w;
+        if(area->x1 > scr_w) { // next band
+            area->x1   = 0;
+            area->y1   = area->y2 + 1;
+            antiburn.w = prime[HASP_RANDOM(sizeof(prime))]; // new random width
+        }
+    } while(area->y1 <= scr_h && lv_tick_elaps(start) < HASP_ANTIBURN_SLICE);
 
-                size_t offset = headroom ? HASP_RANDOM(headroom) : 0;
-                haspTft.flush_pixels(disp_drv, &area, color + offset);
-                area.x1 += w;
-            }
+    antiburn.busy += lv_tick_elaps(start);
+    antiburn.elapsed = lv_tick_elaps(antiburn.enabled);
 
-            w = prime[HASP_RANDOM(sizeof(prime))]; // new random width
-            area.y1 += h;
-        }
+    if(area->y1 <= scr_h) {
+        lv_task_set_period(task, 0); // continue the pass on the next tick
+        return;
     }
 
-    if(task->repeat_count != 1) return; // don't stop yet
+    // pass completed
+    area->y1   = 0;
+    antiburn.w = 487; // first prime larger than 480
+    if(antiburn.repeat > 0 && --antiburn.repeat == 0) {
+        hasp_stop_antiburn();
+        dispatch_state_antiburn(HASP_EVENT_OFF);
+        return;
+    }
 
-    // task is about to get deleted
-    hasp_stop_antiburn();
-    dispatch_state_antiburn(HASP_EVENT_OFF);
+    uint32_t pass = lv_tick_elaps(antiburn.started);
+    lv_task_set_period(task, pass < antiburn.period ? antiburn.period - pass : 0);
 }
 
 /**
@@ -276,13 +306,22 @@ void hasp_set_antiburn(int32_t repeat_count, uint32_t period)
         lv_obj_t* layer = lv_disp_get_layer_sys(NULL);
         if(!layer) return;
 
-        if(!antiburn_task) antiburn_task = lv_task_create(hasp_antiburn_cb, period, LV_TASK_PRIO_LOW, NULL);
+        if(!antiburn_task) {
+            antiburn_task = lv_task_create(hasp_antiburn_cb, 0, LV_TASK_PRIO_LOW, NULL);
+            if(antiburn_task) {
+                antiburn.area    = {0, 0, 0, 0};
+                antiburn.w       = 487; // first prime larger than 480
+                antiburn.enabled = lv_tick_get();
+                antiburn.elapsed = 0;
+                antiburn.busy    = 0;
+            }
+        }
         if(antiburn_task) {
             // lv_obj_set_style_local_bg_color(layer, LV_OBJ_PART_MAIN, LV_STATE_DEFAULT, LV_COLOR_BLACK);
             // lv_obj_set_style_local_bg_opa(layer, LV_OBJ_PART_MAIN, LV_STATE_DEFAULT, LV_OPA_COVER);
             hasp_set_wakeup_touch(true);
-            lv_task_set_repeat_count(antiburn_task, repeat_count);
-            lv_task_set_period(antiburn_task, period);
+            antiburn.repeat = repeat_count;
+            antiburn.period = period;
             //  gui_hide_pointer(true);
 
             /* Refresh screen to antiburn callback */
@@ -298,6 +337,14 @@ void hasp_set_antiburn(int32_t repeat_count, uint32_t period)
     }
 }
 
+/**
+ * Percentage of time the current or last antiburn run spent flushing pixels
+ */
+uint8_t hasp_get_antiburn_duty()
+{
+    return antiburn.elapsed ? (uint64_t)antiburn.busy * 100 / antiburn.elapsed : 0;
+}
+
 /**
  * Check if Anti Burn-in protection is enabled
  */
@@ -625,6 +672,7 @@ void hasp_init(void)
 void hasp_load_json(void)
 {
     haspPages.load_jsonl(haspPagesPath);
+    hasp_rules_load(HASP_RULES_FILE);
 }
 
 /*
@@ -749,6 +797,7 @@ void hasp_get_info(JsonDocument& doc)
     hasp_get_sleep_payload(hasp_get_sleep_state(), size_buf);
     info[F("Idle")]        = size_buf;
     info[F("Active Page")] = haspPages.get();
+    if(antiburn.elapsed) info[F("Antiburn Duty")] = std::to_string(hasp_get_antiburn_duty()) + "%";
 
     info = doc.createNestedObject(F(D_INFO_DEVICE_MEMORY));
     Parser::format_bytes(haspDevice.get_free_heap(), size_buf, sizeof(size_buf));
@@ -22,6 +22,10 @@
 #define HASP_THEME_ID 2
 #endif
 
+#ifndef HASP_ANTIBURN_SLICE
+#define HASP_ANTIBURN_SLICE 8 // ms of antiburn pixels flushed per lvgl task tick
+#endif
+
 #if HASP_USE_DEBUG > 0
 #include "../hasp_debug.h"
 #include "dev/device.h"
@@ -87,6 +91,7 @@ void hasp_set_wakeup_touch(bool en);
 void hasp_set_antiburn(int32_t repeat_count, uint32_t period);
 bool hasp_stop_antiburn();
 hasp_event_t hasp_get_antiburn();
+uint8_t hasp_get_antiburn_duty();
 
 void hasp_init(void);
 void hasp_load_json(void);
@@ -8,12 +8,42 @@
 
 #if LV_USE_ANIMATION
 
-static void my_scr_load_anim_start(lv_anim_t* a)
+/* Snapshot transitions
+ * Moving or fading the live screens makes lvgl redraw the object trees of both pages on every frame. When there is
+ * memory for two screen buffers, both pages are drawn once into a snapshot when the transition starts and a temporary
+ * screen with an image of each snapshot is animated instead, so a frame only copies or blends two bitmaps. The new
+ * page is loaded when the transition ends. */
+
+typedef struct
 {
-    lv_disp_t* d = lv_obj_get_disp((lv_obj_t*)a->var);
-    d->prev_scr  = lv_scr_act();
+    uint16_t count;   // transitions animated from snapshots
+    uint16_t live;    // transitions animated on the live screens
+    uint32_t frames;  // frames of the snapshot transitions
+    uint32_t time;    // ms of the snapshot transitions
+    uint32_t capture; // ms spent drawing the snapshots
+} my_scr_anim_stats_t;
+
+typedef struct
+{
+    lv_obj_t* scr; // temporary screen showing the snapshots
+    lv_obj_t* img_old;
+    lv_obj_t* img_new;
+    lv_img_dsc_t dsc_old;
+    lv_img_dsc_t dsc_new;
+    lv_scr_load_anim_t type;
+    uint32_t start; // lv_tick_get() when the snapshots were loaded
+    uint32_t frames;
+} my_scr_snapshot_t;
+
+static my_scr_snapshot_t snapshot;
+static my_scr_anim_stats_t anim_stats[LV_SCR_LOAD_ANIM_FADE_ON + 1];
 
-    lv_obj_t* page = (lv_obj_t*)a->var;
+static const char* const anim_names[LV_SCR_LOAD_ANIM_FADE_ON + 1] = {
+    "none",      "over_left",  "over_right", "over_top",    "over_bottom",
+    "move_left", "move_right", "move_top",   "move_bottom", "fade_on"};
+
+static void my_scr_load_page(lv_obj_t* page)
+{
     uint8_t pageid;
     uint8_t objid;
 
@@ -26,6 +56,208 @@ static void my_scr_load_anim_start(lv_anim_t* a)
     }
 }
 
+static void my_scr_load_anim_start(lv_anim_t* a)
+{
+    lv_disp_t* d = lv_obj_get_disp((lv_obj_t*)a->var);
+    d->prev_scr  = lv_scr_act();
+
+    my_scr_load_page((lv_obj_t*)a->var);
+}
+
+static void my_scr_snapshot_free()
+{
+    if(!snapshot.dsc_old.data && !snapshot.dsc_new.data) return;
+
+    lv_img_cache_invalidate_src(&snapshot.dsc_old);
+    lv_img_cache_invalidate_src(&snapshot.dsc_new);
+    hasp_free((void*)snapshot.dsc_old.data);
+    hasp_free((void*)snapshot.dsc_new.data);
+    snapshot.dsc_old.data = NULL;
+    snapshot.dsc_new.data = NULL;
+}
+
+// Get two screen sized buffers, returns false if the transition has to use the live screens
+static bool my_scr_snapshot_alloc(lv_disp_t* d)
+{
+#if defined(ARDUINO_ARCH_ESP32)
+    if(!hasp_use_psram()) return false; // two frames don't fit in internal ram
+#endif
+
+    lv_coord_t w  = lv_disp_get_hor_res(d);
+    lv_coord_t h  = lv_disp_get_ver_res(d);
+    uint32_t size = (uint32_t)w * h * sizeof(lv_color_t);
+
+    if(snapshot.dsc_old.data && (snapshot.dsc_old.header.w != w || snapshot.dsc_old.header.h != h)) {
+        my_scr_snapshot_free(); // resolution changed
+    }
+    if(!snapshot.dsc_old.data) snapshot.dsc_old.data = (const uint8_t*)hasp_malloc(size);
+    if(!snapshot.dsc_new.data) snapshot.dsc_new.data = (const uint8_t*)hasp_malloc(size);
+    if(!snapshot.dsc_old.data || !snapshot.dsc_new.data) {
+        my_scr_snapshot_free();
+        return false;
+    }
+
+    lv_img_dsc_t* dscs[] = {&snapshot.dsc_old, &snapshot.dsc_new};
+    for(lv_img_dsc_t* dsc : dscs) {
+        dsc->header.always_zero = 0;
+        dsc->header.cf          = LV_IMG_CF_TRUE_COLOR;
+        dsc->header.w           = w;
+        dsc->header.h           = h;
+        dsc->data_size          = size;
+    }
+    return true;
+}
+
+// Same as lv_refr_obj, but lvgl keeps that one private
+static void my_scr_snapshot_draw_obj(lv_obj_t* obj, const lv_area_t* mask)
+{
+    if(lv_obj_get_hidden(obj)) return;
+
+    lv_area_t obj_area;
+    lv_area_t obj_ext_mask;
+    lv_obj_get_coords(obj, &obj_area);
+    obj_area.x1 -= obj->ext_draw_pad;
+    obj_area.y1 -= obj->ext_draw_pad;
+    obj_area.x2 += obj->ext_draw_pad;
+    obj_area.y2 += obj->ext_draw_pad;
+    if(!_lv_area_intersect(&obj_ext_mask, mask, &obj_area)) return;
+
+    obj->design_cb(obj, &obj_ext_mask, LV_DESIGN_DRAW_MAIN);
+
+    lv_area_t obj_mask;
+    lv_obj_get_coords(obj, &obj_area);
+    if(_lv_area_intersect(&obj_mask, mask, &obj_area)) {
+        lv_obj_t* child;
+        _LV_LL_READ_BACK(obj->child_ll, child)
+        {
+            my_scr_snapshot_draw_obj(child, &obj_mask);
+        }
+    }
+
+    obj->design_cb(obj, &obj_ext_mask, LV_DESIGN_DRAW_POST);
+}
+
+// Draw a screen into a snapshot through a dummy display, like lv_canvas does
+static void my_scr_snapshot_draw(lv_obj_t* scr, lv_img_dsc_t* dsc)
+{
+    lv_area_t area = {0, 0, (lv_coord_t)(dsc->header.w - 1), (lv_coord_t)(dsc->header.h - 1)};
+
+    lv_disp_buf_t disp_buf;
+    lv_disp_buf_init(&disp_buf, (void*)dsc->data, NULL, (uint32_t)dsc->header.w * dsc->header.h);
+    lv_area_copy(&disp_buf.area, &area);
+
+    lv_disp_t disp;
+    _lv_memset_00(&disp, sizeof(lv_disp_t));
+    lv_disp_drv_init(&disp.driver);
+    disp.driver.buffer  = &disp_buf;
+    disp.driver.hor_res = dsc->header.w;
+    disp.driver.ver_res = dsc->header.h;
+
+    lv_disp_t* refr_ori = _lv_refr_get_disp_refreshing();
+    _lv_refr_set_disp_refreshing(&disp);
+    my_scr_snapshot_draw_obj(scr, &area);
+    _lv_refr_set_disp_refreshing(refr_ori);
+}
+
+static void my_scr_snapshot_exec(void*, lv_anim_value_t v)
+{
+    if(!snapshot.scr) return; // still waiting for the delay
+
+    lv_coord_t w = lv_obj_get_width(snapshot.scr);
+    lv_coord_t h = lv_obj_get_height(snapshot.scr);
+
+    switch(snapshot.type) {
+        case LV_SCR_LOAD_ANIM_OVER_LEFT:
+        case LV_SCR_LOAD_ANIM_OVER_RIGHT:
+            lv_obj_set_x(snapshot.img_new, v);
+            break;
+        case LV_SCR_LOAD_ANIM_OVER_TOP:
+        case LV_SCR_LOAD_ANIM_OVER_BOTTOM:
+            lv_obj_set_y(snapshot.img_new, v);
+            break;
+        case LV_SCR_LOAD_ANIM_MOVE_LEFT:
+            lv_obj_set_x(snapshot.img_new, v);
+            lv_obj_set_x(snapshot.img_old, v - w);
+            break;
+        case LV_SCR_LOAD_ANIM_MOVE_RIGHT:
+            lv_obj_set_x(snapshot.img_new, v);
+            lv_obj_set_x(snapshot.img_old, v + w);
+            break;
+        case LV_SCR_LOAD_ANIM_MOVE_TOP:
+            lv_obj_set_y(snapshot.img_new, v);
+            lv_obj_set_y(snapshot.img_old, v - h);
+            break;
+        case LV_SCR_LOAD_ANIM_MOVE_BOTTOM:
+            lv_obj_set_y(snapshot.img_new, v);
+            lv_obj_set_y(snapshot.img_old, v + h);
+            break;
+        case LV_SCR_LOAD_ANIM_FADE_ON:
+            lv_obj_set_style_local_image_opa(snapshot.img_new, LV_IMG_PART_MAIN, LV_STATE_DEFAULT, v);
+            break;
+        default:
+            break;
+    }
+    snapshot.frames++;
+}
+
+static void my_scr_snapshot_event_cb(lv_obj_t*, lv_event_t event)
+{
+    if(event != LV_EVENT_DELETE) return;
+    snapshot.scr     = NULL;
+    snapshot.img_old = NULL;
+    snapshot.img_new = NULL;
+}
+
+static void my_scr_snapshot_start(lv_anim_t* a)
+{
+    lv_obj_t* new_scr = (lv_obj_t*)a->var;
+    lv_disp_t* d      = lv_obj_get_disp(new_scr);
+    d->prev_scr       = lv_scr_act();
+
+    uint32_t start = lv_tick_get();
+    my_scr_snapshot_draw(d->prev_scr, &snapshot.dsc_old);
+    my_scr_snapshot_draw(new_scr, &snapshot.dsc_new);
+    anim_stats[snapshot.type].capture += lv_tick_elaps(start);
+
+    snapshot.scr = lv_obj_create(NULL, NULL);
+    lv_obj_set_event_cb(snapshot.scr, my_scr_snapshot_event_cb);
+    snapshot.img_old = lv_img_create(snapshot.scr, NULL);
+    lv_img_set_src(snapshot.img_old, &snapshot.dsc_old);
+    snapshot.img_new = lv_img_create(snapshot.scr, NULL);
+    lv_img_set_src(snapshot.img_new, &snapshot.dsc_new);
+    my_scr_snapshot_exec(NULL, a->start); // no frame with the new page in place yet
+
+    lv_disp_load_scr(snapshot.scr);
+    snapshot.start  = lv_tick_get();
+    snapshot.frames = 0;
+}
+
+// Load the new page, also when a transition is cut short by the next one
+static void my_scr_snapshot_finish(lv_disp_t* d)
+{
+    lv_obj_t* new_scr = d->scr_to_load;
+    lv_obj_t* old_scr = d->prev_scr;
+    d->prev_scr       = NULL;
+    d->scr_to_load    = NULL;
+
+    if(snapshot.scr) {
+        my_scr_anim_stats_t* stats = &anim_stats[snapshot.type];
+        stats->count++;
+        stats->frames += snapshot.frames;
+        stats->time += lv_tick_elaps(snapshot.start);
+    }
+
+    if(new_scr) my_scr_load_page(new_scr);
+    if(snapshot.scr) lv_obj_del(snapshot.scr);
+    my_scr_snapshot_free();
+    if(old_scr && d->del_prev) lv_obj_del(old_scr);
+}
+
+static void my_scr_snapshot_ready(lv_anim_t* a)
+{
+    my_scr_snapshot_finish(lv_obj_get_disp((lv_obj_t*)a->var));
+}
+
 static void my_opa_scale_anim(lv_obj_t* obj, lv_anim_value_t v)
 {
     lv_obj_set_style_local_opa_scale(obj, LV_OBJ_PART_MAIN, LV_STATE_DEFAULT, v);
@@ -51,7 +283,14 @@ static void my_scr_anim_ready(lv_anim_t* a)
  */
 void my_scr_load_anim(lv_obj_t* new_scr, lv_scr_load_anim_t anim_type, uint32_t time, uint32_t delay, bool auto_del)
 {
-    lv_disp_t* d      = lv_obj_get_disp(new_scr);
+    lv_disp_t* d = lv_obj_get_disp(new_scr);
+
+    if(snapshot.scr) {
+        /*Finish the running snapshot transition*/
+        lv_anim_del(d->scr_to_load, NULL);
+        my_scr_snapshot_finish(d);
+    }
+
     lv_obj_t* act_scr = lv_scr_act();
 
     if(d->scr_to_load && act_scr != d->scr_to_load) {
@@ -156,8 +395,39 @@ void my_scr_load_anim(lv_obj_t* new_scr, lv_scr_load_anim_t anim_type, uint32_t
             break;
     }
 
+    bool animated = anim_type > LV_SCR_LOAD_ANIM_NONE && anim_type <= LV_SCR_LOAD_ANIM_FADE_ON && time > 0;
+    if(animated && my_scr_snapshot_alloc(d)) {
+        /*Animate snapshots of both screens with the values of a_new*/
+        snapshot.type = anim_type;
+        lv_anim_set_start_cb(&a_new, my_scr_snapshot_start);
+        lv_anim_set_ready_cb(&a_new, my_scr_snapshot_ready);
+        lv_anim_set_exec_cb(&a_new, my_scr_snapshot_exec);
+        lv_anim_start(&a_new);
+        return;
+    }
+
+    my_scr_snapshot_free(); // a snapshot transition was still waiting for its delay
+    if(animated) anim_stats[anim_type].live++;
+
     lv_anim_start(&a_new);
     lv_anim_start(&a_old);
 }
 
+void my_scr_anim_get_info(JsonDocument& doc)
+{
+    JsonObject info = doc.createNestedObject(F("Page Transitions"));
+    char buffer[64];
+
+    for(uint8_t i = LV_SCR_LOAD_ANIM_NONE + 1; i <= LV_SCR_LOAD_ANIM_FADE_ON; i++) {
+        const my_scr_anim_stats_t* stats = &anim_stats[i];
+        if(stats->count == 0 && stats->live == 0) continue;
+
+        unsigned fps     = stats->time ? stats->frames * 1000 / stats->time : 0;
+        unsigned capture = stats->count ? stats->capture / stats->count : 0;
+        snprintf_P(buffer, sizeof(buffer), PSTR("%u fps, %u ms capture (%u snapshot, %u live)"), fps, capture,
+                   stats->count, stats->live);
+        info[anim_names[i]] = buffer;
+    }
+}
+
 #endif
\ No newline at end of file
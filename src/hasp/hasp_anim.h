@@ -28,4 +28,10 @@ void my_scr_load_anim(lv_obj_t * new_scr, lv_scr_load_anim_t anim_type, uint32_t
 } /* extern "C" */
 #endif
 
+#if defined(__cplusplus) && LV_USE_ANIMATION
+#include "ArduinoJson.h"
+
+void my_scr_anim_get_info(JsonDocument& doc);
+#endif
+
 #endif
\ No newline at end of file
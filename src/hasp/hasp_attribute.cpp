@@ -2,6 +2,9 @@
    For full license information read the LICENSE file in the project folder */
 
 #include "hasplib.h"
+#if HASP_USE_MQTT > 0
+#include "mqtt/hasp_mqtt_binding.h"
+#endif
 #include "hasp_attribute_helper.h"
 
 /*** Image Improvement ***/
@@ -46,6 +49,7 @@ void my_image_release_resources(lv_obj_t* obj)
 
         case LV_IMG_SRC_FILE:
             lv_img_cache_invalidate_src(src); // remove src from image cache
+            hasp_img_cache_invalidate(src);   // free the decoded image when no other object uses it
             break;
 
         default:
@@ -53,136 +57,671 @@ void my_image_release_resources(lv_obj_t* obj)
     }
 }
 
-void my_btnmatrix_map_clear(lv_obj_t* obj)
+/* ===== Attribute transactions =====
+ * Between hasp_attribute_begin() and hasp_attribute_commit() the coordinates of objects are collected and local
+ * style properties are written without refreshing the object. The commit applies them with one position, one size
+ * and a refresh of the changed style properties per object part, a full style refresh only when the layout changes.
+ * Parts with a style transition are written immediately. Any other attribute applies the pending coordinates first,
+ * so the result is the same as setting the attributes one by one. */
+enum { TXN_X = 1, TXN_Y = 2, TXN_W = 4, TXN_H = 8 };
+
+typedef struct
 {
-    lv_btnmatrix_ext_t* ext = (lv_btnmatrix_ext_t*)lv_obj_get_ext_attr(obj);
-    const char** map_p_tmp  = ext->map_p; // store current pointer
+    uint8_t part;
+    uint8_t prop_count;                             // properties with a postponed refresh
+    lv_style_property_t props[HASP_ATTR_TXN_PROPS]; // LV_STYLE_PROP_ALL when the layout changes or too many
+} attribute_txn_part_t;
 
-    LOG_DEBUG(TAG_ATTR, "%s %d %x   btn_cnt: %d", __FILE__, __LINE__, map_p_tmp, ext->btn_cnt);
+typedef struct
+{
+    lv_obj_t* obj;
+    lv_coord_t x;
+    lv_coord_t y;
+    lv_coord_t w;
+    lv_coord_t h;
+    uint8_t geometry;                                // pending coordinates
+    uint8_t part_count;                              // parts with a postponed style refresh
+    attribute_txn_part_t parts[HASP_ATTR_TXN_PARTS]; // LV_OBJ_PART_ALL when there are too many
+} attribute_txn_obj_t;
+
+static struct
+{
+    attribute_txn_obj_t objs[HASP_ATTR_TXN_OBJECTS];
+    uint8_t count;
+    uint8_t depth;
+    uint16_t inv_start; // first invalidated area of the display when the transaction started
+    uint32_t start;
+} attribute_txn;
 
-    if(ext->map_p && (ext->btn_cnt > 0)) {
+static hasp_attribute_stats_t attribute_stats;
+static JsonObject* attribute_sink = nullptr; // collects returned values instead of dispatching them
 
-        // The map exists and is not the default lvgl map anymore
-        if((map_p_tmp == NULL) || (btnmatrix_default_map == NULL) || (map_p_tmp == btnmatrix_default_map)) return;
+static void attribute_update_cpicker_type(lv_obj_t* obj)
+{
+    if(obj_check_type(obj, LV_HASP_CPICKER)) {
+#if LVGL_VERSION_MAJOR == 7
+        lv_cpicker_set_type(obj, lv_obj_get_width(obj) == lv_obj_get_height(obj) ? LV_CPICKER_TYPE_DISC
+                                                                                 : LV_CPICKER_TYPE_RECT);
+#endif
+    }
+}
 
-        LOG_DEBUG(TAG_ATTR, "%s %d %x", __FILE__, __LINE__,
-                  *map_p_tmp);                                          // label buffer reserved as a contiguous block
-        LOG_DEBUG(TAG_ATTR, "%s %d %x", __FILE__, __LINE__, map_p_tmp); // label pointer array block
-        lv_btnmatrix_set_map(obj, btnmatrix_default_map);               // reset to default btnmap pointer
+static void attribute_txn_apply_geometry(attribute_txn_obj_t* t)
+{
+    lv_obj_t* obj = t->obj;
+    if(!obj || !t->geometry) return;
+
+    if(t->geometry & (TXN_X | TXN_Y)) {
+        lv_obj_set_pos(obj, t->geometry & TXN_X ? t->x : lv_obj_get_x(obj),
+                       t->geometry & TXN_Y ? t->y : lv_obj_get_y(obj));
+        attribute_stats.refreshes++;
+    }
 
-        LOG_DEBUG(TAG_ATTR, F("%s %d"), __FILE__, __LINE__);
-        lv_mem_free(*map_p_tmp); // free label buffer reserved as a contiguous block
-        LOG_DEBUG(TAG_ATTR, F("%s %d"), __FILE__, __LINE__);
-        lv_mem_free(map_p_tmp); // free label pointer array block
-        LOG_DEBUG(TAG_ATTR, F("%s %d"), __FILE__, __LINE__);
+    if(t->geometry & (TXN_W | TXN_H)) {
+        lv_obj_set_size(obj, t->geometry & TXN_W ? t->w : lv_obj_get_width(obj),
+                        t->geometry & TXN_H ? t->h : lv_obj_get_height(obj));
+        attribute_update_cpicker_type(obj);
+        attribute_stats.refreshes++;
     }
+
+    t->geometry = 0;
 }
 
-void my_msgbox_map_clear(lv_obj_t* obj)
+// Refresh only the changed properties, most of them just invalidate the object
+static void attribute_txn_apply_styles(attribute_txn_obj_t* t)
 {
-    lv_msgbox_ext_t* ext_msgbox = (lv_msgbox_ext_t*)lv_obj_get_ext_attr(obj);
-    if(!ext_msgbox) return;
+    if(t->obj) {
+        for(uint8_t i = 0; i < t->part_count; i++) {
+            attribute_txn_part_t* p = &t->parts[i];
+            for(uint8_t j = 0; j < p->prop_count; j++) {
+                lv_obj_refresh_style(t->obj, p->part, p->props[j]);
+                attribute_stats.refreshes++;
+            }
+        }
+    }
+    t->part_count = 0;
+}
 
-    lv_obj_t* btnmatrix = ext_msgbox->btnm; // Get buttonmatrix object
-    if(!btnmatrix) return;
+// Apply all pending coordinates, in the order the objects were changed
+static void attribute_txn_flush_geometry()
+{
+    for(uint8_t i = 0; i < attribute_txn.count; i++) attribute_txn_apply_geometry(&attribute_txn.objs[i]);
+}
 
-    lv_btnmatrix_ext_t* ext_btnmatrix = (lv_btnmatrix_ext_t*)lv_obj_get_ext_attr(btnmatrix);
-    if(!ext_btnmatrix) return;
+static void attribute_txn_apply()
+{
+    attribute_txn_flush_geometry();
+    for(uint8_t i = 0; i < attribute_txn.count; i++) attribute_txn_apply_styles(&attribute_txn.objs[i]);
+    attribute_txn.count = 0;
+}
 
-    if(ext_btnmatrix->map_p != msgbox_default_map) // Don't clear the default btnmap
-        my_btnmatrix_map_clear(btnmatrix);         // Clear the custom button map if it exists
+static attribute_txn_obj_t* attribute_txn_get(lv_obj_t* obj)
+{
+    for(uint8_t i = 0; i < attribute_txn.count; i++) {
+        if(attribute_txn.objs[i].obj == obj) return &attribute_txn.objs[i];
+    }
+
+    if(attribute_txn.count >= HASP_ATTR_TXN_OBJECTS) attribute_txn_apply(); // table is full
+
+    attribute_txn_obj_t* t = &attribute_txn.objs[attribute_txn.count++];
+    memset(t, 0, sizeof(attribute_txn_obj_t));
+    t->obj = obj;
+    return t;
 }
 
-// Create new btnmatrix button map from json array
-const char** my_map_create(const char* payload)
+// Postpone a coordinate change, returns false if no transaction is open
+static bool attribute_txn_set_coord(lv_obj_t* obj, uint8_t flag, lv_coord_t val)
 {
-    // Reserve memory for JsonDocument
-    // StaticJsonDocument<1024> map_doc;
-    size_t maxsize = (128u * ((strlen(payload) / 128) + 1)) + 256;
-    DynamicJsonDocument map_doc(maxsize);
-    DeserializationError jsonError = deserializeJson(map_doc, payload);
+    if(attribute_txn.depth == 0) return false;
 
-    if(jsonError) { // Couldn't parse incoming JSON payload
+    attribute_txn_obj_t* t = attribute_txn_get(obj);
+    switch(flag) {
+        case TXN_X:
+            t->x = val;
+            break;
+        case TXN_Y:
+            t->y = val;
+            break;
+        case TXN_W:
+            t->w = val;
+            break;
+        default:
+            t->h = val;
+    }
+    t->geometry |= flag;
+    attribute_stats.deferred++;
+    return true;
+}
+
+// Get a coordinate of the object, a change that is still pending in the transaction included
+static lv_coord_t attribute_txn_get_coord(lv_obj_t* obj, uint8_t flag)
+{
+    for(uint8_t i = 0; i < attribute_txn.count; i++) {
+        attribute_txn_obj_t* t = &attribute_txn.objs[i];
+        if(t->obj != obj || !(t->geometry & flag)) continue;
+
+        switch(flag) {
+            case TXN_X:
+                return t->x;
+            case TXN_Y:
+                return t->y;
+            case TXN_W:
+                return t->w;
+            default:
+                return t->h;
+        }
+    }
+
+    switch(flag) {
+        case TXN_X:
+            return lv_obj_get_x(obj);
+        case TXN_Y:
+            return lv_obj_get_y(obj);
+        case TXN_W:
+            return lv_obj_get_width(obj);
+        default:
+            return lv_obj_get_height(obj);
+    }
+}
+
+// Properties that change the size or layout of the object or its children need a full style refresh
+static bool attribute_txn_is_layout_prop(lv_style_property_t prop)
+{
+    switch(prop & ~LV_STYLE_STATE_MASK) {
+        case LV_STYLE_PAD_TOP:
+        case LV_STYLE_PAD_BOTTOM:
+        case LV_STYLE_PAD_LEFT:
+        case LV_STYLE_PAD_RIGHT:
+        case LV_STYLE_PAD_INNER:
+        case LV_STYLE_MARGIN_TOP:
+        case LV_STYLE_MARGIN_BOTTOM:
+        case LV_STYLE_MARGIN_LEFT:
+        case LV_STYLE_MARGIN_RIGHT:
+        case LV_STYLE_BORDER_WIDTH:
+        case LV_STYLE_TEXT_FONT:
+            return true;
+        default:
+            return false;
+    }
+}
+
+static void attribute_txn_add_prop(attribute_txn_part_t* p, lv_style_property_t prop)
+{
+    prop &= ~LV_STYLE_STATE_MASK;
+    if(p->prop_count == 1 && p->props[0] == LV_STYLE_PROP_ALL) return; // already refreshing everything
+
+    if(attribute_txn_is_layout_prop(prop) || p->prop_count >= HASP_ATTR_TXN_PROPS) {
+        p->props[0]   = LV_STYLE_PROP_ALL;
+        p->prop_count = 1;
+        return;
+    }
+
+    for(uint8_t i = 0; i < p->prop_count; i++) {
+        if(p->props[i] == prop) return;
+    }
+    p->props[p->prop_count++] = prop;
+}
+
+static attribute_txn_part_t* attribute_txn_get_part(attribute_txn_obj_t* t, uint8_t part)
+{
+    for(uint8_t i = 0; i < t->part_count; i++) {
+        if(t->parts[i].part == part || t->parts[i].part == LV_OBJ_PART_ALL) return &t->parts[i];
+    }
+
+    if(t->part_count >= HASP_ATTR_TXN_PARTS) { // refresh all parts instead
+        t->part_count          = 1;
+        t->parts[0].part       = LV_OBJ_PART_ALL;
+        t->parts[0].props[0]   = LV_STYLE_PROP_ALL;
+        t->parts[0].prop_count = 1;
+        return &t->parts[0];
+    }
+
+    attribute_txn_part_t* p = &t->parts[t->part_count++];
+    p->part                 = part;
+    p->prop_count           = 0;
+    return p;
+}
+
+// Get the local style of a part to write prop to, or NULL if the change must be applied immediately
+static lv_style_t* attribute_txn_get_style(lv_obj_t* obj, uint8_t part, lv_style_property_t prop)
+{
+    if(attribute_txn.depth == 0) return NULL;
+
+    lv_style_list_t* list = lv_obj_get_style_list(obj, part);
+    if(!list) return NULL;
+
+    // Only the lv_obj_set_style_local_* setters stop a running transition that would overwrite the value
+    if(lv_obj_get_style_transition_time(obj, part) > 0) return NULL;
+    list->valid_cache = 0; // getters must not use the cached flags until the refresh
+
+    attribute_txn_obj_t* t = attribute_txn_get(obj);
+    attribute_txn_add_prop(attribute_txn_get_part(t, part), prop);
+
+    attribute_stats.deferred++;
+    return _lv_style_list_get_local_style(list);
+}
+
+/* ===== No-op write elimination =====
+ * A setter is skipped when the local style of the part already holds the value for exactly this state.
+ * The weight returned by _lv_style_get_* equals the requested state only for an exact match. */
+static lv_style_t* attribute_get_local_style(lv_obj_t* obj, uint8_t part)
+{
+    lv_style_list_t* list = lv_obj_get_style_list(obj, part);
+    return list ? lv_style_list_get_local_style(list) : NULL;
+}
+
+static bool attribute_style_int_unchanged(lv_obj_t* obj, uint8_t part, lv_state_t state, lv_style_property_t prop,
+                                          int32_t val, bool is_int)
+{
+    lv_style_t* local = attribute_get_local_style(obj, part);
+    if(!local) return false;
+
+    if(is_int) {
+        lv_style_int_t current;
+        return _lv_style_get_int(local, prop, &current) == state && current == val;
+    } else {
+        lv_opa_t current;
+        return _lv_style_get_opa(local, prop, &current) == state && current == val;
+    }
+}
+
+static bool attribute_style_color_unchanged(lv_obj_t* obj, uint8_t part, lv_state_t state, lv_style_property_t prop,
+                                            lv_color_t color)
+{
+    lv_style_t* local = attribute_get_local_style(obj, part);
+    lv_color_t current;
+    return local && _lv_style_get_color(local, prop, &current) == state && current.full == color.full;
+}
+
+static bool attribute_value_str_unchanged(lv_obj_t* obj, uint8_t part, lv_state_t state, const char* text)
+{
+    lv_style_t* local = attribute_get_local_style(obj, part);
+    const char* current;
+    return local && _lv_style_get_ptr(local, LV_STYLE_VALUE_STR | (state << LV_STYLE_STATE_POS), &current) == state &&
+           current && text && !strcmp(current, text);
+}
+
+void attribute_set_style_int(lv_obj_t* obj, uint8_t part, lv_state_t state, lv_style_property_t prop, int32_t val)
+{
+    prop |= state << LV_STYLE_STATE_POS;
+    bool is_int = (prop & 0xF) < LV_STYLE_ID_COLOR;
+
+    if(attribute_style_int_unchanged(obj, part, state, prop, val, is_int)) {
+        attribute_stats.unchanged++;
+        return;
+    }
+
+    if(lv_style_t* style = attribute_txn_get_style(obj, part, prop)) {
+        if(is_int)
+            _lv_style_set_int(style, prop, (lv_style_int_t)val);
+        else
+            _lv_style_set_opa(style, prop, (lv_opa_t)val);
+    } else {
+        if(is_int)
+            _lv_obj_set_style_local_int(obj, part, prop, (lv_style_int_t)val);
+        else
+            _lv_obj_set_style_local_opa(obj, part, prop, (lv_opa_t)val);
+    }
+}
+
+void attribute_set_style_color(lv_obj_t* obj, uint8_t part, lv_state_t state, lv_style_property_t prop,
+                               lv_color_t color)
+{
+    prop |= state << LV_STYLE_STATE_POS;
+
+    if(attribute_style_color_unchanged(obj, part, state, prop, color)) {
+        attribute_stats.unchanged++;
+        return;
+    }
+
+    if(lv_style_t* style = attribute_txn_get_style(obj, part, prop))
+        _lv_style_set_color(style, prop, color);
+    else
+        _lv_obj_set_style_local_color(obj, part, prop, color);
+}
+
+/**
+ * Start collecting attribute changes, transactions can be nested
+ */
+void hasp_attribute_begin()
+{
+    if(attribute_txn.depth++ > 0) return;
+
+    lv_disp_t* disp         = lv_disp_get_default();
+    attribute_txn.inv_start = disp ? disp->inv_p : 0;
+    attribute_txn.start     = millis();
+}
+
+/**
+ * Apply the collected attribute changes when the outermost transaction ends
+ */
+void hasp_attribute_commit()
+{
+    if(attribute_txn.depth == 0 || --attribute_txn.depth > 0) return;
+
+    attribute_txn_apply();
+
+    // Sum the areas invalidated since the start, the buffer is restarted when it overflowed
+    uint32_t area   = 0;
+    lv_disp_t* disp = lv_disp_get_default();
+    if(disp) {
+        uint16_t first = disp->inv_p < attribute_txn.inv_start ? 0 : attribute_txn.inv_start;
+        for(uint16_t i = first; i < disp->inv_p; i++) {
+            if(!disp->inv_area_joined[i]) area += lv_area_get_size(&disp->inv_areas[i]);
+        }
+    }
+
+    uint32_t elapsed = millis() - attribute_txn.start;
+    attribute_stats.transactions++;
+    attribute_stats.area += area;
+    attribute_stats.last_area = area;
+    attribute_stats.time += elapsed;
+    if(elapsed > attribute_stats.max_time) attribute_stats.max_time = elapsed;
+}
+
+// Drop the pending changes of an object that is being deleted
+void hasp_attribute_forget(lv_obj_t* obj)
+{
+    for(uint8_t i = 0; i < attribute_txn.count; i++) {
+        if(attribute_txn.objs[i].obj == obj) attribute_txn.objs[i].obj = NULL;
+    }
+}
+
+void hasp_attribute_get_info(JsonDocument& doc)
+{
+    JsonObject info            = doc.createNestedObject(F("Attributes"));
+    info[F("transactions")]    = attribute_stats.transactions;
+    info[F("deferred")]        = attribute_stats.deferred;
+    info[F("refreshes")]       = attribute_stats.refreshes;
+    info[F("invalidatedArea")] = attribute_stats.area;
+    info[F("lastArea")]        = attribute_stats.last_area;
+    info[F("time")]            = attribute_stats.time;
+    info[F("maxTime")]         = attribute_stats.max_time;
+    info[F("writes")]          = attribute_stats.writes;
+    info[F("unchanged")]       = attribute_stats.unchanged;
+}
+
+/* Button maps are stored in a single lv_mem block:
+ * [my_map_header_t][const char* ptr[count + 1]][packed labels]
+ * Identical maps are shared between objects and reference counted */
+typedef struct my_map_header_t
+{
+    struct my_map_header_t* next; // list of all custom maps
+    uint32_t hash;                // hash of the packed labels
+    uint16_t refcnt;              // number of objects using this map
+    uint16_t count;               // number of buttons, including line breaks
+    uint16_t size;                // bytes used by the packed labels
+    uint16_t capacity;            // bytes available for the pointer table and packed labels
+} my_map_header_t;
+
+static my_map_header_t* my_map_list = NULL;
+
+static inline const char** my_map_ptrs(my_map_header_t* header)
+{
+    return (const char**)(header + 1);
+}
+
+// Returns the header if the map was created by my_map_create, NULL for the static default maps
+static my_map_header_t* my_map_find_header(const char** map)
+{
+    if(!map) return NULL;
+    for(my_map_header_t* header = my_map_list; header; header = header->next)
+        if(my_map_ptrs(header) == map) return header;
+    return NULL;
+}
+
+static void my_map_release(my_map_header_t* header)
+{
+    if(!header || --header->refcnt > 0) return;
+
+    my_map_header_t** link = &my_map_list;
+    while(*link && *link != header) link = &(*link)->next;
+    if(*link) *link = header->next;
+    lv_mem_free(header);
+}
+
+static inline void my_map_putc(char* buffer, size_t& len, uint32_t& hash, char c)
+{
+    if(buffer) buffer[len] = c;
+    len++;
+    hash = (hash ^ (uint8_t)c) * 16777619u; // FNV-1a
+}
+
+// Decode a flat json array of strings into packed \0 separated labels
+// Call with buffer == NULL to measure the required size
+static bool my_map_parse(const char* payload, char* buffer, size_t& count, size_t& size, uint32_t& hash)
+{
+    const char* p = payload;
+    count         = 0;
+    size          = 0;
+    hash          = 2166136261u;
+
+    while(*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n') p++;
+    if(*p++ != '[') return false;
+
+    while(true) {
+        while(*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n' || *p == ',') p++;
+        if(*p == ']') break;
+        if(*p == '\0') return false;
+
+        if(*p == '"') {
+            p++;
+            while(*p != '"') {
+                if(*p == '\0') return false;
+                if(*p != '\\') {
+                    my_map_putc(buffer, size, hash, *p++);
+                    continue;
+                }
+
+                p++;
+                switch(*p) {
+                    case 'n':
+                        my_map_putc(buffer, size, hash, '\n');
+                        break;
+                    case 't':
+                        my_map_putc(buffer, size, hash, '\t');
+                        break;
+                    case 'r':
+                        my_map_putc(buffer, size, hash, '\r');
+                        break;
+                    case 'b':
+                        my_map_putc(buffer, size, hash, '\b');
+                        break;
+                    case 'f':
+                        my_map_putc(buffer, size, hash, '\f');
+                        break;
+                    case 'u': {
+                        char hex[5] = {0};
+                        for(uint8_t i = 0; i < 4; i++) {
+                            if(!isxdigit(p[1])) return false;
+                            hex[i] = *++p;
+                        }
+                        uint32_t cp = strtoul(hex, NULL, 16);
+                        if(cp >= 0xD800 && cp <= 0xDBFF && p[1] == '\\' && p[2] == 'u') { // surrogate pair
+                            for(uint8_t i = 0; i < 4; i++) {
+                                if(!isxdigit(p[3 + i])) return false;
+                                hex[i] = p[3 + i];
+                            }
+                            uint32_t low = strtoul(hex, NULL, 16);
+                            if(low < 0xDC00 || low > 0xDFFF) return false; // not a low surrogate
+                            cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                            p += 6;
+                        }
+                        if(cp == 0) return false; // would split the label, the labels are separated by NUL
+                        if(cp < 0x80) {
+                            my_map_putc(buffer, size, hash, cp);
+                        } else if(cp < 0x800) {
+                            my_map_putc(buffer, size, hash, 0xC0 | (cp >> 6));
+                            my_map_putc(buffer, size, hash, 0x80 | (cp & 0x3F));
+                        } else if(cp < 0x10000) {
+                            my_map_putc(buffer, size, hash, 0xE0 | (cp >> 12));
+                            my_map_putc(buffer, size, hash, 0x80 | ((cp >> 6) & 0x3F));
+                            my_map_putc(buffer, size, hash, 0x80 | (cp & 0x3F));
+                        } else {
+                            my_map_putc(buffer, size, hash, 0xF0 | (cp >> 18));
+                            my_map_putc(buffer, size, hash, 0x80 | ((cp >> 12) & 0x3F));
+                            my_map_putc(buffer, size, hash, 0x80 | ((cp >> 6) & 0x3F));
+                            my_map_putc(buffer, size, hash, 0x80 | (cp & 0x3F));
+                        }
+                        break;
+                    }
+                    case '\0':
+                        return false;
+                    default: // \" \\ \/
+                        my_map_putc(buffer, size, hash, *p);
+                }
+                p++;
+            }
+            p++; // closing quote
+
+        } else { // unquoted value, use the literal text
+            while(*p != ',' && *p != ']' && *p != '\0' && *p != ' ') my_map_putc(buffer, size, hash, *p++);
+        }
+
+        my_map_putc(buffer, size, hash, '\0');
+        count++;
+    }
+
+    my_map_putc(buffer, size, hash, '\0'); // trailing "" terminates the map
+    return true;
+}
+
+// Point the pointer table to the packed labels
+static void my_map_index(my_map_header_t* header)
+{
+    const char** ptrs = my_map_ptrs(header);
+    char* label       = (char*)(ptrs + header->count + 1);
+
+    for(uint16_t i = 0; i <= header->count; i++) {
+        ptrs[i] = label;
+        label += strlen(label) + 1;
+    }
+}
+
+/* Create a button map from a json array
+ * Returns a shared map with identical labels if one exists, reuses the current map of the object if it is not
+ * shared and large enough or else makes a single new allocation */
+const char** my_map_create(const char* payload, const char** current)
+{
+    size_t count;
+    size_t size;
+    uint32_t hash;
+
+    if(!my_map_parse(payload, NULL, count, size, hash)) {
+        DeserializationError jsonError = DeserializationError::InvalidInput;
         dispatch_json_error(TAG_ATTR, jsonError);
         return NULL;
     }
 
-    JsonArray arr = map_doc.as<JsonArray>(); // Parse payload
-
-    size_t tot_len            = sizeof(char*) * (arr.size() + 1);
-    const char** map_data_str = (const char**)lv_mem_alloc(tot_len);
-    if(map_data_str == NULL) {
-        LOG_ERROR(TAG_ATTR, F("Out of memory while creating button map"));
+    // The header stores the sizes in 16 bits
+    size_t data_len = sizeof(char*) * (count + 1) + size;
+    if(data_len > UINT16_MAX) {
+        LOG_ERROR(TAG_ATTR, F("Button map of %u bytes is too large"), data_len);
         return NULL;
     }
-    memset(map_data_str, 0, tot_len);
 
-    // Create buffer
-    tot_len = 0;
-    for(JsonVariant btn : arr) {
-        tot_len += strlen(btn.as<const char*>()) + 1;
+    my_map_header_t* old = my_map_find_header(current);
+
+    // Share an existing map with the same labels
+    for(my_map_header_t* header = my_map_list; header; header = header->next) {
+        if(header->hash != hash || header->count != count || header->size != size) continue;
+
+        char* buffer = (char*)(my_map_ptrs(header) + count + 1);
+        char* labels = (char*)lv_mem_buf_get(size);
+        if(!labels) break;
+        my_map_parse(payload, labels, count, size, hash);
+        bool equal = memcmp(buffer, labels, size) == 0;
+        lv_mem_buf_release(labels);
+        if(!equal) continue;
+
+        if(header != old) header->refcnt++;
+        LOG_VERBOSE(TAG_ATTR, F("Sharing button map %x (%d users)"), my_map_ptrs(header), header->refcnt);
+        return my_map_ptrs(header);
+    }
+
+    // Refill the current map in place
+    if(old && old->refcnt == 1 && old->capacity >= data_len) {
+        old->count = count;
+        old->size  = size;
+        old->hash  = hash;
+        my_map_parse(payload, (char*)(my_map_ptrs(old) + count + 1), count, size, hash);
+        my_map_index(old);
+        LOG_VERBOSE(TAG_ATTR, F("Reusing button map %x"), current);
+        return current;
     }
-    tot_len++; // trailing '\0'
-    LOG_VERBOSE(TAG_ATTR, F("Array Size = %d, Map Length = %d"), arr.size(), tot_len);
 
-    char* buffer_addr = (char*)lv_mem_alloc(tot_len);
-    if(buffer_addr == NULL) {
-        lv_mem_free(map_data_str);
+    my_map_header_t* header = (my_map_header_t*)lv_mem_alloc(sizeof(my_map_header_t) + data_len);
+    if(header == NULL) {
         LOG_ERROR(TAG_ATTR, F("Out of memory while creating button map"));
         return NULL;
     }
-    memset(buffer_addr, 0, tot_len); // Important, last index needs to be 0 => empty string ""
 
-    /* Point of no return, destroy & free the previous map */
-    LOG_DEBUG(TAG_ATTR, F("%s %d   map addr:  %x"), __FILE__, __LINE__, map_data_str);
-    // my_btnmatrix_map_clear(obj); // Free previous map
+    header->hash     = hash;
+    header->refcnt   = 1;
+    header->count    = count;
+    header->size     = size;
+    header->capacity = data_len;
+    my_map_parse(payload, (char*)(my_map_ptrs(header) + count + 1), count, size, hash);
+    my_map_index(header);
 
-    // Fill buffer
-    size_t index = 0;
-    size_t pos   = 0;
-    LOG_DEBUG(TAG_ATTR, F("%s %d   lbl addr:  %x"), __FILE__, __LINE__, buffer_addr);
-    for(JsonVariant btn : arr) {
-        // size_t len = btn.as<String>().length() + 1;
-        size_t len = strlen(btn.as<const char*>()) + 1;
-        LOG_VERBOSE(TAG_ATTR, F(D_BULLET "Adding button: %s (%d bytes) %x"), btn.as<const char*>(), len,
-                    buffer_addr + pos);
-        // LOG_VERBOSE(TAG_ATTR, F(D_BULLET "Adding button: %s (%d bytes) %x"), btn.as<String>().c_str(), len,
-        // buffer_addr + pos);
-        memccpy(buffer_addr + pos, btn.as<const char*>(), 0, len); // Copy the label text into the buffer
-        // memccpy(buffer_addr + pos, btn.as<String>().c_str(), 0, len); // Copy the label text into the buffer
-        map_data_str[index++] = buffer_addr + pos; // save pointer to the label in the array
-        pos += len;
-    }
-    map_data_str[index] = buffer_addr + pos; // save pointer to the last \0 byte
-
-    LOG_DEBUG(TAG_ATTR, F("%s %d"), __FILE__, __LINE__);
-    return map_data_str;
+    header->next = my_map_list;
+    my_map_list  = header;
+
+    LOG_VERBOSE(TAG_ATTR, F("Array Size = %d, Map Length = %d"), count, data_len);
+    return my_map_ptrs(header);
+}
+
+void my_btnmatrix_map_clear(lv_obj_t* obj)
+{
+    lv_btnmatrix_ext_t* ext = (lv_btnmatrix_ext_t*)lv_obj_get_ext_attr(obj);
+    const char** map_p_tmp  = ext->map_p; // store current pointer
+
+    // The map exists and is not the default lvgl map anymore
+    if((map_p_tmp == NULL) || (btnmatrix_default_map == NULL) || (map_p_tmp == btnmatrix_default_map)) return;
+
+    my_map_header_t* header = my_map_find_header(map_p_tmp);
+    if(!header) return; // static map
+
+    lv_btnmatrix_set_map(obj, btnmatrix_default_map); // reset to default btnmap pointer
+    my_map_release(header);                           // free the map when no other object uses it
+}
+
+void my_msgbox_map_clear(lv_obj_t* obj)
+{
+    lv_msgbox_ext_t* ext_msgbox = (lv_msgbox_ext_t*)lv_obj_get_ext_attr(obj);
+    if(!ext_msgbox) return;
+
+    lv_obj_t* btnmatrix = ext_msgbox->btnm; // Get buttonmatrix object
+    if(!btnmatrix) return;
+
+    lv_btnmatrix_ext_t* ext_btnmatrix = (lv_btnmatrix_ext_t*)lv_obj_get_ext_attr(btnmatrix);
+    if(!ext_btnmatrix) return;
+
+    if(ext_btnmatrix->map_p != msgbox_default_map) // Don't clear the default btnmap
+        my_btnmatrix_map_clear(btnmatrix);         // Clear the custom button map if it exists
 }
 
 static void my_btnmatrix_set_map(lv_obj_t* obj, const char* payload)
 {
-    LOG_DEBUG(TAG_ATTR, F("%s %d"), __FILE__, __LINE__);
-    const char** map = my_map_create(payload);
+    lv_btnmatrix_ext_t* ext = (lv_btnmatrix_ext_t*)lv_obj_get_ext_attr(obj);
+    const char** map        = my_map_create(payload, ext->map_p);
     if(!map) return;
 
-    LOG_DEBUG(TAG_ATTR, F("%s %d"), __FILE__, __LINE__);
-    my_btnmatrix_map_clear(obj); // Free previous map
-    LOG_DEBUG(TAG_ATTR, F("%s %d"), __FILE__, __LINE__);
+    if(map != ext->map_p) my_btnmatrix_map_clear(obj); // Release previous map
     lv_btnmatrix_set_map(obj, map);
-    LOG_DEBUG(TAG_ATTR, F("%s %d"), __FILE__, __LINE__);
 }
 
 static void my_msgbox_set_map(lv_obj_t* obj, const char* payload)
 {
-    LOG_DEBUG(TAG_ATTR, F("%s %d"), __FILE__, __LINE__);
-    const char** map = my_map_create(payload);
+    lv_msgbox_ext_t* ext = (lv_msgbox_ext_t*)lv_obj_get_ext_attr(obj);
+    const char** current = NULL;
+    if(ext && ext->btnm) current = ((lv_btnmatrix_ext_t*)lv_obj_get_ext_attr(ext->btnm))->map_p;
+
+    const char** map = my_map_create(payload, current);
     if(!map) return;
 
-    LOG_DEBUG(TAG_ATTR, F("%s %d"), __FILE__, __LINE__);
-    my_msgbox_map_clear(obj); // Free previous map
-    LOG_DEBUG(TAG_ATTR, F("%s %d"), __FILE__, __LINE__);
+    if(map != current) my_msgbox_map_clear(obj); // Release previous map
     lv_msgbox_add_btns(obj, map);
-    LOG_DEBUG(TAG_ATTR, F("%s %d"), __FILE__, __LINE__);
 }
 
 void my_line_clear_points(lv_obj_t* obj)
@@ -193,6 +732,25 @@ void my_line_clear_points(lv_obj_t* obj)
     lv_mem_free(ptr);
 }
 
+// Get the points as a json array, the caller frees the string
+static char* my_line_get_points(lv_obj_t* obj)
+{
+    lv_line_ext_t* ext = (lv_line_ext_t*)lv_obj_get_ext_attr(obj);
+    size_t size        = 3 + ext->point_num * sizeof("[-32768,-32768],");
+    char* json         = (char*)hasp_malloc(size);
+    if(!json) return NULL;
+
+    size_t len  = 0;
+    json[len++] = '[';
+    for(uint16_t i = 0; i < ext->point_num; i++) {
+        len += snprintf_P(json + len, size - len, PSTR("%s[%d,%d]"), i ? "," : "", ext->point_array[i].x,
+                          ext->point_array[i].y);
+    }
+    json[len++] = ']';
+    json[len]   = '\0';
+    return json;
+}
+
 static bool my_line_set_points(lv_obj_t* obj, const char* payload)
 {
     my_line_clear_points(obj); // delete pointmap
@@ -773,7 +1331,8 @@ static hasp_attribute_type_t hasp_local_style_attr(lv_obj_t* obj, const char* at
             if(update) {
                 lv_color32_t c;
                 if(Parser::haspPayloadToColor(payload, c) && part != 64)
-                    lv_obj_set_style_local_bg_color(obj, part, state, lv_color_make(c.ch.red, c.ch.green, c.ch.blue));
+                    attribute_set_style_color(obj, part, state, LV_STYLE_BG_COLOR,
+                                              lv_color_make(c.ch.red, c.ch.green, c.ch.blue));
             } else {
                 attr_out_color(obj, attr, lv_obj_get_style_bg_color(obj, part));
             }
@@ -783,8 +1342,8 @@ static hasp_attribute_type_t hasp_local_style_attr(lv_obj_t* obj, const char* at
             if(update) {
                 lv_color32_t c;
                 if(Parser::haspPayloadToColor(payload, c))
-                    lv_obj_set_style_local_bg_grad_color(obj, part, state,
-                                                         lv_color_make(c.ch.red, c.ch.green, c.ch.blue));
+                    attribute_set_style_color(obj, part, state, LV_STYLE_BG_GRAD_COLOR,
+                                              lv_color_make(c.ch.red, c.ch.green, c.ch.blue));
             } else {
                 attr_out_color(obj, attr, lv_obj_get_style_bg_grad_color(obj, part));
             }
@@ -822,8 +1381,8 @@ static hasp_attribute_type_t hasp_local_style_attr(lv_obj_t* obj, const char* at
             if(update) {
                 lv_color32_t c;
                 if(Parser::haspPayloadToColor(payload, c) && part != 64)
-                    lv_obj_set_style_local_scale_grad_color(obj, part, state,
-                                                            lv_color_make(c.ch.red, c.ch.green, c.ch.blue));
+                    attribute_set_style_color(obj, part, state, LV_STYLE_SCALE_GRAD_COLOR,
+                                              lv_color_make(c.ch.red, c.ch.green, c.ch.blue));
             } else {
                 attr_out_color(obj, attr, lv_obj_get_style_scale_grad_color(obj, part));
             }
@@ -833,8 +1392,8 @@ static hasp_attribute_type_t hasp_local_style_attr(lv_obj_t* obj, const char* at
             if(update) {
                 lv_color32_t c;
                 if(Parser::haspPayloadToColor(payload, c))
-                    lv_obj_set_style_local_scale_end_color(obj, part, state,
-                                                           lv_color_make(c.ch.red, c.ch.green, c.ch.blue));
+                    attribute_set_style_color(obj, part, state, LV_STYLE_SCALE_END_COLOR,
+                                              lv_color_make(c.ch.red, c.ch.green, c.ch.blue));
             } else {
                 attr_out_color(obj, attr, lv_obj_get_style_scale_end_color(obj, part));
             }
@@ -861,7 +1420,8 @@ static hasp_attribute_type_t hasp_local_style_attr(lv_obj_t* obj, const char* at
             if(update) {
                 lv_color32_t c;
                 if(Parser::haspPayloadToColor(payload, c))
-                    lv_obj_set_style_local_text_color(obj, part, state, lv_color_make(c.ch.red, c.ch.green, c.ch.blue));
+                    attribute_set_style_color(obj, part, state, LV_STYLE_TEXT_COLOR,
+                                              lv_color_make(c.ch.red, c.ch.green, c.ch.blue));
             } else {
                 attr_out_color(obj, attr, lv_obj_get_style_text_color(obj, part));
             }
@@ -871,8 +1431,8 @@ static hasp_attribute_type_t hasp_local_style_attr(lv_obj_t* obj, const char* at
             if(update) {
                 lv_color32_t c;
                 if(Parser::haspPayloadToColor(payload, c))
-                    lv_obj_set_style_local_text_sel_color(obj, part, state,
-                                                          lv_color_make(c.ch.red, c.ch.green, c.ch.blue));
+                    attribute_set_style_color(obj, part, state, LV_STYLE_TEXT_SEL_COLOR,
+                                              lv_color_make(c.ch.red, c.ch.green, c.ch.blue));
             } else {
                 attr_out_color(obj, attr, lv_obj_get_style_text_sel_color(obj, part));
             }
@@ -914,8 +1474,8 @@ static hasp_attribute_type_t hasp_local_style_attr(lv_obj_t* obj, const char* at
             if(update) {
                 lv_color32_t c;
                 if(Parser::haspPayloadToColor(payload, c))
-                    lv_obj_set_style_local_border_color(obj, part, state,
-                                                        lv_color_make(c.ch.red, c.ch.green, c.ch.blue));
+                    attribute_set_style_color(obj, part, state, LV_STYLE_BORDER_COLOR,
+                                              lv_color_make(c.ch.red, c.ch.green, c.ch.blue));
             } else {
                 attr_out_color(obj, attr, lv_obj_get_style_border_color(obj, part));
             }
@@ -933,8 +1493,8 @@ static hasp_attribute_type_t hasp_local_style_attr(lv_obj_t* obj, const char* at
             if(update) {
                 lv_color32_t c;
                 if(Parser::haspPayloadToColor(payload, c))
-                    lv_obj_set_style_local_outline_color(obj, part, state,
-                                                         lv_color_make(c.ch.red, c.ch.green, c.ch.blue));
+                    attribute_set_style_color(obj, part, state, LV_STYLE_OUTLINE_COLOR,
+                                              lv_color_make(c.ch.red, c.ch.green, c.ch.blue));
             } else {
                 attr_out_color(obj, attr, lv_obj_get_style_outline_color(obj, part));
             }
@@ -957,8 +1517,8 @@ static hasp_attribute_type_t hasp_local_style_attr(lv_obj_t* obj, const char* at
             if(update) {
                 lv_color32_t c;
                 if(Parser::haspPayloadToColor(payload, c))
-                    lv_obj_set_style_local_shadow_color(obj, part, state,
-                                                        lv_color_make(c.ch.red, c.ch.green, c.ch.blue));
+                    attribute_set_style_color(obj, part, state, LV_STYLE_SHADOW_COLOR,
+                                              lv_color_make(c.ch.red, c.ch.green, c.ch.blue));
             } else {
                 attr_out_color(obj, attr, lv_obj_get_style_shadow_color(obj, part));
             }
@@ -982,7 +1542,8 @@ static hasp_attribute_type_t hasp_local_style_attr(lv_obj_t* obj, const char* at
             if(update) {
                 lv_color32_t c;
                 if(Parser::haspPayloadToColor(payload, c))
-                    lv_obj_set_style_local_line_color(obj, part, state, lv_color_make(c.ch.red, c.ch.green, c.ch.blue));
+                    attribute_set_style_color(obj, part, state, LV_STYLE_LINE_COLOR,
+                                              lv_color_make(c.ch.red, c.ch.green, c.ch.blue));
             } else {
                 attr_out_color(obj, attr, lv_obj_get_style_line_color(obj, part));
             }
@@ -1004,7 +1565,10 @@ static hasp_attribute_type_t hasp_local_style_attr(lv_obj_t* obj, const char* at
             return attribute_value_opa(obj, part, state, update, (lv_opa_t)var, val);
         case ATTR_VALUE_STR: {
             if(update) {
-                my_obj_set_value_str_text(obj, part, state, payload);
+                if(attribute_value_str_unchanged(obj, part, state, payload))
+                    attribute_stats.unchanged++;
+                else
+                    my_obj_set_value_str_text(obj, part, state, payload);
             } else {
                 attr_out_str(obj, attr, my_obj_get_value_str_text(obj, part, state));
             }
@@ -1014,8 +1578,8 @@ static hasp_attribute_type_t hasp_local_style_attr(lv_obj_t* obj, const char* at
             if(update) {
                 lv_color32_t c;
                 if(Parser::haspPayloadToColor(payload, c))
-                    lv_obj_set_style_local_value_color(obj, part, state,
-                                                       lv_color_make(c.ch.red, c.ch.green, c.ch.blue));
+                    attribute_set_style_color(obj, part, state, LV_STYLE_VALUE_COLOR,
+                                              lv_color_make(c.ch.red, c.ch.green, c.ch.blue));
             } else {
                 attr_out_color(obj, attr, lv_obj_get_style_value_color(obj, part));
             }
@@ -1043,8 +1607,8 @@ static hasp_attribute_type_t hasp_local_style_attr(lv_obj_t* obj, const char* at
             if(update) {
                 lv_color32_t c;
                 if(Parser::haspPayloadToColor(payload, c))
-                    lv_obj_set_style_local_pattern_recolor(obj, part, state,
-                                                           lv_color_make(c.ch.red, c.ch.green, c.ch.blue));
+                    attribute_set_style_color(obj, part, state, LV_STYLE_PATTERN_RECOLOR,
+                                              lv_color_make(c.ch.red, c.ch.green, c.ch.blue));
             } else {
                 attr_out_color(obj, attr, lv_obj_get_style_pattern_recolor(obj, part));
             }
@@ -1064,8 +1628,8 @@ static hasp_attribute_type_t hasp_local_style_attr(lv_obj_t* obj, const char* at
             if(update) {
                 lv_color32_t c;
                 if(Parser::haspPayloadToColor(payload, c))
-                    lv_obj_set_style_local_image_recolor(obj, part, state,
-                                                         lv_color_make(c.ch.red, c.ch.green, c.ch.blue));
+                    attribute_set_style_color(obj, part, state, LV_STYLE_IMAGE_RECOLOR,
+                                              lv_color_make(c.ch.red, c.ch.green, c.ch.blue));
             } else {
                 attr_out_color(obj, attr, lv_obj_get_style_image_recolor(obj, part));
             }
@@ -1312,10 +1876,12 @@ static inline bool do_attribute(T& list, lv_obj_t* obj, uint16_t attr_hash, int3
 
     for(int i = 0; i < count; i++) {
         if(obj_type == list[i].obj_type && attr_hash == list[i].hash) {
-            if(update)
-                list[i].set(obj, val);
-            else
+            if(!update)
                 val = list[i].get(obj);
+            else if(attr_hash != ATTR_AUTO_CLOSE && (int32_t)list[i].get(obj) == val) // auto_close restarts a timer
+                attribute_stats.unchanged++;                                          // compare before set
+            else
+                list[i].set(obj, val);
             return true;
         }
     }
@@ -1686,6 +2252,20 @@ static hasp_attribute_type_t attribute_common_tag(lv_obj_t* obj, uint16_t attr_h
             }
             break; // attribute_found
 
+#if HASP_USE_MQTT > 0
+        case ATTR_BIND:
+            if(update) {
+                my_obj_set_bind(obj, payload);
+            } else {
+                if(my_obj_get_bind(obj)) {
+                    *text = (char*)my_obj_get_bind(obj);
+                } else {
+                    strcpy_P(*text, "null"); // TODO : Literal String
+                }
+            }
+            break; // attribute_found
+#endif
+
         default:
             return HASP_ATTR_TYPE_NOT_FOUND;
     }
@@ -1765,10 +2345,16 @@ static hasp_attribute_type_t attribute_common_text(lv_obj_t* obj, uint16_t attr_
 
     for(int i = 0; i < sizeof(list) / sizeof(list[0]); i++) {
         if(obj_type == list[i].obj_type && attr_hash == list[i].hash) {
-            if(update)
-                list[i].set(obj, payload);
-            else
+            if(!update) {
                 *text = (char*)list[i].get(obj);
+            } else if(const char* current = list[i].get(obj)) {
+                if(strcmp(current, payload))
+                    list[i].set(obj, payload);
+                else
+                    attribute_stats.unchanged++; // skip the realloc and redraw
+            } else {
+                list[i].set(obj, payload);
+            }
 
             return HASP_ATTR_TYPE_STR;
         }
@@ -2059,6 +2645,14 @@ static bool my_obj_get_range(lv_obj_t* obj, int32_t& min, int32_t& max)
 
 static hasp_attribute_type_t attribute_common_val(lv_obj_t* obj, int32_t& val, bool update)
 {
+    if(update) { // compare before set
+        int32_t current;
+        if(attribute_common_val(obj, current, false) == HASP_ATTR_TYPE_INT && current == val) {
+            attribute_stats.unchanged++;
+            return HASP_ATTR_TYPE_INT;
+        }
+    }
+
     switch(obj_get_type(obj)) {
 
         case LV_HASP_BUTTON:
@@ -2390,27 +2984,34 @@ static hasp_attribute_type_t attribute_common_int(lv_obj_t* obj, uint16_t attr_h
             break; // attribute_found
 
         case ATTR_X:
-            if(update)
-                lv_obj_set_x(obj, val);
-            else
+            if(update) {
+                if(attribute_txn_get_coord(obj, TXN_X) == val)
+                    attribute_stats.unchanged++;
+                else if(!attribute_txn_set_coord(obj, TXN_X, val))
+                    lv_obj_set_x(obj, val);
+            } else {
                 val = lv_obj_get_x(obj);
+            }
             break; // attribute_found
 
         case ATTR_Y:
-            if(update)
-                lv_obj_set_y(obj, val);
-            else
+            if(update) {
+                if(attribute_txn_get_coord(obj, TXN_Y) == val)
+                    attribute_stats.unchanged++;
+                else if(!attribute_txn_set_coord(obj, TXN_Y, val))
+                    lv_obj_set_y(obj, val);
+            } else {
                 val = lv_obj_get_y(obj);
+            }
             break; // attribute_found
 
         case ATTR_W:
             if(update) {
-                lv_obj_set_width(obj, val);
-                if(obj_check_type(obj, LV_HASP_CPICKER)) {
-#if LVGL_VERSION_MAJOR == 7
-                    lv_cpicker_set_type(obj, lv_obj_get_width(obj) == lv_obj_get_height(obj) ? LV_CPICKER_TYPE_DISC
-                                                                                             : LV_CPICKER_TYPE_RECT);
-#endif
+                if(attribute_txn_get_coord(obj, TXN_W) == val) {
+                    attribute_stats.unchanged++;
+                } else if(!attribute_txn_set_coord(obj, TXN_W, val)) {
+                    lv_obj_set_width(obj, val);
+                    attribute_update_cpicker_type(obj);
                 }
             } else {
                 val = lv_obj_get_width(obj);
@@ -2419,12 +3020,11 @@ static hasp_attribute_type_t attribute_common_int(lv_obj_t* obj, uint16_t attr_h
 
         case ATTR_H:
             if(update) {
-                lv_obj_set_height(obj, val);
-                if(obj_check_type(obj, LV_HASP_CPICKER)) {
-#if LVGL_VERSION_MAJOR == 7
-                    lv_cpicker_set_type(obj, lv_obj_get_width(obj) == lv_obj_get_height(obj) ? LV_CPICKER_TYPE_DISC
-                                                                                             : LV_CPICKER_TYPE_RECT);
-#endif
+                if(attribute_txn_get_coord(obj, TXN_H) == val) {
+                    attribute_stats.unchanged++;
+                } else if(!attribute_txn_set_coord(obj, TXN_H, val)) {
+                    lv_obj_set_height(obj, val);
+                    attribute_update_cpicker_type(obj);
                 }
             } else {
                 val = lv_obj_get_height(obj);
@@ -2433,7 +3033,7 @@ static hasp_attribute_type_t attribute_common_int(lv_obj_t* obj, uint16_t attr_h
 
         case ATTR_OPACITY:
             if(update)
-                lv_obj_set_style_local_opa_scale(obj, LV_OBJ_PART_MAIN, LV_STATE_DEFAULT, val);
+                attribute_set_style_int(obj, LV_OBJ_PART_MAIN, LV_STATE_DEFAULT, LV_STYLE_OPA_SCALE, val);
             else
                 val = lv_obj_get_style_opa_scale(obj, LV_OBJ_PART_MAIN);
             break; // attribute_found
@@ -2515,6 +3115,20 @@ static hasp_attribute_type_t attribute_common_bool(lv_obj_t* obj, uint16_t attr_
                 val = !(lv_obj_get_state(obj, LV_BTN_PART_MAIN) & LV_STATE_DISABLED);
             break; // attribute_found
 
+#if HASP_USE_LABEL_CACHE > 0
+        case ATTR_CACHE: {
+            lv_obj_t* label = obj_check_type(obj, LV_HASP_BUTTON)  ? FindButtonLabel(obj)
+                              : obj_check_type(obj, LV_HASP_LABEL) ? obj
+                                                                   : NULL;
+            if(!label) return HASP_ATTR_TYPE_NOT_FOUND; // attribute_not found
+            if(update)
+                hasp_label_cache_enable(label, !!val);
+            else
+                val = hasp_label_cache_enabled(label);
+            break; // attribute_found
+        }
+#endif
+
             // case ATTR_SWIPE:
             //     if(update)
             //         obj->user_data.swipeid = (!!val) % 16;
@@ -2563,6 +3177,16 @@ void attr_out(lv_obj_t* obj, const char* attribute, const char* data, bool is_js
     uint8_t pageid;
     uint8_t objid;
 
+    if(attribute && attribute_sink) { // char* makes ArduinoJson copy the strings
+        if(!data)
+            (*attribute_sink)[(char*)attribute] = nullptr;
+        else if(is_json)
+            (*attribute_sink)[(char*)attribute] = serialized((char*)data);
+        else
+            (*attribute_sink)[(char*)attribute] = (char*)data;
+        return;
+    }
+
     if(!attribute || !hasp_find_id_from_obj(obj, &pageid, &objid)) return;
 
     size_t len = 10;
@@ -2615,6 +3239,16 @@ void attr_out_color(lv_obj_t* obj, const char* attribute, lv_color_t color)
     uint8_t pageid;
     uint8_t objid;
 
+    if(attribute && attribute_sink) {
+        char buffer[16];
+        lv_color32_t c32;
+
+        c32.full = lv_color_to32(color);
+        snprintf_P(buffer, sizeof(buffer), PSTR("#%02x%02x%02x"), c32.ch.red, c32.ch.green, c32.ch.blue);
+        (*attribute_sink)[(char*)attribute] = buffer;
+        return;
+    }
+
     if(!attribute || !hasp_find_id_from_obj(obj, &pageid, &objid)) return;
 
     const size_t size = 64 + strlen(attribute);
@@ -2656,6 +3290,13 @@ void hasp_process_obj_attribute(lv_obj_t* obj, const char* attribute, const char
     hasp_attribute_type_t ret = HASP_ATTR_TYPE_NOT_FOUND; // the return code determines the attribute return value type
     uint16_t attr_hash        = Parser::get_sdbm(attribute);
 
+    if(update) attribute_stats.writes++;
+
+    // Only consecutive coordinates are collected, other attributes may depend on them
+    if(attribute_txn.count > 0 &&
+       (!update || (attr_hash != ATTR_X && attr_hash != ATTR_Y && attr_hash != ATTR_W && attr_hash != ATTR_H)))
+        attribute_txn_flush_geometry();
+
     switch(attr_hash) {
         case ATTR_GROUPID:
         case ATTR_ID:
@@ -2679,6 +3320,7 @@ void hasp_process_obj_attribute(lv_obj_t* obj, const char* attribute, const char
         case ATTR_CLICK:
         // case ATTR_SWIPE:
         case ATTR_ENABLED:
+        case ATTR_CACHE:
             val = Parser::is_true(payload);
             ret = attribute_common_bool(obj, attr_hash, val, update);
             break;
@@ -2711,6 +3353,7 @@ void hasp_process_obj_attribute(lv_obj_t* obj, const char* attribute, const char
         case ATTR_TAG:
         case ATTR_ACTION:
         case ATTR_SWIPE:
+        case ATTR_BIND:
             ret = attribute_common_tag(obj, attr_hash, payload, &text, update);
             break;
         case ATTR_JSONL:
@@ -2756,6 +3399,7 @@ void hasp_process_obj_attribute(lv_obj_t* obj, const char* attribute, const char
         case ATTR_TO_BACK:
         case ATTR_OPEN:
         case ATTR_CLOSE:
+            if(attribute_sink) break; // only values are collected, never run a method
             ret = attribute_common_method(obj, attr_hash, attribute, payload);
             break;
 
@@ -2866,8 +3510,14 @@ void hasp_process_obj_attribute(lv_obj_t* obj, const char* attribute, const char
                 break;
 
             case LV_HASP_LINE:
-                if(attr_hash == ATTR_POINTS)
+                if(attr_hash != ATTR_POINTS) break;
+                if(update) {
                     ret = my_line_set_points(obj, payload) ? HASP_ATTR_TYPE_METHOD_OK : HASP_ATTR_TYPE_RANGE_ERROR;
+                } else if(char* points = my_line_get_points(obj)) { // too long for temp_buffer
+                    attr_out_json(obj, attribute, points);
+                    hasp_free(points);
+                    ret = HASP_ATTR_TYPE_METHOD_OK;
+                }
                 break;
 
             case LV_HASP_CPICKER:
@@ -2894,7 +3544,7 @@ void hasp_process_obj_attribute(lv_obj_t* obj, const char* attribute, const char
     // Output the returned value or warning
     switch(ret) {
         case HASP_ATTR_TYPE_NOT_FOUND:
-            LOG_WARNING(TAG_ATTR, F(D_ATTRIBUTE_UNKNOWN " (%d)"), attribute, attr_hash);
+            if(!attribute_sink) LOG_WARNING(TAG_ATTR, F(D_ATTRIBUTE_UNKNOWN " (%d)"), attribute, attr_hash);
             break;
 
         case HASP_ATTR_TYPE_INT_READONLY:
@@ -2948,3 +3598,33 @@ void hasp_process_obj_attribute(lv_obj_t* obj, const char* attribute, const char
             LOG_ERROR(TAG_ATTR, F(D_ERROR_UNKNOWN " (%d)"), ret);
     }
 }
+
+/**
+ * Retrieve the values of several attributes of an object at once
+ * @param obj lv_obj_t*: the object to get the attributes from
+ * @param attrs char*: comma separated list of attribute names
+ * @param json JsonObject: receives a key for every attribute that applies to the object
+ * @note the values are added to json instead of being dispatched, unknown attributes are skipped silently
+ */
+void hasp_get_obj_attributes(lv_obj_t* obj, const char* attrs, JsonObject& json)
+{
+    if(!obj || !attrs) return;
+
+    JsonObject* saved_sink = attribute_sink;
+    attribute_sink         = &json;
+
+    char attribute[32];
+    while(*attrs) {
+        while(*attrs == ',' || *attrs == ' ') attrs++;
+
+        size_t len = strcspn(attrs, ", ");
+        if(len > 0 && len < sizeof(attribute)) {
+            memcpy(attribute, attrs, len);
+            attribute[len] = 0;
+            hasp_process_obj_attribute(obj, attribute, "", false);
+        }
+        attrs += len;
+    }
+
+    attribute_sink = saved_sink;
+}
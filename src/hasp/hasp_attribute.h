@@ -6,6 +6,8 @@
 
 #include "hasplib.h"
 
+struct dispatch_script_t;
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -18,9 +20,13 @@ void my_obj_set_value_str_text(lv_obj_t* obj, uint8_t part, lv_state_t state, co
 void my_obj_set_tag(lv_obj_t* obj, const char* tag);
 void my_obj_set_action(lv_obj_t* obj, const char* tag);
 void my_obj_set_swipe(lv_obj_t* obj, const char* tag);
+void my_obj_set_bind(lv_obj_t* obj, const char* payload);
 const char* my_obj_get_tag(lv_obj_t* obj);
 const char* my_obj_get_action(lv_obj_t* obj);
 const char* my_obj_get_swipe(lv_obj_t* obj);
+const char* my_obj_get_bind(lv_obj_t* obj);
+const dispatch_script_t* my_obj_get_action_script(lv_obj_t* obj);
+const dispatch_script_t* my_obj_get_swipe_script(lv_obj_t* obj);
 void my_btnmatrix_map_clear(lv_obj_t* obj);
 void my_msgbox_map_clear(lv_obj_t* obj);
 void my_line_clear_points(lv_obj_t* obj);
@@ -28,6 +34,7 @@ void my_image_release_resources(lv_obj_t* obj);
 void my_obj_del_task(const lv_obj_t* obj);
 
 void hasp_process_obj_attribute(lv_obj_t* obj, const char* attr_p, const char* payload, bool update);
+void hasp_get_obj_attributes(lv_obj_t* obj, const char* attrs, JsonObject& json);
 
 bool attribute_set_normalized_value(lv_obj_t* obj, hasp_update_value_t& value);
 
@@ -36,10 +43,43 @@ void attr_out_json(lv_obj_t* obj, const char* attribute, const char* data);
 void attr_out_int(lv_obj_t* obj, const char* attribute, int32_t val);
 void attr_out_color(lv_obj_t* obj, const char* attribute, lv_color_t color);
 
+void attribute_set_style_int(lv_obj_t* obj, uint8_t part, lv_state_t state, lv_style_property_t prop, int32_t val);
+void attribute_set_style_color(lv_obj_t* obj, uint8_t part, lv_state_t state, lv_style_property_t prop,
+                               lv_color_t color);
+
+void hasp_attribute_begin(void);
+void hasp_attribute_commit(void);
+void hasp_attribute_forget(lv_obj_t* obj);
+
 #ifdef __cplusplus
 } /* extern "C" */
 #endif
 
+#ifndef HASP_ATTR_TXN_OBJECTS
+#define HASP_ATTR_TXN_OBJECTS 16 // objects with pending changes in a transaction
+#endif
+#ifndef HASP_ATTR_TXN_PARTS
+#define HASP_ATTR_TXN_PARTS 4 // parts with a pending style refresh per object
+#endif
+#ifndef HASP_ATTR_TXN_PROPS
+#define HASP_ATTR_TXN_PROPS 4 // style properties with a pending refresh per part
+#endif
+
+typedef struct
+{
+    uint32_t transactions; // committed transactions
+    uint32_t deferred;     // setters applied at commit time
+    uint32_t refreshes;    // position, size and style updates done at commit time
+    uint32_t area;         // pixels invalidated by all transactions
+    uint32_t last_area;    // pixels invalidated by the last transaction
+    uint32_t time;         // ms spent in all transactions
+    uint32_t max_time;     // ms spent in the longest transaction
+    uint32_t writes;       // attribute updates received
+    uint32_t unchanged;    // updates skipped because the value was already set
+} hasp_attribute_stats_t;
+
+void hasp_attribute_get_info(JsonDocument& doc);
+
 typedef enum {
     HASP_ATTR_TYPE_LONG_MODE_INVALID       = -10,
     HASP_ATTR_TYPE_RANGE_ERROR             = -9,
@@ -174,7 +214,7 @@ struct hasp_attr_update_char_const_t
     static inline hasp_attribute_type_t attribute_##func_name(lv_obj_t* obj, uint8_t part, lv_state_t state,           \
                                                               bool update, value_type val, int32_t& res)               \
     {                                                                                                                  \
-        if(update) lv_obj_set_style_local_##func_name(obj, part, state, (value_type)val);                              \
+        if(update) attribute_set_style_int(obj, part, state, LV_STYLE_##prop_name, (int32_t)val);                      \
         res = (int32_t)lv_obj_get_style_##func_name(obj, part);                                                        \
         return HASP_ATTR_TYPE_INT;                                                                                     \
     }
@@ -497,6 +537,8 @@ _HASP_ATTRIBUTE(SCALE_END_LINE_WIDTH, scale_end_line_width, lv_style_int_t)
 
 /* hasp user data */
 #define ATTR_ACTION 42102
+#define ATTR_BIND 24701
+#define ATTR_CACHE 61090
 #define ATTR_TRANSITION 10933
 #define ATTR_GROUPID 48986
 #define ATTR_OBJID 41010
@@ -90,27 +90,42 @@ static void my_prune_ext_tags(lv_obj_t* obj)
     if(!obj || !obj->user_data.ext) return;
 
     hasp_ext_user_data_t* ext = (hasp_ext_user_data_t*)obj->user_data.ext;
-    if(!ext->action && !ext->swipe && !ext->tag) {
-        hasp_free(ext);
+    if(!ext->action && !ext->swipe && !ext->tag && !ext->binding) {
+        hasp_ext_free(ext);
         obj->user_data.ext = NULL;
     }
 }
 
-// create extended user_data properties object
+// create extended user_data properties object from the pool
 static hasp_ext_user_data_t* my_create_ext_tags(lv_obj_t* obj)
 {
-    void* ext          = hasp_calloc(1, sizeof(hasp_ext_user_data_t));
-    obj->user_data.ext = ext;
-    return (hasp_ext_user_data_t*)ext;
+    hasp_ext_user_data_t* ext = hasp_ext_alloc();
+    obj->user_data.ext        = ext;
+    return ext;
+}
+
+// serialize the json document and store it in the string arena, identical values are stored only once
+static const char* my_ext_intern_json(JsonDocument& doc)
+{
+    const size_t size = measureJson(doc) + 1;
+    char* buffer      = (char*)lv_mem_buf_get(size);
+    if(!buffer) return NULL;
+
+    serializeJson(doc, buffer, size); // tidy-up the json object
+    const char* str = hasp_str_intern(buffer);
+    lv_mem_buf_release(buffer);
+
+    if(str) LOG_VERBOSE(TAG_ATTR, "new json: %s", str);
+    return str;
 }
 
 void my_obj_set_tag(lv_obj_t* obj, const char* payload)
 {
     hasp_ext_user_data_t* ext = (hasp_ext_user_data_t*)obj->user_data.ext;
 
-    // extended tag exists, free old tag
+    // extended tag exists, release old tag
     if(ext && ext->tag) {
-        hasp_free(ext->tag);
+        hasp_str_release(ext->tag);
         ext->tag = NULL;
     }
 
@@ -129,11 +144,8 @@ void my_obj_set_tag(lv_obj_t* obj, const char* payload)
         DeserializationError res = deserializeJson(doc, payload, len);
         if(res != DeserializationError::Ok) doc.set(payload); // use tag as-is
 
-        const size_t size = measureJson(doc) + 1;
-        if(char* str = (char*)hasp_malloc(size)) {
-            len      = serializeJson(doc, str, size); // tidy-up the json object
+        if(const char* str = my_ext_intern_json(doc)) {
             ext->tag = str;
-            LOG_VERBOSE(TAG_ATTR, "new json: %s", str);
             return; // no error & no prune
         }
     }
@@ -158,10 +170,12 @@ void my_obj_set_action(lv_obj_t* obj, const char* payload)
 {
     hasp_ext_user_data_t* ext = (hasp_ext_user_data_t*)obj->user_data.ext;
 
-    // extended tag exists, free old tag
+    // extended tag exists, release old action
     if(ext && ext->action) {
-        hasp_free(ext->action);
-        ext->action = NULL;
+        hasp_str_release(ext->action);
+        dispatch_script_free(ext->action_script);
+        ext->action        = NULL;
+        ext->action_script = NULL;
     }
 
     // new tag is blank
@@ -209,11 +223,9 @@ void my_obj_set_action(lv_obj_t* obj, const char* payload)
             }
         }
 
-        const size_t size = measureJson(doc) + 1;
-        if(char* str = (char*)hasp_malloc(size)) {
-            size_t len  = serializeJson(doc, str, size); // tidy-up the json object
-            ext->action = str;
-            LOG_VERBOSE(TAG_ATTR, "new json: %s", str);
+        if(const char* str = my_ext_intern_json(doc)) {
+            ext->action        = str;
+            ext->action_script = dispatch_script_compile(doc.as<JsonVariantConst>()); // NULL: use the json
             return; // no error & no prune
         }
     }
@@ -239,10 +251,16 @@ void my_obj_set_swipe(lv_obj_t* obj, const char* payload)
     hasp_ext_user_data_t* ext     = (hasp_ext_user_data_t*)obj->user_data.ext;
     static const char* _swipejson = R"({"down":"page back","left":"page next","right":"page prev","up":"page back"})";
 
+    static dispatch_script_t* _swipescript = NULL;
+
     // extended tag exists, free old tag if it's not the const _swipejson
     if(ext) {
-        if(ext->swipe != _swipejson) hasp_free((void*)ext->swipe);
-        ext->swipe = NULL;
+        if(ext->swipe != _swipejson) {
+            hasp_str_release(ext->swipe);
+            dispatch_script_free(ext->swipe_script);
+        }
+        ext->swipe        = NULL;
+        ext->swipe_script = NULL;
     }
 
     // new tag is blank
@@ -252,9 +270,16 @@ void my_obj_set_swipe(lv_obj_t* obj, const char* payload)
     if(!ext) ext = my_create_ext_tags(obj);
 
     if(ext) {
+        // backwards compatibility: use static action, compiled once
+        if(!_swipescript) {
+            StaticJsonDocument<256> doc;
+            if(!deserializeJson(doc, _swipejson)) _swipescript = dispatch_script_compile(doc.as<JsonVariantConst>());
+        }
+
         if(Parser::is_true(payload)) {
-            ext->swipe = _swipejson; // backwards compatibility: use static action
-            return;                  // no error & no prune
+            ext->swipe        = _swipejson; // backwards compatibility: use static action
+            ext->swipe_script = _swipescript;
+            return; // no error & no prune
         }
 
         // create new action
@@ -271,18 +296,17 @@ void my_obj_set_swipe(lv_obj_t* obj, const char* payload)
         if(doc.isNull()) goto prune;
         if(doc.is<bool>() || doc.is<uint8_t>()) {
             if(doc.as<bool>()) { // backwards compatibility: use static action
-                ext->swipe = _swipejson;
+                ext->swipe        = _swipejson;
+                ext->swipe_script = _swipescript;
                 return; // no error & no prune
             } else {
                 goto prune;
             }
         }
 
-        const size_t size = measureJson(doc) + 1;
-        if(char* str = (char*)hasp_malloc(size)) {
-            size_t len = serializeJson(doc, str, size); // tidy-up the json object
-            ext->swipe = str;
-            LOG_VERBOSE(TAG_ATTR, "new json: %s", str);
+        if(const char* str = my_ext_intern_json(doc)) {
+            ext->swipe        = str;
+            ext->swipe_script = dispatch_script_compile(doc.as<JsonVariantConst>()); // NULL: use the json
             return; // no error & no prune
         }
     }
@@ -302,6 +326,63 @@ const char* my_obj_get_swipe(lv_obj_t* obj)
     return ext ? ext->swipe : NULL;
 }
 
+// the compiled action, NULL if it could not be compiled
+const dispatch_script_t* my_obj_get_action_script(lv_obj_t* obj)
+{
+    if(!obj) return NULL;
+    hasp_ext_user_data_t* ext = (hasp_ext_user_data_t*)obj->user_data.ext;
+    return ext ? ext->action_script : NULL;
+}
+
+// the compiled swipe, NULL if it could not be compiled
+const dispatch_script_t* my_obj_get_swipe_script(lv_obj_t* obj)
+{
+    if(!obj) return NULL;
+    hasp_ext_user_data_t* ext = (hasp_ext_user_data_t*)obj->user_data.ext;
+    return ext ? ext->swipe_script : NULL;
+}
+
+#if HASP_USE_MQTT > 0
+// the binding is stored as SERIALIZED JSON data, the object is added to the topic index
+void my_obj_set_bind(lv_obj_t* obj, const char* payload)
+{
+    hasp_ext_user_data_t* ext = (hasp_ext_user_data_t*)obj->user_data.ext;
+
+    // extended tag exists, release old binding
+    if(ext && ext->binding) {
+        mqtt_binding_free(ext->binding);
+        ext->binding = NULL;
+    }
+
+    // new binding is blank
+    if(payload == NULL || payload[0] == '\0') goto prune;
+
+    // create new extended tags
+    if(!ext) ext = my_create_ext_tags(obj);
+
+    if(ext) {
+        ext->binding = mqtt_binding_create(obj, payload);
+        if(ext->binding) return; // no error & no prune
+
+        LOG_WARNING(TAG_ATTR, "Invalid parameter");
+        goto prune;
+    }
+
+error:
+    LOG_WARNING(TAG_ATTR, D_ERROR_OUT_OF_MEMORY); // ext was NULL
+
+prune:
+    my_prune_ext_tags(obj); // delete extended data if all extended properties are NULL
+}
+
+const char* my_obj_get_bind(lv_obj_t* obj)
+{
+    if(!obj) return NULL;
+    hasp_ext_user_data_t* ext = (hasp_ext_user_data_t*)obj->user_data.ext;
+    return ext ? mqtt_binding_get_spec(ext->binding) : NULL;
+}
+#endif
+
 lv_label_align_t my_textarea_get_text_align(lv_obj_t* ta)
 {
     lv_textarea_ext_t* ext = (lv_textarea_ext_t*)lv_obj_get_ext_attr(ta);
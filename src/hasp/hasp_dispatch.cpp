@@ -45,6 +45,23 @@ uint16_t dispatchSecondsToNextDiscovery  = 0;
 uint8_t nCommands                        = 0;
 haspCommand_t commands[28];
 
+/* Perfect hash index into commands[], built once by dispatch_build_command_table() */
+#define DISPATCH_COMMAND_SLOTS 128 // power of 2, at least four times the size of commands[]
+#define DISPATCH_COMMAND_EMPTY 0xFF
+static uint8_t command_slots[DISPATCH_COMMAND_SLOTS];
+static uint32_t command_seed = 0;
+static bool command_table    = false; // false when no seed was found, commands are then searched one by one
+
+/* Topic prefixes that are routed to a handler */
+enum dispatch_route_t {
+    DISPATCH_ROUTE_NONE,
+    DISPATCH_ROUTE_COMMAND, // command/
+    DISPATCH_ROUTE_CONFIG,  // config/
+    DISPATCH_ROUTE_CUSTOM,  // custom/
+    DISPATCH_ROUTE_OUTPUT,  // output
+    DISPATCH_ROUTE_INPUT,   // input
+};
+
 moodlight_t moodlight    = {.brightness = 255};
 uint8_t saved_jsonl_page = 0;
 
@@ -61,6 +78,9 @@ void dispatch_state_subtopic(const char* subtopic, const char* payload)
         case MQTT_ERR_OK:
             LOG_TRACE(TAG_MQTT_PUB, F("%s => %s"), subtopic, payload);
             break;
+        case MQTT_ERR_QUEUED:
+            LOG_VERBOSE(TAG_MQTT, F(D_MQTT_NOT_CONNECTED " %s => %s"), subtopic, payload);
+            break;
         case MQTT_ERR_PUB_FAIL:
             LOG_ERROR(TAG_MQTT_PUB, F(D_MQTT_FAILED " %s => %s"), subtopic, payload);
             break;
@@ -79,6 +99,10 @@ void dispatch_state_subtopic(const char* subtopic, const char* payload)
 #endif
 
 #endif
+
+#if HASP_USE_WEBSOCKET > 0
+    websocket_send_state(subtopic, payload);
+#endif
 }
 
 void dispatch_state_eventid(const char* topic, hasp_event_t eventid)
@@ -134,53 +158,62 @@ void dispatch_json_error(uint8_t tag, DeserializationError& jsonError)
     // LOG_ERROR(tag, F(D_JSON_FAILED " %s"), error);
 }
 
-// p[x].b[y].attr=value
-static inline bool dispatch_parse_button_attribute(const char* topic_p, const char* payload, bool update)
+// p[x].b[y].attr, returns a pointer to the attribute name or NULL if the topic is not an object attribute
+static const char* dispatch_parse_button_target(const char* topic_p, uint8_t& pageid, uint8_t& objid)
 {
     long num;
     char* pEnd;
-    uint8_t pageid, objid;
 
-    if(*topic_p != 'p' && *topic_p != 'P') return false; // obligated p
+    if(*topic_p != 'p' && *topic_p != 'P') return NULL; // obligated p
     topic_p++;
 
     if(*topic_p == '[') { // optional brackets, TODO: remove
         topic_p++;
         num = strtol(topic_p, &pEnd, DEC);
-        if(*pEnd != ']') return false; // obligated closing bracket
+        if(*pEnd != ']') return NULL; // obligated closing bracket
         pEnd++;
 
     } else {
         num = strtol(topic_p, &pEnd, DEC);
     }
 
-    if(num < 0 || num > HASP_NUM_PAGES) return false; // page number must be valid
+    if(num < 0 || num > HASP_NUM_PAGES) return NULL; // page number must be valid
 
     pageid  = (uint8_t)num;
     topic_p = pEnd;
 
     if(*topic_p == '.') topic_p++; // optional separator
 
-    if(*topic_p != 'b' && *topic_p != 'B') return false; // obligated b
+    if(*topic_p != 'b' && *topic_p != 'B') return NULL; // obligated b
     topic_p++;
 
     if(*topic_p == '[') { // optional brackets, TODO: remove
         topic_p++;
         num = strtol(topic_p, &pEnd, DEC);
-        if(*pEnd != ']') return false; // obligated closing bracket
+        if(*pEnd != ']') return NULL; // obligated closing bracket
         pEnd++;
     } else {
         num = strtol(topic_p, &pEnd, DEC);
     }
 
-    if(num < 0 || num > 255) return false; // id must be valid
+    if(num < 0 || num > 255) return NULL; // id must be valid
     objid   = (uint8_t)num;
     topic_p = pEnd;
 
-    if(*topic_p != '.') return false; // obligated separator
+    if(*topic_p != '.') return NULL; // obligated separator
     topic_p++;
 
-    hasp_process_attribute(pageid, objid, topic_p, payload, update);
+    return topic_p;
+}
+
+// p[x].b[y].attr=value
+static inline bool dispatch_parse_button_attribute(const char* topic_p, const char* payload, bool update)
+{
+    uint8_t pageid, objid;
+    const char* attr = dispatch_parse_button_target(topic_p, pageid, objid);
+    if(!attr) return false;
+
+    hasp_process_attribute(pageid, objid, attr, payload, update);
     return true;
 }
 
@@ -305,6 +338,97 @@ static void dispatch_output(const char* topic, const char* payload)
 //     }
 // }
 
+// Case-insensitive FNV-1a hash of a command name
+// The seed is mixed in by a final avalanche, so every seed changes all bits that select a slot
+static uint32_t dispatch_command_hash(const char* cmd, uint32_t seed)
+{
+    uint32_t hash = 2166136261u;
+    while(char c = *cmd++) hash = (hash ^ (uint8_t)tolower(c)) * 16777619u;
+
+    hash ^= seed * 0x9E3779B9u;
+    hash ^= hash >> 16;
+    hash *= 0x85EBCA6Bu;
+    hash ^= hash >> 13;
+    hash *= 0xC2B2AE35u;
+    hash ^= hash >> 16;
+    return hash;
+}
+
+// Find a command with a single hash calculation and one string compare
+static haspCommand_t* dispatch_find_command(const char* topic)
+{
+    if(!command_table) {
+        for(uint8_t i = 0; i < nCommands; i++) {
+            if(!strcasecmp_P(topic, commands[i].p_cmdstr)) return &commands[i];
+        }
+        return NULL;
+    }
+
+    uint32_t hash = dispatch_command_hash(topic, command_seed);
+    uint8_t index = command_slots[hash & (DISPATCH_COMMAND_SLOTS - 1)];
+    if(index == DISPATCH_COMMAND_EMPTY) return NULL;
+
+    haspCommand_t* command = &commands[index];
+    if(command->hash != hash || strcasecmp_P(topic, command->p_cmdstr)) return NULL;
+    return command;
+}
+
+// Search a seed for which all registered commands hash to a different slot
+static void dispatch_build_command_table()
+{
+    for(uint32_t seed = 0; seed < 1000; seed++) {
+        bool collision = false;
+        memset(command_slots, DISPATCH_COMMAND_EMPTY, sizeof(command_slots));
+
+        for(uint8_t i = 0; i < nCommands && !collision; i++) {
+            commands[i].hash = dispatch_command_hash(commands[i].p_cmdstr, seed);
+            uint8_t* slot    = &command_slots[commands[i].hash & (DISPATCH_COMMAND_SLOTS - 1)];
+            if(*slot != DISPATCH_COMMAND_EMPTY) collision = true;
+            *slot = i;
+        }
+
+        if(!collision) {
+            command_seed  = seed;
+            command_table = true;
+            LOG_VERBOSE(TAG_MSGR, F("Command table: %d commands, seed %d"), nCommands, seed);
+            return;
+        }
+    }
+
+    command_table = false;
+    LOG_WARNING(TAG_MSGR, F("Command table: no perfect hash for %d commands, using a linear search"), nCommands);
+}
+
+// Match the topic against the routed prefixes in one pass and strip the prefix
+// The first two characters reject a prefix before the full compare is done
+static dispatch_route_t dispatch_match_route(const char*& topic)
+{
+    static const struct
+    {
+        const char* prefix;
+        dispatch_route_t route;
+    } routes[] = {
+        {MQTT_TOPIC_COMMAND "/", DISPATCH_ROUTE_COMMAND},
+        {"config/", DISPATCH_ROUTE_CONFIG},
+        {MQTT_TOPIC_CUSTOM "/", DISPATCH_ROUTE_CUSTOM},
+        {"output", DISPATCH_ROUTE_OUTPUT},
+        {"input", DISPATCH_ROUTE_INPUT},
+    };
+
+    for(uint8_t i = 0; i < sizeof(routes) / sizeof(routes[0]); i++) {
+        const char* prefix = routes[i].prefix;
+        if(topic[0] != prefix[0] || topic[1] != prefix[1]) continue;
+
+        size_t len = strlen(prefix);
+        if(strncmp(topic, prefix, len)) continue;
+
+        topic += len;
+        return routes[i].route;
+    }
+
+    return DISPATCH_ROUTE_NONE;
+}
+
 // objectattribute=value
 static void dispatch_command(const char* topic, const char* payload, bool update, uint8_t source)
 {
@@ -312,22 +436,22 @@ static void dispatch_command(const char* topic, const char* payload, bool update
 
     if(dispatch_parse_button_attribute(topic, payload, update)) return; // matched pxby.attr, first for speed
 
-    // check and execute commands from commands array
-    for(int i = 0; i < nCommands; i++) {
-        if(!strcasecmp_P(topic, commands[i].p_cmdstr)) {
-            // LOG_DEBUG(TAG_MSGR, F("Command %d found in array !!!"), i);
-            commands[i].func(topic, payload, source); /* execute command */
-            return;
-        }
+    // check and execute commands from the commands table
+    if(haspCommand_t* command = dispatch_find_command(topic)) {
+        command->func(topic, payload, source); /* execute command */
+        return;
     }
 
     /* =============================== Not standard payload commands ===================================== */
 
-    if(topic == strstr_P(topic, PSTR("output"))) {
-        dispatch_output(topic + 6, payload);
+    const char* subtopic   = topic;
+    dispatch_route_t route = dispatch_match_route(subtopic);
 
-    } else if(topic == strstr_P(topic, PSTR("input"))) {
-        dispatch_input(topic + 5, payload);
+    if(route == DISPATCH_ROUTE_OUTPUT) {
+        dispatch_output(subtopic, payload);
+
+    } else if(route == DISPATCH_ROUTE_INPUT) {
+        dispatch_input(subtopic, payload);
 
         // } else if(strcasecmp_P(topic, PSTR("screenshot")) == 0) {
         //     guiTakeScreenshot("/screenshot.bmp"); // Literal String
@@ -434,28 +558,28 @@ void dispatch_topic_payload(const char* topic, const char* payload, bool update,
         return;
     }
 
-    if(topic == strstr_P(topic, PSTR(MQTT_TOPIC_COMMAND "/"))) { // startsWith command/
-        topic += 8u;
-        dispatch_command(topic, (char*)payload, update, source);
-        return;
-    }
+    const char* subtopic = topic;
+    switch(dispatch_match_route(subtopic)) {
+        case DISPATCH_ROUTE_COMMAND: // startsWith command/
+            dispatch_command(subtopic, (char*)payload, update, source);
+            return;
 
 #if HASP_USE_CONFIG > 0
-    if(topic == strstr_P(topic, PSTR("config/"))) { // startsWith config/
-        topic += 7u;
-        dispatch_config(topic, (char*)payload, source);
-        return;
-    }
+        case DISPATCH_ROUTE_CONFIG: // startsWith config/
+            dispatch_config(subtopic, (char*)payload, source);
+            return;
 #endif
 
 #if defined(HASP_USE_CUSTOM)
-    if(topic == strstr_P(topic, PSTR(MQTT_TOPIC_CUSTOM "/"))) { // startsWith custom
-        topic += 7u;
-        custom_topic_payload(topic, (char*)payload, source);
-        return;
-    }
+        case DISPATCH_ROUTE_CUSTOM: // startsWith custom/
+            custom_topic_payload(subtopic, (char*)payload, source);
+            return;
 #endif
 
+        default:
+            break;
+    }
+
     dispatch_command(topic, (char*)payload, update, source); // dispatch as is
 }
 
@@ -596,7 +720,9 @@ void dispatch_config(const char* topic, const char* payload, uint8_t source)
 #endif
 
     // Send output
-    if(!update) {
+    if(update) {
+        configSetDirty(topic); // persisted after the debounce period
+    } else {
         char subtopic[8];
         settings.remove(FP_CONFIG_PASS); // hide password in output
 
@@ -649,9 +775,11 @@ bool dispatch_json_variant(JsonVariant& json, uint8_t& savedPage, uint8_t source
 {
     if(json.is<JsonArray>()) { // handle json as an array of commands
         LOG_DEBUG(TAG_MSGR, "Json ARRAY");
+        hasp_attribute_begin();
         for(JsonVariant command : json.as<JsonArray>()) {
             dispatch_json_variant(command, savedPage, source);
         }
+        hasp_attribute_commit();
 
     } else if(json.is<JsonObject>()) { // handle json as a jsonl
         LOG_DEBUG(TAG_MSGR, "Json OBJECT");
@@ -707,6 +835,257 @@ void dispatch_text_line(const char* payload, uint8_t source)
     dispatch_simple_text_command(payload, source);
 }
 
+/* ===== Precompiled event scripts ===== */
+
+// Temporary storage while compiling, the result is copied into one allocation
+typedef struct
+{
+    dispatch_script_event_t events[DISPATCH_SCRIPT_MAX_EVENTS];
+    dispatch_script_op_t ops[DISPATCH_SCRIPT_MAX_OPS];
+    char strings[DISPATCH_SCRIPT_MAX_STRINGS];
+    uint8_t event_count;
+    uint8_t op_count;
+    uint16_t strings_len;
+    bool overflow;
+} dispatch_script_builder_t;
+
+static uint16_t dispatch_script_add_string(dispatch_script_builder_t* b, const char* str, size_t len)
+{
+    if(b->strings_len + len + 1 > sizeof(b->strings)) {
+        b->overflow = true;
+        return 0;
+    }
+
+    uint16_t offset = b->strings_len;
+    memcpy(b->strings + offset, str, len);
+    b->strings[offset + len] = '\0';
+    b->strings_len += len + 1;
+    return offset;
+}
+
+static void dispatch_script_add_op(dispatch_script_builder_t* b, uint8_t type, uint8_t page, uint8_t id,
+                                   const char* topic, const char* payload, bool update)
+{
+    if(b->op_count >= DISPATCH_SCRIPT_MAX_OPS) {
+        b->overflow = true;
+        return;
+    }
+
+    dispatch_script_op_t* op = &b->ops[b->op_count++];
+    op->type                 = type;
+    op->page                 = page;
+    op->id                   = id;
+    op->update               = update;
+    op->topic                = dispatch_script_add_string(b, topic, strlen(topic));
+    op->payload              = dispatch_script_add_string(b, payload, strlen(payload));
+}
+
+static void dispatch_script_add_text(dispatch_script_builder_t* b, const char* cmnd);
+
+// Same decisions as dispatch_topic_payload and dispatch_command, resolved once
+static void dispatch_script_add_topic_payload(dispatch_script_builder_t* b, const char* topic, const char* payload,
+                                              bool update)
+{
+    if(!strcmp_P(topic, PSTR(MQTT_TOPIC_COMMAND)) || topic[0] == '\0') {
+        dispatch_script_add_text(b, payload);
+        return;
+    }
+
+    const char* subtopic   = topic;
+    dispatch_route_t route = dispatch_match_route(subtopic);
+    if(route != DISPATCH_ROUTE_NONE && route != DISPATCH_ROUTE_COMMAND) {
+        dispatch_script_add_op(b, DISPATCH_OP_TOPIC, 0, 0, topic, payload, update); // routed at runtime
+        return;
+    }
+
+    uint8_t pageid, objid;
+    if(const char* attr = dispatch_parse_button_target(subtopic, pageid, objid)) {
+        dispatch_script_add_op(b, DISPATCH_OP_ATTRIBUTE, pageid, objid, attr, payload, update);
+    } else if(haspCommand_t* command = dispatch_find_command(subtopic)) {
+        dispatch_script_add_op(b, DISPATCH_OP_COMMAND, 0, command - commands, subtopic, payload, update);
+    } else {
+        dispatch_script_add_op(b, DISPATCH_OP_TOPIC, 0, 0, topic, payload, update);
+    }
+}
+
+// Same split as dispatch_simple_text_command, done once
+static void dispatch_script_add_text(dispatch_script_builder_t* b, const char* cmnd)
+{
+    while(cmnd[0] == ' ' || cmnd[0] == '\t') cmnd++; // skip leading spaces
+    if(cmnd[0] == '/' && cmnd[1] == '/') return;     // comment
+
+    switch(cmnd[0]) {
+        case '#':  // comment
+        case '\0': // empty line
+            return;
+
+        case '{':
+        case '[':
+            dispatch_script_add_op(b, DISPATCH_OP_TEXT, 0, 0, "", cmnd, false);
+            return;
+    }
+
+    const char* equal = strchr(cmnd, '=');
+    const char* space = strchr(cmnd, ' ');
+    const char* sep   = equal && (!space || equal < space) ? equal : space;
+
+    if(!sep || sep == cmnd) {
+        dispatch_script_add_topic_payload(b, cmnd, "", false);
+        return;
+    }
+
+    char topic[64];
+    size_t len = sep - cmnd;
+    if(len >= sizeof(topic)) len = sizeof(topic) - 1;
+    memcpy(topic, cmnd, len);
+    topic[len] = '\0';
+
+    bool update = sep == equal || strlen(sep + 1) > 0; // equal sign OR space with payload
+    dispatch_script_add_topic_payload(b, topic, sep + 1, update);
+}
+
+static void dispatch_script_add_variant(dispatch_script_builder_t* b, JsonVariantConst json)
+{
+    if(json.is<JsonArrayConst>()) {
+        for(JsonVariantConst command : json.as<JsonArrayConst>()) dispatch_script_add_variant(b, command);
+
+    } else if(json.is<JsonObjectConst>()) { // jsonl object, kept as text
+        char buffer[DISPATCH_SCRIPT_MAX_STRINGS];
+        size_t len = serializeJson(json, buffer, sizeof(buffer));
+        if(len >= sizeof(buffer) - 1) b->overflow = true;
+        dispatch_script_add_op(b, DISPATCH_OP_OBJECT, 0, 0, "", buffer, false);
+
+    } else if(json.is<const char*>()) {
+        dispatch_script_add_text(b, json.as<const char*>());
+
+    } else if(!json.isNull()) {
+        LOG_WARNING(TAG_MSGR, "Json has unknown type");
+    }
+}
+
+/**
+ * Compile an event script like {"up":"page 2","down":["p1b2.val=1","backlight=on"]} into a command list.
+ * Object targets and commands are resolved once, running the script does not parse anything.
+ * @param json object with the event names as keys
+ * @return newly allocated script or NULL when out of memory or too large
+ */
+dispatch_script_t* dispatch_script_compile(JsonVariantConst json)
+{
+    if(!json.is<JsonObjectConst>()) return NULL;
+
+    dispatch_script_builder_t* b = (dispatch_script_builder_t*)hasp_calloc(1, sizeof(dispatch_script_builder_t));
+    if(!b) return NULL;
+
+    for(JsonPairConst kv : json.as<JsonObjectConst>()) {
+        if(b->event_count >= DISPATCH_SCRIPT_MAX_EVENTS) {
+            b->overflow = true;
+            break;
+        }
+
+        dispatch_script_event_t* event = &b->events[b->event_count++];
+        event->name                    = dispatch_script_add_string(b, kv.key().c_str(), strlen(kv.key().c_str()));
+        event->first                   = b->op_count;
+        dispatch_script_add_variant(b, kv.value());
+        event->count = b->op_count - event->first;
+    }
+
+    dispatch_script_t* script = NULL;
+    if(b->overflow) {
+        LOG_WARNING(TAG_MSGR, F("Script too large to compile"));
+    } else {
+        size_t size = sizeof(dispatch_script_t) + b->event_count * sizeof(dispatch_script_event_t) +
+                      b->op_count * sizeof(dispatch_script_op_t) + b->strings_len;
+        script = (dispatch_script_t*)hasp_malloc(size);
+        if(script) {
+            uint8_t* p          = (uint8_t*)(script + 1);
+            script->event_count = b->event_count;
+            script->op_count    = b->op_count;
+            script->size        = size;
+            memcpy(p, b->events, b->event_count * sizeof(dispatch_script_event_t));
+            p += b->event_count * sizeof(dispatch_script_event_t);
+            memcpy(p, b->ops, b->op_count * sizeof(dispatch_script_op_t));
+            p += b->op_count * sizeof(dispatch_script_op_t);
+            memcpy(p, b->strings, b->strings_len);
+        }
+    }
+
+    hasp_free(b);
+    return script;
+}
+
+void dispatch_script_free(dispatch_script_t* script)
+{
+    hasp_free(script);
+}
+
+// Create an object of a script, like a jsonl object in a json array it does not change the saved jsonl page
+static void dispatch_script_new_object(const char* payload, uint8_t& page)
+{
+    DynamicJsonDocument doc((128u * ((strlen(payload) / 128) + 1)) + 512);
+    DeserializationError jsonError = deserializeJson(doc, payload);
+    if(jsonError) {
+        dispatch_json_error(TAG_MSGR, jsonError);
+        return;
+    }
+    hasp_new_object(doc.as<JsonObject>(), page);
+}
+
+/**
+ * Execute the commands of one event of a compiled script
+ * @param script compiled with dispatch_script_compile
+ * @param eventname name of the event to execute
+ * @param source origin of the commands
+ * @return false if the script has no commands for this event
+ */
+bool dispatch_script_run(const dispatch_script_t* script, const char* eventname, uint8_t source)
+{
+    const dispatch_script_event_t* events = (const dispatch_script_event_t*)(script + 1);
+    const dispatch_script_op_t* ops       = (const dispatch_script_op_t*)(events + script->event_count);
+    const char* strings                   = (const char*)(ops + script->op_count);
+
+    uint8_t i = 0;
+    while(i < script->event_count && strcmp(strings + events[i].name, eventname)) i++;
+    if(i == script->event_count) return false;
+
+    // A command can delete the object that owns the script, work on a copy
+    dispatch_script_t* copy = (dispatch_script_t*)lv_mem_buf_get(script->size);
+    if(!copy) return false;
+    memcpy(copy, script, script->size);
+
+    events  = (const dispatch_script_event_t*)(copy + 1);
+    ops     = (const dispatch_script_op_t*)(events + copy->event_count);
+    strings = (const char*)(ops + copy->op_count);
+
+    uint8_t page = haspPages.get(); // objects without a page property are created on the current page
+    hasp_attribute_begin();
+    for(uint8_t n = events[i].first; n < events[i].first + events[i].count; n++) {
+        const dispatch_script_op_t* op = &ops[n];
+        const char* topic              = strings + op->topic;
+        const char* payload            = strings + op->payload;
+
+        switch(op->type) {
+            case DISPATCH_OP_ATTRIBUTE:
+                hasp_process_attribute(op->page, op->id, topic, payload, op->update);
+                break;
+            case DISPATCH_OP_COMMAND:
+                commands[op->id].func(topic, payload, source);
+                break;
+            case DISPATCH_OP_TOPIC:
+                dispatch_topic_payload(topic, payload, op->update, source);
+                break;
+            case DISPATCH_OP_OBJECT:
+                dispatch_script_new_object(payload, page);
+                break;
+            default:
+                dispatch_simple_text_command(payload, source);
+        }
+    }
+    hasp_attribute_commit();
+
+    lv_mem_buf_release(copy);
+    return true;
+}
+
 void dispatch_parse_json(const char*, const char* payload, uint8_t source)
 { // Parse an incoming JSON array into individual commands
   // StaticJsonDocument<2048> doc;
@@ -748,6 +1127,7 @@ void dispatch_parse_jsonl(std::istream& stream, uint8_t& saved_page_id)
     //     line++;
     // }
 
+    hasp_attribute_begin();
     while(1) {
         jsonError = deserializeJson(jsonl, stream);
         if(jsonError == DeserializationError::Ok) {
@@ -757,6 +1137,7 @@ void dispatch_parse_jsonl(std::istream& stream, uint8_t& saved_page_id)
             break;
         }
     };
+    hasp_attribute_commit();
 
     /* For debugging purposes */
     if(jsonError == DeserializationError::EmptyInput) {
@@ -771,6 +1152,8 @@ void dispatch_parse_jsonl(std::istream& stream, uint8_t& saved_page_id)
 
 void dispatch_parse_jsonl(const char*, const char* payload, uint8_t source)
 {
+    if(jsonl_stream_command(payload, source)) return; // chunked upload
+
     if(source != TAG_MQTT) saved_jsonl_page = haspPages.get();
 #if HASP_USE_CONFIG > 0 && HASP_TARGET_ARDUINO
     CharStream stream((char*)payload);
@@ -1009,6 +1392,34 @@ void dispatch_clear_page(const char*, const char* page, uint8_t source)
     haspPages.clear(pageid);
 }
 
+static void dispatch_page_state_object(uint8_t pageid, uint8_t objid, JsonObject& state, void*)
+{
+    char payload[HASP_OBJECT_STATE_SIZE];
+    serializeJson(state, payload, sizeof(payload));
+    object_dispatch_state(pageid, objid, payload);
+}
+
+// Sends the state of all objects on a page id or the current page if empty, optionally only the listed attributes
+static void dispatch_page_state(const char*, const char* payload, uint8_t source)
+{
+    uint8_t pageid    = haspPages.get();
+    const char* attrs = payload;
+
+    if(isdigit(payload[0])) { // pagestate 2 obj,val
+        pageid = atoi(payload);
+        attrs  = strchr(payload, ' ');
+        attrs  = attrs ? attrs + 1 : "";
+    }
+
+    if(!haspPages.is_valid(pageid)) {
+        LOG_WARNING(TAG_MSGR, F(D_DISPATCH_INVALID_PAGE), payload);
+        return;
+    }
+
+    uint16_t count = hasp_object_page_state(pageid, attrs, dispatch_page_state_object, nullptr);
+    LOG_VERBOSE(TAG_MSGR, F("Page %u state sent (%u objects)"), pageid, count);
+}
+
 // Clears all fonts
 void dispatch_clear_font(const char*, const char* payload, uint8_t source)
 {
@@ -1272,6 +1683,8 @@ void dispatch_send_sensordata(const char*, const char*, uint8_t source)
         case MQTT_ERR_OK:
             LOG_TRACE(TAG_MQTT_PUB, F(MQTT_TOPIC_SENSORS " => %s"), data);
             break;
+        case MQTT_ERR_QUEUED:
+            break;
         case MQTT_ERR_PUB_FAIL:
             LOG_ERROR(TAG_MQTT_PUB, F(D_MQTT_FAILED " " MQTT_TOPIC_SENSORS " => %s"), data);
             break;
@@ -1567,6 +1980,7 @@ static void dispatch_add_command(const char* p_cmdstr, void (*func)(const char*,
     } else {
         commands[nCommands].p_cmdstr = p_cmdstr;
         commands[nCommands].func     = func;
+        commands[nCommands].hash     = 0;
         nCommands++;
     }
 }
@@ -1588,6 +2002,7 @@ void dispatchSetup()
     dispatch_add_command(PSTR("sleep"), dispatch_sleep);
     dispatch_add_command(PSTR("statusupdate"), dispatch_statusupdate);
     dispatch_add_command(PSTR("clearpage"), dispatch_clear_page);
+    dispatch_add_command(PSTR("pagestate"), dispatch_page_state);
     dispatch_add_command(PSTR("clearfont"), dispatch_clear_font);
     dispatch_add_command(PSTR("sensors"), dispatch_send_sensordata);
     dispatch_add_command(PSTR("theme"), dispatch_theme);
@@ -1604,6 +2019,7 @@ void dispatchSetup()
     dispatch_add_command(PSTR("screenshot"), dispatch_screenshot);
     dispatch_add_command(PSTR("discovery"), dispatch_queue_discovery);
     dispatch_add_command(PSTR("factoryreset"), dispatch_factory_reset);
+    dispatch_add_command(PSTR("rules"), hasp_rules_command);
 
     /* obsolete commands */
     // dispatch_add_command(PSTR("dim"), dispatch_backlight_obsolete);
@@ -1621,6 +2037,8 @@ void dispatchSetup()
 #endif
     /* WARNING: remember to expand the commands array when adding new commands */
 
+    dispatch_build_command_table();
+
     LOG_INFO(TAG_MSGR, F(D_SERVICE_STARTED));
 }
 
@@ -65,6 +65,54 @@ void dispatch_parse_jsonl(std::istream& stream, uint8_t& saved_page_id);
 #endif
 bool dispatch_json_variant(JsonVariant& json, uint8_t& savedPage, uint8_t source);
 
+/* ===== Precompiled event scripts ===== */
+#ifndef DISPATCH_SCRIPT_MAX_EVENTS
+#define DISPATCH_SCRIPT_MAX_EVENTS 16 // events per script
+#endif
+#ifndef DISPATCH_SCRIPT_MAX_OPS
+#define DISPATCH_SCRIPT_MAX_OPS 32 // commands per script
+#endif
+#ifndef DISPATCH_SCRIPT_MAX_STRINGS
+#define DISPATCH_SCRIPT_MAX_STRINGS 512 // bytes of topics and payloads per script
+#endif
+
+enum dispatch_op_type_t {
+    DISPATCH_OP_ATTRIBUTE = 0, // pXbY.attr on a pre-resolved page and id
+    DISPATCH_OP_COMMAND   = 1, // entry of the commands table
+    DISPATCH_OP_TOPIC     = 2, // other topics, routed when executed
+    DISPATCH_OP_TEXT      = 3, // text line like jsonl, parsed when executed
+    DISPATCH_OP_OBJECT    = 4, // jsonl object, created on the current page when executed
+};
+
+typedef struct
+{
+    uint16_t name; // offset of the event name in the strings
+    uint8_t first; // index of the first command
+    uint8_t count; // number of commands
+} dispatch_script_event_t;
+
+typedef struct
+{
+    uint8_t type;     // dispatch_op_type_t
+    uint8_t page;     // page of an attribute
+    uint8_t id;       // object id of an attribute or index in the commands table
+    uint8_t update;   // payload given
+    uint16_t topic;   // offset of the topic or attribute in the strings
+    uint16_t payload; // offset of the payload in the strings
+} dispatch_script_op_t;
+
+// Single allocation: header, events, commands and strings
+struct dispatch_script_t
+{
+    uint8_t event_count;
+    uint8_t op_count;
+    uint16_t size;
+};
+
+dispatch_script_t* dispatch_script_compile(JsonVariantConst json);
+void dispatch_script_free(dispatch_script_t* script);
+bool dispatch_script_run(const dispatch_script_t* script, const char* eventname, uint8_t source);
+
 void dispatch_clear_page(const char* page);
 void dispatch_json_error(uint8_t tag, DeserializationError& jsonError);
 
@@ -109,6 +157,7 @@ struct haspCommand_t
 {
     const char* p_cmdstr;
     void (*func)(const char*, const char*, uint8_t);
+    uint32_t hash; // case-insensitive hash of p_cmdstr
 };
 
 #endif
\ No newline at end of file
@@ -42,8 +42,14 @@ void event_reset_last_value_sent()
     last_value_sent = INT16_MIN;
 }
 
-void script_event_handler(const char* eventname, const char* json)
+// Run the compiled script, the json is only parsed if the script could not be compiled
+void script_event_handler(const char* eventname, const dispatch_script_t* script, const char* json)
 {
+    if(script) {
+        dispatch_script_run(script, eventname, TAG_EVENT);
+        return;
+    }
+
     StaticJsonDocument<256> doc;
     StaticJsonDocument<64> filter;
 
@@ -69,6 +75,11 @@ void delete_event_handler(lv_obj_t* obj, lv_event_t event)
 {
     if(event != LV_EVENT_DELETE) return;
 
+    hasp_attribute_forget(obj); // drop pending attribute changes
+#if HASP_USE_LABEL_CACHE > 0
+    hasp_label_cache_forget(obj); // free the rendered text
+#endif
+
     switch(obj_get_type(obj)) {
         case LV_HASP_LINE:
             my_line_clear_points(obj);
@@ -116,6 +127,9 @@ void delete_event_handler(lv_obj_t* obj, lv_event_t event)
     my_obj_set_tag(obj, (char*)NULL);
     my_obj_set_action(obj, (char*)NULL);
     my_obj_set_swipe(obj, (char*)NULL);
+#if HASP_USE_MQTT > 0
+    my_obj_set_bind(obj, (char*)NULL);
+#endif
 }
 
 /* ============================== Timer Event  ============================ */
@@ -411,19 +425,20 @@ void swipe_event_handler(lv_obj_t* obj, lv_event_t event)
     if(event != LV_EVENT_GESTURE) return;
 
     if(const char* swipe = my_obj_get_swipe(obj)) {
-        lv_gesture_dir_t dir = lv_indev_get_gesture_dir(lv_indev_get_act());
+        const dispatch_script_t* script = my_obj_get_swipe_script(obj);
+        lv_gesture_dir_t dir            = lv_indev_get_gesture_dir(lv_indev_get_act());
         switch(dir) {
             case LV_GESTURE_DIR_LEFT:
-                script_event_handler("left", swipe);
+                script_event_handler("left", script, swipe);
                 break;
             case LV_GESTURE_DIR_RIGHT:
-                script_event_handler("right", swipe);
+                script_event_handler("right", script, swipe);
                 break;
             case LV_GESTURE_DIR_BOTTOM:
-                script_event_handler("down", swipe);
+                script_event_handler("down", script, swipe);
                 break;
             default:
-                script_event_handler("up", swipe);
+                script_event_handler("up", script, swipe);
         }
     }
 }
@@ -532,7 +547,7 @@ void generic_event_handler(lv_obj_t* obj, lv_event_t event)
     if(const char* action = my_obj_get_action(obj)) {
         char eventname[8];
         Parser::get_event_name(last_value_sent, eventname, sizeof(eventname));
-        script_event_handler(eventname, action);
+        script_event_handler(eventname, my_obj_get_action_script(obj), action);
     } else {
         char data[512];
         {
@@ -551,6 +566,8 @@ void generic_event_handler(lv_obj_t* obj, lv_event_t event)
         bool state = Parser::get_event_state(last_value_sent);
         event_update_group(obj->user_data.groupid, obj, state, state, HASP_EVENT_OFF, HASP_EVENT_ON);
     }
+
+    hasp_rules_process(obj, last_value_sent, false, 0);
 }
 
 /**
@@ -596,6 +613,8 @@ void toggle_event_handler(lv_obj_t* obj, lv_event_t event)
         event_update_group(obj->user_data.groupid, obj, last_value_sent, last_value_sent, HASP_EVENT_OFF,
                            HASP_EVENT_ON);
     }
+
+    hasp_rules_process(obj, hasp_event_id, true, last_value_sent);
 }
 
 /**
@@ -830,6 +849,8 @@ void slider_event_handler(lv_obj_t* obj, lv_event_t event)
 
     if(obj->user_data.groupid && (hasp_event_id == HASP_EVENT_CHANGED || hasp_event_id == HASP_EVENT_UP) && min != max)
         event_update_group(obj->user_data.groupid, obj, !!val, val, min, max);
+
+    hasp_rules_process(obj, hasp_event_id, true, val);
 }
 
 /**
@@ -163,9 +163,11 @@ static lv_font_t* font_add_to_list(const char* payload)
 
     // Try .bin file
     snprintf_P(filename, sizeof(filename), PSTR("L:\\%s.bin"), payload);
+    uint32_t start    = millis();
     lv_font_t* font   = hasp_font_load(filename);
     char* name_p      = NULL;
     uint8_t font_type = 0;
+    if(font) LOG_VERBOSE(TAG_FONT, F("Loaded %s in %u ms"), filename, millis() - start);
 
 #if defined(ARDUINO_ARCH_ESP32) && (HASP_USE_FREETYPE > 0)
     char* ext[] = {"ttf", "otf"};
@@ -0,0 +1,229 @@
+/* MIT License - Copyright (c) 2019-2024 Francis Van Roie
+   For full license information read the LICENSE file in the project folder */
+
+/* Decoded image cache shared by all image decoders
+ * The open and close callbacks of the registered decoders are wrapped. A decoded file stays in the cache after it is
+ * closed, until the byte budget is exceeded. Then the unused image with the lowest priority is freed by its own
+ * decoder. The priority of an image is the time it took to decode plus the priority of the last freed image, so
+ * images that are slow to decode stay longer than recently used but cheap ones. */
+
+#include "hasplib.h"
+#include "src/lv_misc/lv_gc.h"
+
+#include "hasp_debug.h"
+
+typedef struct hasp_img_cache_entry_t
+{
+    struct hasp_img_cache_entry_t* next;
+    lv_img_decoder_t* decoder;
+    const char* src;     // interned file name
+    const uint8_t* data; // decoded image, allocated by the decoder
+    uint32_t size;
+    uint32_t priority;
+    uint16_t cost; // ms to decode
+    uint8_t refs;  // open descriptors using the data
+    bool stale;    // invalidated while in use, freed when closed
+} hasp_img_cache_entry_t;
+
+typedef struct
+{
+    lv_img_decoder_t* decoder;
+    lv_img_decoder_open_f_t open_cb;   // original open callback
+    lv_img_decoder_close_f_t close_cb; // original close callback
+} hasp_img_cache_decoder_t;
+
+static hasp_img_cache_decoder_t img_decoders[HASP_IMG_CACHE_DECODERS];
+static uint8_t img_decoder_count;
+static hasp_img_cache_entry_t* img_cache;
+static uint32_t img_cache_clock; // priority of the last freed image
+static hasp_img_cache_stats_t img_stats;
+
+static hasp_img_cache_decoder_t* img_cache_find_decoder(lv_img_decoder_t* decoder)
+{
+    for(uint8_t i = 0; i < img_decoder_count; i++) {
+        if(img_decoders[i].decoder == decoder) return &img_decoders[i];
+    }
+    return NULL;
+}
+
+// Let the decoder free the image data
+static void img_cache_free(hasp_img_cache_entry_t* entry)
+{
+    hasp_img_cache_decoder_t* d = img_cache_find_decoder(entry->decoder);
+    if(d && d->close_cb) {
+        lv_img_decoder_dsc_t dsc;
+        memset(&dsc, 0, sizeof(dsc));
+        dsc.decoder  = entry->decoder;
+        dsc.src      = entry->src;
+        dsc.src_type = LV_IMG_SRC_FILE;
+        dsc.img_data = entry->data;
+        d->close_cb(entry->decoder, &dsc);
+    }
+
+    img_stats.bytes -= entry->size;
+    img_stats.entries--;
+    hasp_str_release(entry->src);
+    hasp_free(entry);
+}
+
+// Free the unused image with the lowest priority
+static bool img_cache_evict()
+{
+    hasp_img_cache_entry_t** victim = NULL;
+    for(hasp_img_cache_entry_t** e = &img_cache; *e; e = &(*e)->next) {
+        if((*e)->refs == 0 && (!victim || (*e)->priority < (*victim)->priority)) victim = e;
+    }
+    if(!victim) return false; // all images are in use
+
+    hasp_img_cache_entry_t* entry = *victim;
+    *victim                       = entry->next;
+    img_cache_clock               = entry->priority;
+    img_cache_free(entry);
+    img_stats.evictions++;
+    return true;
+}
+
+static lv_res_t img_cache_open(lv_img_decoder_t* decoder, lv_img_decoder_dsc_t* dsc)
+{
+    hasp_img_cache_decoder_t* d = img_cache_find_decoder(decoder);
+    if(!d || !d->open_cb) return LV_RES_INV;
+
+    if(dsc->src_type == LV_IMG_SRC_FILE) {
+        for(hasp_img_cache_entry_t* entry = img_cache; entry; entry = entry->next) {
+            if(entry->decoder != decoder || entry->stale || strcmp(entry->src, (const char*)dsc->src)) continue;
+
+            entry->refs++;
+            entry->priority = img_cache_clock + entry->cost;
+            dsc->img_data   = entry->data;
+            dsc->user_data  = NULL;
+            img_stats.hits++;
+            return LV_RES_OK;
+        }
+    }
+
+    uint32_t start = millis();
+    lv_res_t res   = d->open_cb(decoder, dsc);
+    if(res != LV_RES_OK || dsc->src_type != LV_IMG_SRC_FILE) return res;
+
+    // Only whole images without private decoder data can be kept after close
+    uint32_t size = lv_img_buf_get_img_size(dsc->header.w, dsc->header.h, dsc->header.cf);
+    if(!dsc->img_data || dsc->user_data || size > img_stats.budget) {
+        img_stats.uncached++;
+        return res;
+    }
+
+    hasp_img_cache_entry_t* entry = (hasp_img_cache_entry_t*)hasp_calloc(1, sizeof(hasp_img_cache_entry_t));
+    const char* src               = hasp_str_intern((const char*)dsc->src);
+    if(!entry || !src) {
+        hasp_free(entry);
+        hasp_str_release(src);
+        img_stats.uncached++;
+        return res;
+    }
+
+    uint32_t cost   = millis() - start;
+    entry->decoder  = decoder;
+    entry->src      = src;
+    entry->data     = dsc->img_data;
+    entry->size     = size;
+    entry->cost     = cost < 1 ? 1 : cost > UINT16_MAX ? UINT16_MAX : cost;
+    entry->priority = img_cache_clock + entry->cost;
+    entry->refs     = 1;
+    entry->next     = img_cache;
+    img_cache       = entry;
+
+    img_stats.misses++;
+    img_stats.entries++;
+    img_stats.bytes += size;
+    if(img_stats.bytes > img_stats.peak) img_stats.peak = img_stats.bytes;
+
+    while(img_stats.bytes > img_stats.budget && img_cache_evict()) {
+    }
+    return res;
+}
+
+static void img_cache_close(lv_img_decoder_t* decoder, lv_img_decoder_dsc_t* dsc)
+{
+    for(hasp_img_cache_entry_t** e = &img_cache; *e; e = &(*e)->next) {
+        hasp_img_cache_entry_t* entry = *e;
+        if(entry->decoder != decoder || entry->data != dsc->img_data) continue;
+
+        if(entry->refs > 0) entry->refs--;
+        if(entry->refs == 0 && entry->stale) {
+            *e = entry->next;
+            img_cache_free(entry);
+        }
+        return; // the data stays in the cache
+    }
+
+    hasp_img_cache_decoder_t* d = img_cache_find_decoder(decoder);
+    if(d && d->close_cb) d->close_cb(decoder, dsc);
+}
+
+/**
+ * Wrap all registered image decoders, call after the decoders are initialized
+ * @param budget maximum bytes of decoded images to keep
+ */
+void hasp_img_cache_init(uint32_t budget)
+{
+    img_stats.budget = budget;
+    if(budget == 0 || img_decoder_count > 0) return;
+
+    lv_img_decoder_t* decoder;
+    _LV_LL_READ(LV_GC_ROOT(_lv_img_defoder_ll), decoder)
+    {
+        if(img_decoder_count >= HASP_IMG_CACHE_DECODERS) break;
+
+        hasp_img_cache_decoder_t* d = &img_decoders[img_decoder_count++];
+        d->decoder                  = decoder;
+        d->open_cb                  = decoder->open_cb;
+        d->close_cb                 = decoder->close_cb;
+        decoder->open_cb            = img_cache_open;
+        decoder->close_cb           = img_cache_close;
+    }
+
+    LOG_VERBOSE(TAG_LVGL, F("Image cache: %u bytes, %u decoders"), budget, img_decoder_count);
+}
+
+// The image source has a drive letter, a path on the filesystem matches the file on any drive
+static bool img_cache_match(const char* entry_src, const char* src)
+{
+    if(!strcmp(entry_src, src)) return true;
+    return src[0] == '/' && entry_src[0] != '\0' && entry_src[1] == ':' && !strcmp(entry_src + 2, src);
+}
+
+/**
+ * Remove a file from the cache, the image is freed when it is no longer in use
+ * @param src file name of the image like L:/img.png or /img.png, NULL removes all images
+ */
+void hasp_img_cache_invalidate(const void* src)
+{
+    if(src && lv_img_src_get_type(src) != LV_IMG_SRC_FILE) return;
+
+    hasp_img_cache_entry_t** e = &img_cache;
+    while(*e) {
+        hasp_img_cache_entry_t* entry = *e;
+        if(!src || img_cache_match(entry->src, (const char*)src)) {
+            if(entry->refs == 0) {
+                *e = entry->next;
+                img_cache_free(entry);
+                continue;
+            }
+            entry->stale = true;
+        }
+        e = &entry->next;
+    }
+}
+
+void hasp_img_cache_get_info(JsonDocument& doc)
+{
+    JsonObject info      = doc.createNestedObject(F("Image Cache"));
+    info[F("entries")]   = img_stats.entries;
+    info[F("bytes")]     = img_stats.bytes;
+    info[F("peak")]      = img_stats.peak;
+    info[F("budget")]    = img_stats.budget;
+    info[F("hits")]      = img_stats.hits;
+    info[F("misses")]    = img_stats.misses;
+    info[F("evictions")] = img_stats.evictions;
+    info[F("uncached")]  = img_stats.uncached;
+}
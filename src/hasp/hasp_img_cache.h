@@ -0,0 +1,37 @@
+/* MIT License - Copyright (c) 2019-2024 Francis Van Roie
+   For full license information read the LICENSE file in the project folder */
+
+#ifndef HASP_IMG_CACHE_H
+#define HASP_IMG_CACHE_H
+
+#include "hasplib.h"
+
+#ifndef HASP_IMG_CACHE_SIZE
+#define HASP_IMG_CACHE_SIZE 65536 // bytes of decoded images kept in internal ram, 0 disables the cache
+#endif
+
+#ifndef HASP_IMG_CACHE_SIZE_PSRAM
+#define HASP_IMG_CACHE_SIZE_PSRAM 2097152 // bytes of decoded images kept when PSRAM is available
+#endif
+
+#ifndef HASP_IMG_CACHE_DECODERS
+#define HASP_IMG_CACHE_DECODERS 8 // image decoders that can be wrapped
+#endif
+
+typedef struct
+{
+    uint32_t hits;      // images opened without decoding
+    uint32_t misses;    // images decoded and added to the cache
+    uint32_t evictions; // images freed to stay within the budget
+    uint32_t uncached;  // images that could not be cached, too large or decoded line by line
+    uint32_t bytes;     // decoded bytes in the cache
+    uint32_t peak;      // highest number of cached bytes
+    uint32_t budget;    // maximum number of cached bytes
+    uint16_t entries;   // images in the cache
+} hasp_img_cache_stats_t;
+
+void hasp_img_cache_init(uint32_t budget);
+void hasp_img_cache_invalidate(const void* src);
+void hasp_img_cache_get_info(JsonDocument& doc);
+
+#endif
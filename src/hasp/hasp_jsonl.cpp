@@ -0,0 +1,234 @@
+/* MIT License - Copyright (c) 2019-2024 Francis Van Roie
+   For full license information read the LICENSE file in the project folder */
+
+/* Streaming upload of large jsonl layouts in sequence numbered chunks:
+ *   jsonl begin          start a new upload
+ *   jsonl <seq> <data>   chunk of jsonl text, seq starts at 0
+ *   jsonl status         report the next expected seq and crc, to resume after a reconnect
+ *   jsonl end <crc>      parse the last line and verify the crc32 of all chunks (8 hex digits)
+ * Complete lines are created as soon as their chunk arrives, only an incomplete last line is kept.
+ * Replies are published to the jsonl state topic. */
+
+#include "hasplib.h"
+
+static struct
+{
+    char* line;      // incomplete line carried over to the next chunk
+    uint16_t length; // bytes in line
+    uint16_t size;   // allocated size of line
+    uint32_t seq;    // next expected chunk
+    uint32_t crc;    // crc32 of the accepted chunks
+    uint32_t bytes;  // bytes accepted
+    uint32_t start;  // millis() at begin
+    uint8_t page;    // page of objects without a page property
+    bool active;
+    bool discard; // skip the rest of a line that could not be carried over
+} upload;
+
+static jsonl_stream_stats_t jsonl_stats;
+
+// Standard crc32 (zlib) using a 16 entry table
+static uint32_t jsonl_crc32(uint32_t crc, const char* data, size_t len)
+{
+    static const uint32_t table[16] = {0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4,
+                                       0x4DB26158, 0x5005713C, 0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C,
+                                       0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C};
+    crc = ~crc;
+    while(len--) {
+        crc ^= (uint8_t)*data++;
+        crc = (crc >> 4) ^ table[crc & 0x0F];
+        crc = (crc >> 4) ^ table[crc & 0x0F];
+    }
+    return ~crc;
+}
+
+static void jsonl_stream_reply(const char* status)
+{
+    char data[96];
+    snprintf_P(data, sizeof(data), PSTR("{\"status\":\"%s\",\"seq\":%u,\"crc\":\"%08x\",\"bytes\":%u}"), status,
+               upload.seq, upload.crc, upload.bytes);
+    dispatch_state_subtopic("jsonl", data);
+}
+
+static void jsonl_stream_reset()
+{
+    hasp_free(upload.line);
+    upload.line   = NULL;
+    upload.length = 0;
+    upload.size    = 0;
+    upload.active  = false;
+    upload.discard = false;
+}
+
+static void jsonl_stream_parse_line(JsonDocument& doc, const char* line, size_t length)
+{
+    while(length > 0 && (line[length - 1] == '\r' || line[length - 1] == ' ')) length--;
+    if(length == 0) return;
+
+    DeserializationError jsonError = deserializeJson(doc, line, length);
+    if(jsonError == DeserializationError::Ok) {
+        hasp_new_object(doc.as<JsonObject>(), upload.page);
+        jsonl_stats.lines++;
+    } else if(jsonError != DeserializationError::EmptyInput) { // comment lines are empty
+        LOG_ERROR(TAG_MSGR, F(D_JSONL_FAILED ": %s"), jsonl_stats.lines + 1, jsonError.c_str());
+    }
+}
+
+// Keep an incomplete line until the next chunk arrives
+static bool jsonl_stream_carry(const char* data, size_t length)
+{
+    size_t needed = upload.length + length;
+    if(needed >= HASP_JSONL_LINE_MAX) {
+        LOG_ERROR(TAG_MSGR, F("Jsonl line exceeds %u bytes"), HASP_JSONL_LINE_MAX);
+        upload.length  = 0;
+        upload.discard = true;
+        jsonl_stats.errors++;
+        return false;
+    }
+
+    if(needed > upload.size) {
+        uint16_t size = needed < 256 ? 256 : HASP_JSONL_LINE_MAX;
+        char* line    = (char*)hasp_realloc(upload.line, size);
+        if(!line) {
+            LOG_ERROR(TAG_MSGR, D_ERROR_OUT_OF_MEMORY);
+            upload.length  = 0;
+            upload.discard = true;
+            return false;
+        }
+        upload.line = line;
+        upload.size = size;
+    }
+
+    memcpy(upload.line + upload.length, data, length);
+    upload.length = needed;
+    if(upload.length > jsonl_stats.peak) jsonl_stats.peak = upload.length;
+    return true;
+}
+
+// Create the objects of all complete lines in the chunk
+static void jsonl_stream_chunk(const char* data, size_t length)
+{
+    DynamicJsonDocument doc(HASP_JSONL_LINE_MAX + 256);
+    const char* end = data + length;
+
+    hasp_attribute_begin();
+    while(data < end) {
+        const char* newline = (const char*)memchr(data, '\n', end - data);
+        if(upload.discard) { // the remainder of a dropped line is not a line by itself
+            if(!newline) break;
+            upload.discard = false;
+            data           = newline + 1;
+            continue;
+        }
+
+        if(!newline) {
+            jsonl_stream_carry(data, end - data);
+            break;
+        }
+
+        if(upload.length > 0) { // finish the line of the previous chunk
+            if(jsonl_stream_carry(data, newline - data)) jsonl_stream_parse_line(doc, upload.line, upload.length);
+            upload.length  = 0;
+            upload.discard = false; // the dropped line ends here
+        } else {
+            jsonl_stream_parse_line(doc, data, newline - data);
+        }
+        data = newline + 1;
+    }
+    hasp_attribute_commit();
+}
+
+/**
+ * Handle the upload subcommands of jsonl
+ * @param payload begin, status, end <crc> or <seq> <data>
+ * @param source origin of the command
+ * @return false if the payload is plain jsonl
+ */
+bool jsonl_stream_command(const char* payload, uint8_t source)
+{
+    if(!payload[0]) return false;
+
+    if(!strcasecmp_P(payload, PSTR("begin"))) {
+        jsonl_stream_reset();
+        upload.seq    = 0;
+        upload.crc    = 0;
+        upload.bytes  = 0;
+        upload.start  = millis();
+        upload.page   = haspPages.get();
+        upload.active = true;
+        jsonl_stats.uploads++;
+        jsonl_stream_reply("ready");
+        return true;
+    }
+
+    if(!strcasecmp_P(payload, PSTR("status"))) {
+        jsonl_stream_reply(upload.active ? "busy" : "idle");
+        return true;
+    }
+
+    if(!strncasecmp(payload, "end", 3) && (payload[3] == ' ' || payload[3] == '\0')) {
+        if(!upload.active) {
+            jsonl_stream_reply("idle");
+            return true;
+        }
+
+        if(upload.length > 0) { // last line without a newline
+            DynamicJsonDocument doc(HASP_JSONL_LINE_MAX + 256);
+            hasp_attribute_begin();
+            jsonl_stream_parse_line(doc, upload.line, upload.length);
+            hasp_attribute_commit();
+        }
+
+        jsonl_stats.time = millis() - upload.start;
+        bool valid       = payload[3] == '\0' || strtoul(payload + 4, NULL, 16) == upload.crc;
+        if(!valid) jsonl_stats.errors++;
+        LOG_INFO(TAG_MSGR, F("Jsonl upload of %u bytes in %u ms, crc %08x"), upload.bytes, jsonl_stats.time,
+                 upload.crc);
+
+        jsonl_stream_reply(valid ? "done" : "crc");
+        jsonl_stream_reset();
+        return true;
+    }
+
+    if(!isdigit(payload[0])) return false; // plain jsonl
+
+    char* data;
+    uint32_t seq = strtoul(payload, &data, 10);
+    if(*data != ' ' && *data != '\n') return false; // not a chunk
+    data++;
+
+    if(!upload.active) {
+        jsonl_stream_reply("idle");
+
+    } else if(seq < upload.seq) {
+        jsonl_stats.duplicates++; // already applied before the reconnect
+
+    } else if(seq > upload.seq) {
+        jsonl_stats.errors++;
+        jsonl_stream_reply("resend"); // a chunk was lost, resume from upload.seq
+
+    } else {
+        size_t length = strlen(data);
+        upload.crc    = jsonl_crc32(upload.crc, data, length);
+        upload.bytes += length;
+        upload.seq++;
+        jsonl_stats.chunks++;
+        jsonl_stats.bytes += length;
+        jsonl_stream_chunk(data, length);
+    }
+
+    return true;
+}
+
+void jsonl_stream_get_info(JsonDocument& doc)
+{
+    JsonObject info       = doc.createNestedObject(F("Jsonl Upload"));
+    info[F("uploads")]    = jsonl_stats.uploads;
+    info[F("chunks")]     = jsonl_stats.chunks;
+    info[F("duplicates")] = jsonl_stats.duplicates;
+    info[F("errors")]     = jsonl_stats.errors;
+    info[F("objects")]    = jsonl_stats.lines;
+    info[F("bytes")]      = jsonl_stats.bytes;
+    info[F("time")]       = jsonl_stats.time;
+    info[F("peakLine")]   = jsonl_stats.peak;
+}
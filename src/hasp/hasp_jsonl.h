@@ -0,0 +1,28 @@
+/* MIT License - Copyright (c) 2019-2024 Francis Van Roie
+   For full license information read the LICENSE file in the project folder */
+
+#ifndef HASP_JSONL_H
+#define HASP_JSONL_H
+
+#include "hasplib.h"
+
+#ifndef HASP_JSONL_LINE_MAX
+#define HASP_JSONL_LINE_MAX 2048 // longest jsonl line that can be split across chunks
+#endif
+
+typedef struct
+{
+    uint32_t uploads;    // uploads started
+    uint32_t chunks;     // chunks accepted
+    uint32_t duplicates; // chunks received again after a resume
+    uint32_t errors;     // chunks out of order, lines too long or crc mismatches
+    uint32_t lines;      // objects created
+    uint32_t bytes;      // bytes accepted
+    uint32_t time;       // ms between begin and end of the last upload
+    uint16_t peak;       // largest partial line carried over between chunks
+} jsonl_stream_stats_t;
+
+bool jsonl_stream_command(const char* payload, uint8_t source);
+void jsonl_stream_get_info(JsonDocument& doc);
+
+#endif
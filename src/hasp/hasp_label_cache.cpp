@@ -0,0 +1,388 @@
+/* MIT License - Copyright (c) 2019-2024 Francis Van Roie
+   For full license information read the LICENSE file in the project folder */
+
+/* Render cache for static labels
+ * Labels with the `cache` attribute get a design function that marks them while their text is drawn. lv_draw_label
+ * is wrapped at link time with -Wl,--wrap=lv_draw_label: the text of a marked label is rendered once in white on black
+ * into a temporary buffer, kept as an 8 bit coverage mask and blitted in the label color on the next redraws. The mask
+ * is rendered again when the text, font, size, spacing, offset or flags change, so color and opacity changes still
+ * hit. A label that changes on every frame, e.g. a scrolling text, is drawn by lvgl until it is stable again. */
+
+#include "hasplib.h"
+
+#if HASP_USE_LABEL_CACHE > 0
+
+#include "src/lv_draw/lv_draw_blend.h"
+#include "src/lv_draw/lv_draw_mask.h"
+
+#include "hasp_debug.h"
+#include "hasp_label_cache.h"
+
+typedef struct hasp_label_entry_t
+{
+    struct hasp_label_entry_t* next;
+    const lv_obj_t* obj;
+    uint32_t used; // lv_tick_get() of the last draw
+
+    // Everything that changes the shape of the text
+    const lv_font_t* font;
+    char* text;
+    lv_coord_t width;
+    lv_coord_t height;
+    lv_coord_t ofs_x;
+    lv_coord_t ofs_y;
+    lv_style_int_t letter_space;
+    lv_style_int_t line_space;
+    lv_txt_flag_t flag;
+    lv_text_decor_t decor;
+    lv_bidi_dir_t bidi_dir;
+    uint8_t changes; // key changes in a row
+
+    lv_coord_t* spans; // first and last column with coverage of each row, followed by the mask
+    lv_opa_t* mask;    // width x height coverage, NULL when not rendered
+    uint32_t size;     // bytes of the text copy and the mask
+} hasp_label_entry_t;
+
+static hasp_label_entry_t* label_cache;
+static hasp_label_cache_stats_t label_stats;
+static lv_design_cb_t label_design_orig; // design function of lv_label
+static const lv_obj_t* label_drawing;    // cached label whose text is being drawn
+
+extern "C" void __real_lv_draw_label(const lv_area_t* coords, const lv_area_t* mask, const lv_draw_label_dsc_t* dsc,
+                                     const char* txt, lv_draw_label_hint_t* hint);
+
+static void label_free_mask(hasp_label_entry_t* entry)
+{
+    if(!entry->mask) return;
+
+    uint32_t size = (uint32_t)entry->width * entry->height + entry->height * 2 * sizeof(lv_coord_t);
+    hasp_free(entry->spans);
+    entry->mask  = NULL;
+    entry->spans = NULL;
+    entry->size -= size;
+    label_stats.bytes -= size;
+}
+
+static void label_free(hasp_label_entry_t** e)
+{
+    hasp_label_entry_t* entry = *e;
+    *e                        = entry->next;
+
+    label_free_mask(entry);
+    label_stats.bytes -= entry->size; // text copy
+    label_stats.entries--;
+    hasp_free(entry->text);
+    hasp_free(entry);
+}
+
+// Free the least recently used label other than keep
+static bool label_evict(const hasp_label_entry_t* keep)
+{
+    hasp_label_entry_t** victim = NULL;
+    for(hasp_label_entry_t** e = &label_cache; *e; e = &(*e)->next) {
+        if(*e == keep) continue;
+        if(!victim || (*e)->used - (*victim)->used > UINT32_MAX / 2) victim = e; // older, also across a tick rollover
+    }
+    if(!victim) return false;
+
+    label_free(victim);
+    label_stats.evictions++;
+    return true;
+}
+
+static hasp_label_entry_t** label_find(const lv_obj_t* obj)
+{
+    hasp_label_entry_t** e = &label_cache;
+    while(*e && (*e)->obj != obj) e = &(*e)->next;
+    return e;
+}
+
+static bool label_key_equal(const hasp_label_entry_t* entry, const lv_area_t* coords, const lv_draw_label_dsc_t* dsc,
+                            const char* txt)
+{
+    return entry->font == dsc->font && entry->width == lv_area_get_width(coords) &&
+           entry->height == lv_area_get_height(coords) && entry->ofs_x == dsc->ofs_x && entry->ofs_y == dsc->ofs_y &&
+           entry->letter_space == dsc->letter_space && entry->line_space == dsc->line_space &&
+           entry->flag == dsc->flag && entry->decor == dsc->decor && entry->bidi_dir == dsc->bidi_dir &&
+           entry->text && !strcmp(entry->text, txt);
+}
+
+static bool label_key_set(hasp_label_entry_t* entry, const lv_area_t* coords, const lv_draw_label_dsc_t* dsc,
+                          const char* txt)
+{
+    label_free_mask(entry);
+
+    if(!entry->text || strcmp(entry->text, txt)) {
+        size_t len = strlen(txt) + 1;
+        char* text = (char*)hasp_malloc(len);
+        if(!text) return false;
+        memcpy(text, txt, len);
+
+        if(entry->text) {
+            label_stats.bytes -= entry->size;
+            hasp_free(entry->text);
+        }
+        entry->text = text;
+        entry->size = len;
+        label_stats.bytes += len;
+    }
+
+    entry->font         = dsc->font;
+    entry->width        = lv_area_get_width(coords);
+    entry->height       = lv_area_get_height(coords);
+    entry->ofs_x        = dsc->ofs_x;
+    entry->ofs_y        = dsc->ofs_y;
+    entry->letter_space = dsc->letter_space;
+    entry->line_space   = dsc->line_space;
+    entry->flag         = dsc->flag;
+    entry->decor        = dsc->decor;
+    entry->bidi_dir     = dsc->bidi_dir;
+    return true;
+}
+
+// Draw the text in white on black into a private buffer and keep its brightness as coverage
+static bool label_render(hasp_label_entry_t* entry, const lv_area_t* coords, const lv_draw_label_dsc_t* dsc,
+                         const char* txt)
+{
+    lv_coord_t w  = entry->width;
+    lv_coord_t h  = entry->height;
+    uint32_t size = (uint32_t)w * h + h * 2 * sizeof(lv_coord_t);
+    if(size > label_stats.budget) return false;
+    while(label_stats.bytes + size > label_stats.budget && label_evict(entry)) {
+    }
+    if(label_stats.bytes + size > label_stats.budget) return false;
+
+    lv_disp_t* disp    = _lv_refr_get_disp_refreshing();
+    lv_disp_buf_t* vdb = disp ? lv_disp_get_buf(disp) : NULL;
+    if(!vdb) return false;
+
+    lv_color_t* buf   = (lv_color_t*)hasp_calloc((uint32_t)w * h, sizeof(lv_color_t)); // black
+    lv_coord_t* spans = (lv_coord_t*)hasp_malloc(size);
+    if(!buf || !spans) {
+        hasp_free(buf);
+        hasp_free(spans);
+        return false;
+    }
+
+    // Let lvgl draw into the private buffer as if it were the display buffer
+    lv_color_t* buf_act = vdb->buf_act;
+    lv_area_t area      = vdb->area;
+    vdb->buf_act        = buf;
+    vdb->area           = *coords;
+
+    lv_draw_label_dsc_t white = *dsc;
+    white.color               = LV_COLOR_WHITE;
+    white.opa                 = LV_OPA_COVER;
+    white.blend_mode          = LV_BLEND_MODE_NORMAL;
+    __real_lv_draw_label(coords, coords, &white, txt, NULL);
+
+    vdb->buf_act = buf_act;
+    vdb->area    = area;
+
+    lv_opa_t* mask = (lv_opa_t*)(spans + h * 2);
+    for(lv_coord_t y = 0; y < h; y++) {
+        lv_coord_t first = w;
+        lv_coord_t last  = -1;
+        for(lv_coord_t x = 0; x < w; x++) {
+            uint32_t i = (uint32_t)y * w + x;
+            mask[i]    = lv_color_brightness(buf[i]);
+            if(mask[i] > LV_OPA_TRANSP) {
+                if(first == w) first = x;
+                last = x;
+            }
+        }
+        spans[y * 2]     = first;
+        spans[y * 2 + 1] = last;
+    }
+    hasp_free(buf);
+
+    entry->mask  = mask;
+    entry->spans = spans;
+    entry->size += size;
+    label_stats.bytes += size;
+    return true;
+}
+
+static void label_blit(const hasp_label_entry_t* entry, const lv_area_t* coords, const lv_area_t* clip,
+                       const lv_draw_label_dsc_t* dsc)
+{
+    lv_area_t draw_area;
+    if(!_lv_area_intersect(&draw_area, coords, clip)) return;
+
+    lv_opa_t* line = (lv_opa_t*)_lv_mem_buf_get(lv_area_get_width(&draw_area));
+
+    for(lv_coord_t y = draw_area.y1; y <= draw_area.y2; y++) {
+        lv_coord_t row = y - coords->y1;
+        lv_coord_t x1  = LV_MATH_MAX(draw_area.x1, coords->x1 + entry->spans[row * 2]);
+        lv_coord_t x2  = LV_MATH_MIN(draw_area.x2, coords->x1 + entry->spans[row * 2 + 1]);
+        if(x1 > x2) continue; // no text on this row
+
+        lv_coord_t len = x2 - x1 + 1;
+        memcpy(line, entry->mask + (uint32_t)row * entry->width + (x1 - coords->x1), len);
+        if(lv_draw_mask_apply(line, x1, y, len) == LV_DRAW_MASK_RES_TRANSP) continue;
+
+        lv_area_t fill = {x1, y, x2, y};
+        _lv_blend_fill(clip, &fill, dsc->color, line, LV_DRAW_MASK_RES_CHANGED, dsc->opa, dsc->blend_mode);
+    }
+
+    _lv_mem_buf_release(line);
+}
+
+// Selections and recolored text use more than one color
+static inline bool label_is_cacheable(const lv_draw_label_dsc_t* dsc, const char* txt)
+{
+    if(dsc->sel_start != LV_DRAW_LABEL_NO_TXT_SEL && dsc->sel_end != LV_DRAW_LABEL_NO_TXT_SEL) return false;
+    if((dsc->flag & LV_TXT_FLAG_RECOLOR) && strchr(txt, LV_TXT_COLOR_CMD[0])) return false;
+    return true;
+}
+
+extern "C" void __wrap_lv_draw_label(const lv_area_t* coords, const lv_area_t* mask, const lv_draw_label_dsc_t* dsc,
+                                     const char* txt, lv_draw_label_hint_t* hint)
+{
+    if(!label_drawing || label_stats.budget == 0 || !txt || !txt[0] || dsc->opa <= LV_OPA_MIN) {
+        __real_lv_draw_label(coords, mask, dsc, txt, hint);
+        return;
+    }
+
+    hasp_label_entry_t** e = label_find(label_drawing);
+    if(!label_is_cacheable(dsc, txt)) {
+        if(*e) label_free(e);
+        label_stats.bypassed++;
+        __real_lv_draw_label(coords, mask, dsc, txt, hint);
+        return;
+    }
+
+    hasp_label_entry_t* entry = *e;
+    if(!entry) {
+        entry = (hasp_label_entry_t*)hasp_calloc(1, sizeof(hasp_label_entry_t));
+        if(entry) {
+            entry->obj  = label_drawing;
+            entry->next = label_cache;
+            label_cache = entry;
+            label_stats.entries++;
+        }
+    }
+
+    bool cached = false;
+    if(entry) {
+        bool stable = label_key_equal(entry, coords, dsc, txt);
+        entry->used = lv_tick_get();
+
+        if(stable) {
+            entry->changes = 0;
+        } else if(entry->changes < UINT8_MAX) {
+            entry->changes++;
+        }
+
+        if(stable && entry->mask) {
+            label_stats.hits++;
+            cached = true;
+        } else if((stable || label_key_set(entry, coords, dsc, txt)) && entry->changes <= HASP_LABEL_CACHE_CHANGES &&
+                  lv_draw_mask_get_cnt() == 0 && label_render(entry, coords, dsc, txt)) {
+            label_stats.misses++;
+            cached = true;
+        }
+    }
+
+    if(cached) {
+        label_blit(entry, coords, mask, dsc);
+    } else {
+        label_stats.bypassed++;
+        __real_lv_draw_label(coords, mask, dsc, txt, hint);
+    }
+}
+
+// Mark the label while lv_label draws its text
+static lv_design_res_t label_cache_design(lv_obj_t* obj, const lv_area_t* clip_area, lv_design_mode_t mode)
+{
+    if(mode != LV_DESIGN_DRAW_MAIN) return label_design_orig(obj, clip_area, mode);
+
+    label_drawing       = obj;
+    lv_design_res_t res = label_design_orig(obj, clip_area, mode);
+    label_drawing       = NULL;
+    return res;
+}
+
+/**
+ * Set the memory budget of the label cache
+ * @param budget maximum bytes of rendered text to keep, 0 lets lvgl draw all labels
+ */
+void hasp_label_cache_init(uint32_t budget)
+{
+    label_stats.budget = budget;
+    while(label_stats.bytes > label_stats.budget && label_evict(NULL)) {
+    }
+    LOG_VERBOSE(TAG_LVGL, F("Label cache: %u bytes"), budget);
+}
+
+/**
+ * Draw the text of a label from the cache
+ * @param label label object
+ * @param enable true to cache the rendered text, false to let lvgl draw it again
+ * @return true if the setting changed
+ */
+bool hasp_label_cache_enable(lv_obj_t* label, bool enable)
+{
+    if(!label || hasp_label_cache_enabled(label) == enable) return false;
+
+    if(enable) {
+        if(!label_design_orig) label_design_orig = lv_obj_get_design_cb(label);
+        lv_obj_set_design_cb(label, label_cache_design);
+    } else {
+        lv_obj_set_design_cb(label, label_design_orig);
+        hasp_label_entry_t** e = label_find(label);
+        if(*e) label_free(e);
+    }
+
+    lv_obj_invalidate(label);
+    return true;
+}
+
+/**
+ * Drop the cached text of an object that is being deleted
+ * @param obj label, or button whose label is cached
+ * @note called from LV_EVENT_DELETE, before lvgl deletes the children of obj
+ */
+void hasp_label_cache_forget(lv_obj_t* obj)
+{
+    if(!label_cache || !obj) return;
+
+    hasp_label_entry_t** e = label_find(obj);
+    if(*e) label_free(e);
+
+    for(lv_obj_t* child = lv_obj_get_child(obj, NULL); child; child = lv_obj_get_child(obj, child)) {
+        e = label_find(child);
+        if(*e) label_free(e);
+    }
+}
+
+bool hasp_label_cache_enabled(const lv_obj_t* label)
+{
+    return label && lv_obj_get_design_cb(label) == label_cache_design;
+}
+
+void hasp_label_cache_get_info(JsonDocument& doc)
+{
+    JsonObject info      = doc.createNestedObject(F("Label Cache"));
+    info[F("entries")]   = label_stats.entries;
+    info[F("bytes")]     = label_stats.bytes;
+    info[F("budget")]    = label_stats.budget;
+    info[F("hits")]      = label_stats.hits;
+    info[F("misses")]    = label_stats.misses;
+    info[F("bypassed")]  = label_stats.bypassed;
+    info[F("evictions")] = label_stats.evictions;
+}
+
+#else
+
+// The build flags wrap lv_draw_label unconditionally, so keep the symbol when the cache is disabled.
+extern "C" void __real_lv_draw_label(const lv_area_t* coords, const lv_area_t* mask, const lv_draw_label_dsc_t* dsc,
+                                     const char* txt, lv_draw_label_hint_t* hint) __attribute__((weak));
+
+extern "C" void __wrap_lv_draw_label(const lv_area_t* coords, const lv_area_t* mask, const lv_draw_label_dsc_t* dsc,
+                                     const char* txt, lv_draw_label_hint_t* hint)
+{
+    __real_lv_draw_label(coords, mask, dsc, txt, hint);
+}
+
+#endif
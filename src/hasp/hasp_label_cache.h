@@ -0,0 +1,38 @@
+/* MIT License - Copyright (c) 2019-2024 Francis Van Roie
+   For full license information read the LICENSE file in the project folder */
+
+#ifndef HASP_LABEL_CACHE_H
+#define HASP_LABEL_CACHE_H
+
+#include "hasplib.h"
+
+#ifndef HASP_LABEL_CACHE_SIZE
+#define HASP_LABEL_CACHE_SIZE 32768 // bytes of rendered text kept in internal ram
+#endif
+
+#ifndef HASP_LABEL_CACHE_SIZE_PSRAM
+#define HASP_LABEL_CACHE_SIZE_PSRAM 262144 // bytes of rendered text kept when PSRAM is available
+#endif
+
+#ifndef HASP_LABEL_CACHE_CHANGES
+#define HASP_LABEL_CACHE_CHANGES 3 // stop rendering a label to the cache after this many changes in a row
+#endif
+
+typedef struct
+{
+    uint32_t hits;      // redraws blitted from the cache
+    uint32_t misses;    // labels rendered into the cache
+    uint32_t bypassed;  // redraws drawn by lvgl: selection, recolor, masks, too large or changing every frame
+    uint32_t evictions; // bitmaps freed to stay within the budget
+    uint32_t bytes;     // bitmap bytes in the cache
+    uint32_t budget;    // maximum number of bitmap bytes
+    uint16_t entries;   // cached labels
+} hasp_label_cache_stats_t;
+
+void hasp_label_cache_init(uint32_t budget);
+bool hasp_label_cache_enable(lv_obj_t* label, bool enable);
+bool hasp_label_cache_enabled(const lv_obj_t* label);
+void hasp_label_cache_forget(lv_obj_t* obj);
+void hasp_label_cache_get_info(JsonDocument& doc);
+
+#endif
@@ -5,6 +5,7 @@
 
 #include "hasp_conf.h" // include first
 #include "hasp_debug.h"
+#include "hasp_lvfs.h"
 
 void filesystem_list_path(const char* path)
 {
@@ -34,3 +35,232 @@ void filesystem_list_path(const char* path)
 
     lv_fs_dir_close(&dir);
 }
+
+/* ===== Buffered read-ahead wrapper around an lv_fs driver ===== */
+
+// Per-file state, followed by the file data of the wrapped driver
+typedef struct
+{
+    uint8_t* buffer;    // read-ahead buffer, NULL for unbuffered files
+    uint32_t buf_size;  // allocated size of the buffer
+    uint32_t buf_start; // file offset of buffer[0]
+    uint32_t buf_len;   // valid bytes in the buffer
+    uint32_t pos;       // position as seen by the caller
+    uint32_t drv_pos;   // position of the underlying file
+    hasp_lvfs_stats_t stats;
+    char name[24];
+} lvfs_file_t;
+
+#define LVFS_HEADER_SIZE ((sizeof(lvfs_file_t) + 7) & ~7)
+#define LVFS_INNER(f) ((void*)((uint8_t*)(f) + LVFS_HEADER_SIZE))
+
+static lv_fs_drv_t lvfs_orig_drv; // copy of the wrapped driver with its original callbacks
+static hasp_lvfs_stats_t lvfs_stats;
+
+static lv_fs_res_t lvfs_sync_pos(lvfs_file_t* f)
+{
+    if(f->drv_pos == f->pos) return LV_FS_RES_OK;
+
+    f->stats.driver_seeks++;
+    lv_fs_res_t res = lvfs_orig_drv.seek_cb(&lvfs_orig_drv, LVFS_INNER(f), f->pos);
+    if(res == LV_FS_RES_OK) f->drv_pos = f->pos;
+    return res;
+}
+
+static lv_fs_res_t lvfs_open(lv_fs_drv_t* drv, void* file_p, const char* path, lv_fs_mode_t mode)
+{
+    lvfs_file_t* f = (lvfs_file_t*)file_p;
+    memset(f, 0, sizeof(lvfs_file_t));
+
+    size_t len = strlen(path);
+    strncpy(f->name, len < sizeof(f->name) ? path : path + len - sizeof(f->name) + 1, sizeof(f->name) - 1);
+
+    lv_fs_res_t res = lvfs_orig_drv.open_cb(&lvfs_orig_drv, LVFS_INNER(f), path, mode);
+    if(res != LV_FS_RES_OK) return res;
+
+    // Only read-only files are buffered, writers go straight to the driver
+    if(mode == LV_FS_MODE_RD && HASP_LVFS_BLOCK_SIZE > 0 && lvfs_orig_drv.seek_cb) {
+        f->buffer = (uint8_t*)lv_mem_alloc(HASP_LVFS_BLOCK_SIZE);
+        if(f->buffer) f->buf_size = HASP_LVFS_BLOCK_SIZE;
+    }
+
+    return LV_FS_RES_OK;
+}
+
+static lv_fs_res_t lvfs_close(lv_fs_drv_t* drv, void* file_p)
+{
+    lvfs_file_t* f  = (lvfs_file_t*)file_p;
+    lv_fs_res_t res = lvfs_orig_drv.close_cb(&lvfs_orig_drv, LVFS_INNER(f));
+
+    if(f->buffer) lv_mem_free(f->buffer);
+    f->buffer = NULL;
+
+    if(f->stats.reads > 0) {
+        LOG_DEBUG(TAG_LVFS, F("%s: %u reads, %u hits, %u driver reads, %u of %u seeks, %u bytes"), f->name,
+                  f->stats.reads, f->stats.hits, f->stats.driver_reads, f->stats.driver_seeks, f->stats.seeks,
+                  f->stats.bytes);
+    }
+
+    lvfs_stats.files++;
+    lvfs_stats.reads += f->stats.reads;
+    lvfs_stats.hits += f->stats.hits;
+    lvfs_stats.driver_reads += f->stats.driver_reads;
+    lvfs_stats.seeks += f->stats.seeks;
+    lvfs_stats.driver_seeks += f->stats.driver_seeks;
+    lvfs_stats.bytes += f->stats.bytes;
+    lvfs_stats.driver_bytes += f->stats.driver_bytes;
+
+    return res;
+}
+
+static lv_fs_res_t lvfs_read(lv_fs_drv_t* drv, void* file_p, void* buf, uint32_t btr, uint32_t* br)
+{
+    lvfs_file_t* f  = (lvfs_file_t*)file_p;
+    uint8_t* dst    = (uint8_t*)buf;
+    uint32_t done   = 0;
+    bool hit        = true;
+    lv_fs_res_t res = LV_FS_RES_OK;
+
+    f->stats.reads++;
+
+    while(done < btr) {
+        // Serve what we can from the buffer
+        if(f->pos >= f->buf_start && f->pos < f->buf_start + f->buf_len) {
+            uint32_t offset = f->pos - f->buf_start;
+            uint32_t len    = f->buf_len - offset;
+            if(len > btr - done) len = btr - done;
+
+            memcpy(dst + done, f->buffer + offset, len);
+            done += len;
+            f->pos += len;
+            continue;
+        }
+
+        hit = false;
+        res = lvfs_sync_pos(f);
+        if(res != LV_FS_RES_OK) break;
+
+        uint32_t read = 0;
+        if(btr - done >= f->buf_size) {
+            // Large reads bypass the buffer, also used for unbuffered files
+            res = lvfs_orig_drv.read_cb(&lvfs_orig_drv, LVFS_INNER(f), dst + done, btr - done, &read);
+            done += read;
+            f->pos += read;
+        } else {
+            res          = lvfs_orig_drv.read_cb(&lvfs_orig_drv, LVFS_INNER(f), f->buffer, f->buf_size, &read);
+            f->buf_start = f->pos;
+            f->buf_len   = read;
+        }
+
+        f->drv_pos += read;
+        f->stats.driver_reads++;
+        f->stats.driver_bytes += read;
+        if(res != LV_FS_RES_OK || read == 0) break; // error or end of file
+    }
+
+    if(hit) f->stats.hits++;
+    f->stats.bytes += done;
+    if(br) *br = done;
+    return res;
+}
+
+static lv_fs_res_t lvfs_write(lv_fs_drv_t* drv, void* file_p, const void* buf, uint32_t btw, uint32_t* bw)
+{
+    lvfs_file_t* f  = (lvfs_file_t*)file_p;
+    lv_fs_res_t res = lvfs_sync_pos(f);
+    if(res != LV_FS_RES_OK) return res;
+
+    uint32_t written = 0;
+    res              = lvfs_orig_drv.write_cb(&lvfs_orig_drv, LVFS_INNER(f), buf, btw, &written);
+    f->pos += written;
+    f->drv_pos = f->pos;
+    f->buf_len = 0; // the buffer may be stale now
+
+    if(bw) *bw = written;
+    return res;
+}
+
+static lv_fs_res_t lvfs_seek(lv_fs_drv_t* drv, void* file_p, uint32_t pos)
+{
+    lvfs_file_t* f = (lvfs_file_t*)file_p;
+
+    // The driver is only repositioned when the next read misses the buffer
+    f->stats.seeks++;
+    f->pos = pos;
+    return LV_FS_RES_OK;
+}
+
+static lv_fs_res_t lvfs_tell(lv_fs_drv_t* drv, void* file_p, uint32_t* pos_p)
+{
+    lvfs_file_t* f = (lvfs_file_t*)file_p;
+    *pos_p         = f->pos;
+    return LV_FS_RES_OK;
+}
+
+static lv_fs_res_t lvfs_size(lv_fs_drv_t* drv, void* file_p, uint32_t* size_p)
+{
+    lvfs_file_t* f = (lvfs_file_t*)file_p;
+    if(!lvfs_orig_drv.size_cb) return LV_FS_RES_NOT_IMP;
+    return lvfs_orig_drv.size_cb(&lvfs_orig_drv, LVFS_INNER(f), size_p);
+}
+
+static lv_fs_res_t lvfs_trunc(lv_fs_drv_t* drv, void* file_p)
+{
+    lvfs_file_t* f = (lvfs_file_t*)file_p;
+    if(!lvfs_orig_drv.trunc_cb) return LV_FS_RES_NOT_IMP;
+
+    lv_fs_res_t res = lvfs_sync_pos(f);
+    if(res != LV_FS_RES_OK) return res;
+
+    f->buf_len = 0;
+    return lvfs_orig_drv.trunc_cb(&lvfs_orig_drv, LVFS_INNER(f));
+}
+
+/**
+ * Insert the read-ahead buffer between LVGL and the driver registered for a drive letter.
+ * Only one drive can be wrapped, call it after lv_fs_if_init().
+ * @param letter the drive letter of the driver to wrap
+ */
+void lvfs_cache_init(char letter)
+{
+    lv_fs_drv_t* drv = lv_fs_get_drv(letter);
+    if(!drv) {
+        LOG_WARNING(TAG_LVFS, F("Drive %c not found"), letter);
+        return;
+    }
+    if(drv->open_cb == lvfs_open) return; // already wrapped
+    if(!drv->open_cb || !drv->close_cb || !drv->read_cb) return;
+
+    lvfs_orig_drv = *drv;
+
+    drv->file_size = LVFS_HEADER_SIZE + lvfs_orig_drv.file_size;
+    drv->open_cb   = lvfs_open;
+    drv->close_cb  = lvfs_close;
+    drv->read_cb   = lvfs_read;
+    drv->write_cb  = lvfs_orig_drv.write_cb ? lvfs_write : NULL;
+    drv->seek_cb   = lvfs_orig_drv.seek_cb ? lvfs_seek : NULL;
+    drv->tell_cb   = lvfs_tell;
+    drv->size_cb   = lvfs_size;
+    drv->trunc_cb  = lvfs_trunc;
+
+    LOG_VERBOSE(TAG_LVFS, F("Drive %c read-ahead %u bytes"), letter, HASP_LVFS_BLOCK_SIZE);
+}
+
+const hasp_lvfs_stats_t* lvfs_cache_get_stats()
+{
+    return &lvfs_stats;
+}
+
+void lvfs_get_info(JsonDocument& doc)
+{
+    JsonObject info        = doc.createNestedObject(F("File Cache"));
+    info[F("blockSize")]   = HASP_LVFS_BLOCK_SIZE;
+    info[F("files")]       = lvfs_stats.files;
+    info[F("reads")]       = lvfs_stats.reads;
+    info[F("hits")]        = lvfs_stats.hits;
+    info[F("driverReads")] = lvfs_stats.driver_reads;
+    info[F("seeks")]       = lvfs_stats.seeks;
+    info[F("driverSeeks")] = lvfs_stats.driver_seeks;
+    info[F("bytes")]       = lvfs_stats.bytes;
+    info[F("driverBytes")] = lvfs_stats.driver_bytes;
+}
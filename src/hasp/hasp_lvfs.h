@@ -4,6 +4,28 @@
 #ifndef HASP_LVFS_H
 #define HASP_LVFS_H
 
+#include "ArduinoJson.h"
+
+#ifndef HASP_LVFS_BLOCK_SIZE
+#define HASP_LVFS_BLOCK_SIZE 1024 // read-ahead block size of the lv_fs cache, 0 disables buffering
+#endif
+
+typedef struct
+{
+    uint32_t files;        // files opened through the cache
+    uint32_t reads;        // lv_fs_read calls
+    uint32_t hits;         // reads served from the buffer
+    uint32_t driver_reads; // reads passed to the underlying driver
+    uint32_t seeks;        // lv_fs_seek calls
+    uint32_t driver_seeks; // seeks passed to the underlying driver
+    uint32_t bytes;        // bytes returned to the caller
+    uint32_t driver_bytes; // bytes read from the underlying driver
+} hasp_lvfs_stats_t;
+
 void filesystem_list_path(const char* path);
 
-#endif
\ No newline at end of file
+void lvfs_cache_init(char letter);
+const hasp_lvfs_stats_t* lvfs_cache_get_stats();
+void lvfs_get_info(JsonDocument& doc);
+
+#endif
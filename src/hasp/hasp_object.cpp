@@ -68,24 +68,18 @@ bool hasp_find_id_from_obj(const lv_obj_t* obj, uint8_t* pageid, uint8_t* objid)
     return true;
 }
 
-void hasp_object_tree(const lv_obj_t* parent, uint8_t pageid, uint16_t level)
+// Call cb for parent and all of its descendants, including the contents of tabview tabs
+void hasp_object_tree_walk(lv_obj_t* parent, uint8_t pageid, uint16_t level, hasp_object_cb_t cb, void* data)
 {
     if(parent == nullptr) return;
 
-    /* Output parent info */
-    char indent[31];
-    memset(indent, 32, 31);
-    if(level < 15) indent[level * 2] = 0;
-    indent[30] = 0;
-
-    LOG_VERBOSE(TAG_HASP, F("%s- " HASP_OBJECT_NOTATION ": %s"), indent, pageid, parent->user_data.id,
-                obj_get_type_name(parent));
+    cb(parent, pageid, level, data);
 
     lv_obj_t* child;
     child = lv_obj_get_child(parent, NULL);
     while(child) {
         /* child found, process it */
-        hasp_object_tree(child, pageid, level + 1);
+        hasp_object_tree_walk(child, pageid, level + 1, cb, data);
 
         /* try next sibling */
         child = lv_obj_get_child(parent, child);
@@ -93,17 +87,80 @@ void hasp_object_tree(const lv_obj_t* parent, uint8_t pageid, uint16_t level)
 
     /* check tabs */
     if(obj_check_type(parent, LV_HASP_TABVIEW)) {
-#if 1
         uint16_t tabcount = lv_tabview_get_tab_count(parent);
         for(uint16_t i = 0; i < tabcount; i++) {
             lv_obj_t* tab = lv_tabview_get_tab(parent, i);
-            LOG_VERBOSE(TAG_HASP, "Found tab %i", i);
-            if(tab->user_data.objid) hasp_object_tree(tab, pageid, level + 1);
+            if(tab->user_data.objid) hasp_object_tree_walk(tab, pageid, level + 1, cb, data);
         }
-#endif
     }
 }
 
+static void hasp_object_tree_log(lv_obj_t* obj, uint8_t pageid, uint16_t level, void*)
+{
+    /* Output parent info */
+    char indent[31];
+    memset(indent, 32, 31);
+    if(level < 15) indent[level * 2] = 0;
+    indent[30] = 0;
+
+    LOG_VERBOSE(TAG_HASP, F("%s- " HASP_OBJECT_NOTATION ": %s"), indent, pageid, obj->user_data.id,
+                obj_get_type_name(obj));
+}
+
+void hasp_object_tree(const lv_obj_t* parent, uint8_t pageid, uint16_t level)
+{
+    hasp_object_tree_walk((lv_obj_t*)parent, pageid, level, hasp_object_tree_log, nullptr);
+}
+
+typedef struct
+{
+    JsonDocument* doc;
+    const char* attrs;
+    hasp_object_state_cb_t cb;
+    void* data;
+    uint16_t count;
+} hasp_object_state_t;
+
+static void hasp_object_state_collect(lv_obj_t* obj, uint8_t pageid, uint16_t level, void* data)
+{
+    hasp_object_state_t* state = (hasp_object_state_t*)data;
+    uint8_t objid              = obj->user_data.id;
+
+    if(level == 0 || objid == 0) return; // skip the page itself and objects that can't be addressed
+
+    JsonObject json = state->doc->to<JsonObject>();
+    json[F("id")]   = objid;
+    hasp_get_obj_attributes(obj, state->attrs, json);
+    if(state->doc->overflowed()) LOG_WARNING(TAG_HASP, F(HASP_OBJECT_NOTATION " state truncated"), pageid, objid);
+
+    state->cb(pageid, objid, json, state->data);
+    state->count++;
+}
+
+/**
+ * Collect the attributes of all objects on a page, one object at a time
+ * @param pageid uint8_t: the page to walk
+ * @param attrs char*: comma separated attribute names, nullptr or empty for HASP_OBJECT_STATE_ATTRS
+ * @param cb hasp_object_state_cb_t: called with the state of each object, the json is reused for the next object
+ * @return the number of objects passed to cb
+ */
+uint16_t hasp_object_page_state(uint8_t pageid, const char* attrs, hasp_object_state_cb_t cb, void* data)
+{
+    lv_obj_t* page = haspPages.get_obj(pageid);
+    if(!page || !cb) return 0;
+
+    DynamicJsonDocument doc(HASP_OBJECT_STATE_SIZE);
+    hasp_object_state_t state;
+    state.doc   = &doc;
+    state.attrs = (attrs && *attrs) ? attrs : HASP_OBJECT_STATE_ATTRS;
+    state.cb    = cb;
+    state.data  = data;
+    state.count = 0;
+
+    hasp_object_tree_walk(page, pageid, 0, hasp_object_state_collect, &state);
+    return state.count;
+}
+
 // ##################### Value Dispatchers ########################################################
 
 /* Sends the data out on the state/pxby topic */
@@ -178,6 +235,7 @@ void hasp_process_attribute(uint8_t pageid, uint8_t objid, const char* attr, con
 int hasp_parse_json_attributes(lv_obj_t* obj, const JsonObject& doc)
 {
     int i = 0;
+    hasp_attribute_begin(); // one refresh for all attributes of this object
 
 #if HASP_TARGET_PC || defined(ESP32)
     std::string v;
@@ -201,6 +259,7 @@ int hasp_parse_json_attributes(lv_obj_t* obj, const JsonObject& doc)
         i++;
     }
 #endif
+    hasp_attribute_commit();
     // LOG_DEBUG(TAG_HASP, F("%d keys processed"), i);
     return i;
 }
@@ -6,6 +6,14 @@
 
 #include "hasplib.h"
 
+#ifndef HASP_OBJECT_STATE_ATTRS
+#define HASP_OBJECT_STATE_ATTRS "obj,x,y,w,h,val,text" // attributes of each object in a page state
+#endif
+
+#ifndef HASP_OBJECT_STATE_SIZE
+#define HASP_OBJECT_STATE_SIZE 1024 // json bytes reserved for the state of one object
+#endif
+
 const char FP_SKIP[] PROGMEM     = "skip";
 const char FP_PAGE[] PROGMEM     = "page";
 const char FP_ID[] PROGMEM       = "id";
@@ -16,9 +24,12 @@ const char FP_GROUPID[] PROGMEM  = "groupid";
 
 typedef struct
 {
-    char* action;
-    char* tag;
-    const char* swipe;
+    const char* action; // interned string
+    const char* tag;    // interned string
+    const char* swipe;  // interned string or static default
+    struct dispatch_script_t* action_script; // compiled action
+    struct dispatch_script_t* swipe_script;  // compiled swipe or static default
+    struct mqtt_binding_t* binding;          // data binding to an mqtt topic
 } hasp_ext_user_data_t;
 
 typedef struct
@@ -100,7 +111,12 @@ lv_obj_t* hasp_find_obj_from_parent_id(lv_obj_t* parent, uint8_t objid);
 lv_obj_t* hasp_find_obj_from_page_id(uint8_t pageid, uint8_t objid);
 bool hasp_find_id_from_obj(const lv_obj_t* obj, uint8_t* pageid, uint8_t* objid);
 
+typedef void (*hasp_object_cb_t)(lv_obj_t* obj, uint8_t pageid, uint16_t level, void* data);
+typedef void (*hasp_object_state_cb_t)(uint8_t pageid, uint8_t objid, JsonObject& state, void* data);
+
 void hasp_object_tree(const lv_obj_t* parent, uint8_t pageid, uint16_t level);
+void hasp_object_tree_walk(lv_obj_t* parent, uint8_t pageid, uint16_t level, hasp_object_cb_t cb, void* data);
+uint16_t hasp_object_page_state(uint8_t pageid, const char* attrs, hasp_object_state_cb_t cb, void* data);
 
 void object_dispatch_state(uint8_t pageid, uint8_t btnid, const char* payload);
 
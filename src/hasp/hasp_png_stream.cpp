@@ -0,0 +1,583 @@
+/* MIT License - Copyright (c) 2019-2024 Francis Van Roie
+   For full license information read the LICENSE file in the project folder */
+
+/* Line by line PNG decoder
+ * lv_png decodes a whole image into one buffer before it can be drawn. This decoder implements the read_line
+ * interface instead: the IDAT stream is inflated and unfiltered one row at a time, with only the previous row kept for
+ * the filters. The last decoded rows are kept in a small strip, so redrawing an area does not inflate the image again.
+ * When a row above the strip is requested the stream restarts from the first row. */
+
+#include "hasplib.h"
+
+#if HASP_USE_PNG_STREAM > 0
+
+#include "hasp_debug.h"
+#include "hasp_png_stream.h"
+
+#if defined(ARDUINO_ARCH_ESP32)
+#include "rom/miniz.h"
+#else
+#include <zlib.h>
+#endif
+
+#define PNG_CHUNK(a, b, c, d) (((uint32_t)(a) << 24) | ((uint32_t)(b) << 16) | ((uint32_t)(c) << 8) | (uint32_t)(d))
+
+enum png_color_t { PNG_GRAY = 0, PNG_RGB = 2, PNG_PALETTE = 3, PNG_GRAY_ALPHA = 4, PNG_RGBA = 6 };
+
+typedef struct
+{
+    lv_fs_file_t file;
+    uint32_t idat_pos;   // file position of the first IDAT data
+    uint32_t idat_len;   // length of the first IDAT chunk
+    uint32_t chunk_left; // unread bytes in the current IDAT chunk
+    uint32_t width;
+    uint32_t height;
+    uint32_t row_bytes; // filtered row without the filter type byte
+    uint32_t next_row;  // next row to inflate
+    uint32_t bytes;     // memory in use by this image
+    uint16_t trns_key[3];
+    uint16_t pal_count;
+    uint8_t depth;
+    uint8_t color;
+    uint8_t interlace;
+    uint8_t channels;
+    uint8_t filter_bpp; // bytes per complete pixel, at least 1
+    uint8_t px_size;    // bytes per pixel in the strip
+    bool alpha;
+    bool trns;
+    bool input_done;
+    uint8_t* palette; // r, g, b, a per entry
+    uint8_t* prev;    // previous unfiltered row
+    uint8_t* cur;     // filter type byte followed by the row
+    uint8_t* strip;   // last decoded rows in lvgl color format
+    uint8_t in[HASP_PNG_READ_SIZE];
+    size_t in_len;
+    size_t in_ofs;
+#if defined(ARDUINO_ARCH_ESP32)
+    tinfl_decompressor* inflator;
+    uint8_t* dict;      // circular LZ dictionary, also the inflate output
+    size_t dict_next;   // where the next output is written
+    size_t dict_avail;  // inflated bytes not yet copied to a row
+    tinfl_status status;
+#else
+    z_stream zs;
+    bool zs_init;
+#endif
+} hasp_png_t;
+
+static hasp_png_stream_stats_t png_stats;
+
+static inline uint32_t png_be32(const uint8_t* buf)
+{
+    return ((uint32_t)buf[0] << 24) | ((uint32_t)buf[1] << 16) | ((uint32_t)buf[2] << 8) | buf[3];
+}
+
+static bool png_read(lv_fs_file_t* file, void* buf, uint32_t len)
+{
+    uint32_t read = 0;
+    return lv_fs_read(file, buf, len, &read) == LV_FS_RES_OK && read == len;
+}
+
+static bool png_skip(lv_fs_file_t* file, uint32_t len)
+{
+    uint32_t pos = 0;
+    return lv_fs_tell(file, &pos) == LV_FS_RES_OK && lv_fs_seek(file, pos + len) == LV_FS_RES_OK;
+}
+
+/**
+ * Read the chunks up to the first IDAT
+ * @param png image with an open file, the palette is only loaded when png->palette is allocated
+ * @return true if the header is valid and the file is positioned at the image data
+ */
+static bool png_parse(hasp_png_t* png)
+{
+    static const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    uint8_t buf[13];
+
+    if(!png_read(&png->file, buf, 8) || memcmp(buf, signature, 8)) return false;
+
+    bool ihdr = false;
+    bool idat = false;
+    while(png_read(&png->file, buf, 8)) {
+        uint32_t len  = png_be32(buf);
+        uint32_t type = png_be32(buf + 4);
+
+        if(type == PNG_CHUNK('I', 'H', 'D', 'R')) {
+            if(len != 13 || !png_read(&png->file, buf, 13)) return false;
+            png->width     = png_be32(buf);
+            png->height    = png_be32(buf + 4);
+            png->depth     = buf[8];
+            png->color     = buf[9];
+            png->interlace = buf[12];
+            if(buf[10] != 0 || buf[11] != 0) return false; // unknown compression or filter method
+            ihdr = true;
+            len  = 0;
+
+        } else if(type == PNG_CHUNK('P', 'L', 'T', 'E') && png->palette && len <= 768 && len % 3 == 0) {
+            if(!png_read(&png->file, png->palette, len)) return false;
+            png->pal_count = len / 3;
+            for(int16_t i = png->pal_count - 1; i >= 0; i--) { // expand rgb to rgba in place
+                png->palette[i * 4 + 3] = 0xFF;
+                png->palette[i * 4 + 2] = png->palette[i * 3 + 2];
+                png->palette[i * 4 + 1] = png->palette[i * 3 + 1];
+                png->palette[i * 4 + 0] = png->palette[i * 3 + 0];
+            }
+            len = 0;
+
+        } else if(type == PNG_CHUNK('t', 'R', 'N', 'S') && len <= sizeof(png->in)) {
+            png->alpha = true;
+            if(!png_read(&png->file, png->in, len)) return false;
+            if(png->color == PNG_PALETTE && png->palette) {
+                for(uint16_t i = 0; i < len && i < png->pal_count; i++) png->palette[i * 4 + 3] = png->in[i];
+            } else if(png->color == PNG_GRAY && len >= 2) {
+                png->trns        = true;
+                png->trns_key[0] = (png->in[0] << 8) | png->in[1];
+            } else if(png->color == PNG_RGB && len >= 6) {
+                png->trns = true;
+                for(uint8_t i = 0; i < 3; i++) png->trns_key[i] = (png->in[i * 2] << 8) | png->in[i * 2 + 1];
+            }
+            len = 0;
+
+        } else if(type == PNG_CHUNK('I', 'D', 'A', 'T')) {
+            if(!ihdr || lv_fs_tell(&png->file, &png->idat_pos) != LV_FS_RES_OK) return false;
+            png->idat_len = len;
+            idat          = true;
+            break;
+
+        } else if(type == PNG_CHUNK('I', 'E', 'N', 'D')) {
+            return false;
+        }
+
+        if(!png_skip(&png->file, len + 4)) return false; // data and crc
+    }
+    if(!ihdr || !idat || png->width == 0 || png->height == 0) return false;
+    if(png->width > 0x7FF || png->height > 0x7FF) return false; // too large for lv_img_header_t
+
+    switch(png->color) {
+        case PNG_GRAY:
+            png->channels = 1;
+            if(png->depth == 0 || png->depth > 16 || (png->depth & (png->depth - 1))) return false;
+            break;
+        case PNG_PALETTE:
+            png->channels = 1;
+            if(png->depth == 0 || png->depth > 8 || (png->depth & (png->depth - 1))) return false;
+            break;
+        case PNG_RGB:
+            png->channels = 3;
+            break;
+        case PNG_GRAY_ALPHA:
+            png->channels = 2;
+            png->alpha    = true;
+            break;
+        case PNG_RGBA:
+            png->channels = 4;
+            png->alpha    = true;
+            break;
+        default:
+            return false;
+    }
+    if(png->channels > 1 && png->depth != 8 && png->depth != 16) return false;
+
+    png->row_bytes  = (png->width * png->channels * png->depth + 7) / 8;
+    png->filter_bpp = (png->channels * png->depth + 7) / 8;
+    png->px_size    = png->alpha ? LV_IMG_PX_SIZE_ALPHA_BYTE : LV_COLOR_SIZE / 8;
+    return true;
+}
+
+// Read the next piece of the IDAT stream, which can be split over several chunks
+static void png_read_input(hasp_png_t* png)
+{
+    png->in_len = 0;
+    png->in_ofs = 0;
+
+    while(png->chunk_left == 0 && !png->input_done) {
+        uint8_t buf[12]; // crc of the current chunk and the header of the next one
+        if(!png_read(&png->file, buf, sizeof(buf)) || png_be32(buf + 8) != PNG_CHUNK('I', 'D', 'A', 'T')) {
+            png->input_done = true;
+            return;
+        }
+        png->chunk_left = png_be32(buf + 4);
+    }
+    if(png->input_done) return;
+
+    uint32_t len = png->chunk_left < sizeof(png->in) ? png->chunk_left : sizeof(png->in);
+    if(!png_read(&png->file, png->in, len)) {
+        png->input_done = true;
+        return;
+    }
+    png->chunk_left -= len;
+    png->in_len = len;
+}
+
+// (Re)start inflating at the first row
+static bool png_rewind(hasp_png_t* png)
+{
+    if(lv_fs_seek(&png->file, png->idat_pos) != LV_FS_RES_OK) return false;
+    png->chunk_left = png->idat_len;
+    png->input_done = false;
+    png->in_len     = 0;
+    png->in_ofs     = 0;
+    png->next_row   = 0;
+    memset(png->prev, 0, png->row_bytes);
+
+#if defined(ARDUINO_ARCH_ESP32)
+    tinfl_init(png->inflator);
+    png->dict_next  = 0;
+    png->dict_avail = 0;
+    png->status     = TINFL_STATUS_NEEDS_MORE_INPUT;
+    return true;
+#else
+    if(png->zs_init) inflateEnd(&png->zs);
+    memset(&png->zs, 0, sizeof(png->zs));
+    png->zs_init = inflateInit(&png->zs) == Z_OK;
+    return png->zs_init;
+#endif
+}
+
+// Inflate exactly len bytes of the zlib stream
+static bool png_inflate(hasp_png_t* png, uint8_t* out, size_t len)
+{
+#if defined(ARDUINO_ARCH_ESP32)
+    while(len > 0) {
+        if(png->dict_avail > 0) { // copy pending output from the dictionary first
+            size_t start = (png->dict_next - png->dict_avail) & (TINFL_LZ_DICT_SIZE - 1);
+            size_t n     = len < png->dict_avail ? len : png->dict_avail;
+            memcpy(out, png->dict + start, n);
+            png->dict_avail -= n;
+            out += n;
+            len -= n;
+            continue;
+        }
+        if(png->status == TINFL_STATUS_DONE) return false; // stream ended before the last row
+
+        if(png->in_ofs == png->in_len) png_read_input(png);
+        size_t in_size  = png->in_len - png->in_ofs;
+        size_t out_size = TINFL_LZ_DICT_SIZE - png->dict_next;
+        png->status     = tinfl_decompress(png->inflator, png->in + png->in_ofs, &in_size, png->dict,
+                                           png->dict + png->dict_next, &out_size,
+                                           TINFL_FLAG_PARSE_ZLIB_HEADER | (png->input_done ? 0 : TINFL_FLAG_HAS_MORE_INPUT));
+        png->in_ofs += in_size;
+        png->dict_avail = out_size;
+        png->dict_next  = (png->dict_next + out_size) & (TINFL_LZ_DICT_SIZE - 1);
+
+        if(png->status < TINFL_STATUS_DONE) return false;
+        if(out_size == 0 && in_size == 0 && png->input_done) return false;
+    }
+    return true;
+#else
+    while(len > 0) {
+        if(png->zs.avail_in == 0) {
+            png_read_input(png);
+            if(png->in_len == 0) return false;
+            png->zs.next_in  = png->in;
+            png->zs.avail_in = png->in_len;
+        }
+        png->zs.next_out  = out;
+        png->zs.avail_out = len;
+        int res           = inflate(&png->zs, Z_NO_FLUSH);
+        out += len - png->zs.avail_out;
+        len = png->zs.avail_out;
+
+        if(res == Z_STREAM_END) return len == 0;
+        if(res != Z_OK && res != Z_BUF_ERROR) return false;
+    }
+    return true;
+#endif
+}
+
+static inline uint8_t png_paeth(uint8_t a, uint8_t b, uint8_t c)
+{
+    int16_t p  = a + b - c;
+    int16_t pa = abs(p - a);
+    int16_t pb = abs(p - b);
+    int16_t pc = abs(p - c);
+    return (pa <= pb && pa <= pc) ? a : pb <= pc ? b : c;
+}
+
+// Undo the row filter in place, using the previous unfiltered row
+static bool png_unfilter(hasp_png_t* png)
+{
+    uint8_t* row        = png->cur + 1;
+    const uint8_t* prev = png->prev;
+    uint8_t bpp         = png->filter_bpp;
+
+    switch(png->cur[0]) {
+        case 0: // None
+            break;
+        case 1: // Sub
+            for(uint32_t i = bpp; i < png->row_bytes; i++) row[i] += row[i - bpp];
+            break;
+        case 2: // Up
+            for(uint32_t i = 0; i < png->row_bytes; i++) row[i] += prev[i];
+            break;
+        case 3: // Average
+            for(uint32_t i = 0; i < png->row_bytes; i++)
+                row[i] += ((i < bpp ? 0 : row[i - bpp]) + prev[i]) >> 1;
+            break;
+        case 4: // Paeth
+            for(uint32_t i = 0; i < png->row_bytes; i++)
+                row[i] += i < bpp ? prev[i] : png_paeth(row[i - bpp], prev[i], prev[i - bpp]);
+            break;
+        default:
+            return false;
+    }
+    return true;
+}
+
+static inline uint16_t png_sample(const hasp_png_t* png, const uint8_t* row, uint32_t index)
+{
+    switch(png->depth) {
+        case 8:
+            return row[index];
+        case 16:
+            return (row[index * 2] << 8) | row[index * 2 + 1];
+        default: {
+            uint32_t bit = index * png->depth;
+            return (row[bit >> 3] >> (8 - png->depth - (bit & 7))) & ((1 << png->depth) - 1);
+        }
+    }
+}
+
+static inline uint8_t png_to_8bit(const hasp_png_t* png, uint16_t value)
+{
+    if(png->depth == 16) return value >> 8;
+    if(png->depth == 8) return value;
+    return value * 0xFF / ((1 << png->depth) - 1);
+}
+
+// Convert an unfiltered row to the lvgl color format
+static void png_convert_row(const hasp_png_t* png, const uint8_t* row, uint8_t* out)
+{
+    for(uint32_t x = 0; x < png->width; x++) {
+        uint8_t r, g, b, a = 0xFF;
+
+        switch(png->color) {
+            case PNG_GRAY: {
+                uint16_t v = png_sample(png, row, x);
+                r = g = b = png_to_8bit(png, v);
+                if(png->trns && v == png->trns_key[0]) a = 0;
+                break;
+            }
+            case PNG_RGB: {
+                uint16_t v[3] = {png_sample(png, row, x * 3), png_sample(png, row, x * 3 + 1),
+                                 png_sample(png, row, x * 3 + 2)};
+                r             = png_to_8bit(png, v[0]);
+                g             = png_to_8bit(png, v[1]);
+                b             = png_to_8bit(png, v[2]);
+                if(png->trns && !memcmp(v, png->trns_key, sizeof(v))) a = 0;
+                break;
+            }
+            case PNG_PALETTE: {
+                uint16_t i = png_sample(png, row, x);
+                if(i < png->pal_count) {
+                    r = png->palette[i * 4];
+                    g = png->palette[i * 4 + 1];
+                    b = png->palette[i * 4 + 2];
+                    a = png->palette[i * 4 + 3];
+                } else {
+                    r = g = b = 0;
+                }
+                break;
+            }
+            case PNG_GRAY_ALPHA:
+                r = g = b = png_to_8bit(png, png_sample(png, row, x * 2));
+                a         = png_to_8bit(png, png_sample(png, row, x * 2 + 1));
+                break;
+            default: // PNG_RGBA
+                r = png_to_8bit(png, png_sample(png, row, x * 4));
+                g = png_to_8bit(png, png_sample(png, row, x * 4 + 1));
+                b = png_to_8bit(png, png_sample(png, row, x * 4 + 2));
+                a = png_to_8bit(png, png_sample(png, row, x * 4 + 3));
+                break;
+        }
+
+        lv_color_t c = lv_color_make(r, g, b);
+        memcpy(out, &c, LV_COLOR_SIZE / 8);
+        if(png->alpha) out[png->px_size - 1] = a;
+        out += png->px_size;
+    }
+}
+
+// Inflate the next row into the strip
+static bool png_decode_row(hasp_png_t* png)
+{
+    if(!png_inflate(png, png->cur, png->row_bytes + 1) || !png_unfilter(png)) return false;
+
+    uint8_t* out = png->strip + (png->next_row % HASP_PNG_STRIP_ROWS) * png->width * png->px_size;
+    png_convert_row(png, png->cur + 1, out);
+
+    memcpy(png->prev, png->cur + 1, png->row_bytes);
+    png->next_row++;
+    png_stats.rows++;
+    return true;
+}
+
+static void* png_alloc(hasp_png_t* png, size_t size)
+{
+    void* ptr = hasp_malloc(size);
+    if(ptr) png->bytes += size;
+    return ptr;
+}
+
+static void png_free(hasp_png_t* png)
+{
+    if(!png) return;
+
+    if(png->file.file_d) lv_fs_close(&png->file);
+#if defined(ARDUINO_ARCH_ESP32)
+    hasp_free(png->inflator);
+    hasp_free(png->dict);
+#else
+    if(png->zs_init) inflateEnd(&png->zs);
+#endif
+    hasp_free(png->palette);
+    hasp_free(png->prev);
+    hasp_free(png->cur);
+    hasp_free(png->strip);
+    hasp_free(png);
+}
+
+static bool png_is_file(const void* src)
+{
+    return lv_img_src_get_type(src) == LV_IMG_SRC_FILE && !strcmp(lv_fs_get_ext((const char*)src), "png");
+}
+
+// Only stream images that are too large to decode whole
+static bool png_use_stream(const hasp_png_t* png)
+{
+    if(png->interlace != 0) return false; // Adam7 needs the whole image
+#if HASP_USE_PNGDECODE > 0
+    return (uint32_t)png->width * png->height * png->px_size >= HASP_PNG_STREAM_MIN;
+#else
+    return true;
+#endif
+}
+
+static lv_res_t png_stream_info(lv_img_decoder_t*, const void* src, lv_img_header_t* header)
+{
+    if(!png_is_file(src)) return LV_RES_INV;
+
+    hasp_png_t* png = (hasp_png_t*)hasp_calloc(1, sizeof(hasp_png_t));
+    if(!png) return LV_RES_INV;
+
+    lv_res_t res = LV_RES_INV;
+    if(lv_fs_open(&png->file, (const char*)src, LV_FS_MODE_RD) == LV_FS_RES_OK && png_parse(png) &&
+       png_use_stream(png)) {
+        header->always_zero = 0;
+        header->w           = png->width;
+        header->h           = png->height;
+        header->cf          = png->alpha ? LV_IMG_CF_TRUE_COLOR_ALPHA : LV_IMG_CF_TRUE_COLOR;
+        res                 = LV_RES_OK;
+    }
+
+    png_free(png);
+    return res;
+}
+
+static lv_res_t png_stream_open(lv_img_decoder_t*, lv_img_decoder_dsc_t* dsc)
+{
+    if(!png_is_file(dsc->src)) return LV_RES_INV;
+
+    hasp_png_t* png = (hasp_png_t*)hasp_calloc(1, sizeof(hasp_png_t));
+    if(!png) return LV_RES_INV;
+    png->bytes   = sizeof(hasp_png_t);
+    png->palette = (uint8_t*)png_alloc(png, 256 * 4);
+
+    if(!png->palette || lv_fs_open(&png->file, (const char*)dsc->src, LV_FS_MODE_RD) != LV_FS_RES_OK ||
+       !png_parse(png) || !png_use_stream(png)) {
+        png_free(png);
+        return LV_RES_INV;
+    }
+
+    png->prev  = (uint8_t*)png_alloc(png, png->row_bytes);
+    png->cur   = (uint8_t*)png_alloc(png, png->row_bytes + 1);
+    png->strip = (uint8_t*)png_alloc(png, HASP_PNG_STRIP_ROWS * png->width * png->px_size);
+#if defined(ARDUINO_ARCH_ESP32)
+    png->inflator = (tinfl_decompressor*)png_alloc(png, sizeof(tinfl_decompressor));
+    png->dict     = (uint8_t*)png_alloc(png, TINFL_LZ_DICT_SIZE);
+    if(!png->inflator || !png->dict) {
+        png_free(png);
+        return LV_RES_INV;
+    }
+#endif
+    if(!png->prev || !png->cur || !png->strip || !png_rewind(png)) {
+        LOG_WARNING(TAG_LVGL, F("PNG stream: out of memory for %s"), (const char*)dsc->src);
+        png_free(png);
+        return LV_RES_INV;
+    }
+
+    dsc->img_data  = NULL; // use read_line
+    dsc->user_data = png;
+
+    png_stats.opened++;
+    if(png->bytes > png_stats.peak) png_stats.peak = png->bytes;
+    return LV_RES_OK;
+}
+
+static lv_res_t png_stream_read_line(lv_img_decoder_t*, lv_img_decoder_dsc_t* dsc, lv_coord_t x, lv_coord_t y,
+                                     lv_coord_t len, uint8_t* buf)
+{
+    hasp_png_t* png = (hasp_png_t*)dsc->user_data;
+    if(!png || x < 0 || y < 0 || len <= 0 || (uint32_t)y >= png->height || (uint32_t)(x + len) > png->width)
+        return LV_RES_INV;
+
+    uint32_t start = millis();
+    if((uint32_t)y + HASP_PNG_STRIP_ROWS < png->next_row) { // row is no longer in the strip
+        if(!png_rewind(png)) return LV_RES_INV;
+        png_stats.restarts++;
+    } else if((uint32_t)y < png->next_row) {
+        png_stats.hits++;
+    }
+
+    while(png->next_row <= (uint32_t)y) {
+        if(!png_decode_row(png)) {
+            png_stats.errors++;
+            png_rewind(png);
+            return LV_RES_INV;
+        }
+    }
+
+    const uint8_t* row = png->strip + (y % HASP_PNG_STRIP_ROWS) * png->width * png->px_size;
+    memcpy(buf, row + x * png->px_size, len * png->px_size);
+    png_stats.time += millis() - start;
+    return LV_RES_OK;
+}
+
+static void png_stream_close(lv_img_decoder_t*, lv_img_decoder_dsc_t* dsc)
+{
+    hasp_png_t* png = (hasp_png_t*)dsc->user_data;
+    if(!png) return;
+
+    LOG_VERBOSE(TAG_LVGL, F("PNG stream: closed %s %ux%u, %u bytes"), (const char*)dsc->src, png->width, png->height,
+                png->bytes);
+    png_free(png);
+    dsc->user_data = NULL;
+}
+
+/**
+ * Register the streaming decoder, call after lv_png_init() so it is tried first
+ */
+void hasp_png_stream_init()
+{
+    lv_img_decoder_t* decoder = lv_img_decoder_create();
+    if(!decoder) return;
+
+    lv_img_decoder_set_info_cb(decoder, png_stream_info);
+    lv_img_decoder_set_open_cb(decoder, png_stream_open);
+    lv_img_decoder_set_read_line_cb(decoder, png_stream_read_line);
+    lv_img_decoder_set_close_cb(decoder, png_stream_close);
+}
+
+void hasp_png_stream_get_info(JsonDocument& doc)
+{
+    JsonObject info     = doc.createNestedObject(F("PNG Stream"));
+    info[F("opened")]   = png_stats.opened;
+    info[F("rows")]     = png_stats.rows;
+    info[F("hits")]     = png_stats.hits;
+    info[F("restarts")] = png_stats.restarts;
+    info[F("errors")]   = png_stats.errors;
+    info[F("time")]     = png_stats.time;
+    info[F("peak")]     = png_stats.peak;
+}
+
+#endif
@@ -0,0 +1,35 @@
+/* MIT License - Copyright (c) 2019-2024 Francis Van Roie
+   For full license information read the LICENSE file in the project folder */
+
+#ifndef HASP_PNG_STREAM_H
+#define HASP_PNG_STREAM_H
+
+#include "hasplib.h"
+
+#ifndef HASP_PNG_STREAM_MIN
+#define HASP_PNG_STREAM_MIN 32768 // smaller images are decoded whole by lv_png, if enabled
+#endif
+
+#ifndef HASP_PNG_STRIP_ROWS
+#define HASP_PNG_STRIP_ROWS 16 // decoded rows kept to redraw without inflating again, minimum 1
+#endif
+
+#ifndef HASP_PNG_READ_SIZE
+#define HASP_PNG_READ_SIZE 512 // compressed bytes read from the file at once
+#endif
+
+typedef struct
+{
+    uint32_t opened;   // images opened for streaming
+    uint32_t rows;     // rows inflated and unfiltered
+    uint32_t hits;     // lines served from the strip without inflating
+    uint32_t restarts; // times a stream was inflated again from the first row
+    uint32_t errors;   // corrupt or truncated streams
+    uint32_t time;     // ms spent decoding lines
+    uint32_t peak;     // largest memory use of one open image
+} hasp_png_stream_stats_t;
+
+void hasp_png_stream_init();
+void hasp_png_stream_get_info(JsonDocument& doc);
+
+#endif
@@ -0,0 +1,255 @@
+/* MIT License - Copyright (c) 2019-2024 Francis Van Roie
+   For full license information read the LICENSE file in the project folder */
+
+#include <stddef.h>
+#include "hasplib.h"
+#include "hasp_pool.h"
+#include "dev/device.h"
+
+/* ===== Fixed size object pool =====
+ * Items are allocated from slabs of items_per_slab objects. A slab is released when its last item is freed,
+ * so thousands of small objects only cost a handful of heap blocks. */
+
+void hasp_pool_init(hasp_pool_t* pool, size_t item_size, uint16_t items_per_slab)
+{
+    memset(pool, 0, sizeof(hasp_pool_t));
+    // every item must be able to hold the free list pointer and keep pointer alignment
+    item_size            = (item_size + sizeof(void*) - 1) & ~(sizeof(void*) - 1);
+    pool->item_size      = item_size < sizeof(void*) ? sizeof(void*) : item_size;
+    pool->items_per_slab = items_per_slab > 0 ? items_per_slab : 1;
+}
+
+static inline uint8_t* hasp_pool_slab_items(hasp_pool_slab_t* slab)
+{
+    return (uint8_t*)(slab + 1);
+}
+
+static hasp_pool_slab_t* hasp_pool_add_slab(hasp_pool_t* pool)
+{
+    size_t items_size      = (size_t)pool->item_size * pool->items_per_slab;
+    hasp_pool_slab_t* slab = (hasp_pool_slab_t*)hasp_malloc(sizeof(hasp_pool_slab_t) + items_size);
+    if(!slab) return NULL;
+
+    // thread the free list through the items
+    uint8_t* items  = hasp_pool_slab_items(slab);
+    slab->free_list = NULL;
+    for(int16_t i = pool->items_per_slab - 1; i >= 0; i--) {
+        void** item     = (void**)(items + (size_t)i * pool->item_size);
+        *item           = slab->free_list;
+        slab->free_list = item;
+    }
+    slab->used  = 0;
+    slab->next  = pool->slabs;
+    pool->slabs = slab;
+    pool->slab_count++;
+
+    return slab;
+}
+
+void* hasp_pool_alloc(hasp_pool_t* pool)
+{
+    hasp_pool_slab_t* slab = pool->slabs;
+    while(slab && !slab->free_list) slab = slab->next;
+    if(!slab) slab = hasp_pool_add_slab(pool);
+    if(!slab) return NULL;
+
+    void** item     = (void**)slab->free_list;
+    slab->free_list = *item;
+    slab->used++;
+
+    pool->used++;
+    if(pool->used > pool->peak) pool->peak = pool->used;
+
+    memset(item, 0, pool->item_size);
+    return item;
+}
+
+void hasp_pool_free(hasp_pool_t* pool, void* item)
+{
+    if(!item) return;
+
+    size_t items_size       = (size_t)pool->item_size * pool->items_per_slab;
+    hasp_pool_slab_t** link = &pool->slabs;
+
+    while(hasp_pool_slab_t* slab = *link) {
+        uint8_t* items = hasp_pool_slab_items(slab);
+        if((uint8_t*)item >= items && (uint8_t*)item < items + items_size) {
+            *(void**)item   = slab->free_list;
+            slab->free_list = item;
+            slab->used--;
+            pool->used--;
+
+            if(slab->used == 0) { // release empty slab
+                *link = slab->next;
+                hasp_free(slab);
+                pool->slab_count--;
+            }
+            return;
+        }
+        link = &slab->next;
+    }
+
+    LOG_ERROR(TAG_ATTR, F("Item %x does not belong to the pool"), item);
+}
+
+/* ===== Extended user_data objects ===== */
+
+static hasp_pool_t ext_pool = {NULL, 0, 0, 0, 0, 0};
+
+hasp_ext_user_data_t* hasp_ext_alloc(void)
+{
+    if(ext_pool.item_size == 0) hasp_pool_init(&ext_pool, sizeof(hasp_ext_user_data_t), HASP_POOL_SLAB_ITEMS);
+    return (hasp_ext_user_data_t*)hasp_pool_alloc(&ext_pool);
+}
+
+void hasp_ext_free(hasp_ext_user_data_t* ext)
+{
+    hasp_pool_free(&ext_pool, ext);
+}
+
+/* ===== Interned strings =====
+ * Identical strings are stored once and reference counted. They are packed into chunks of HASP_STR_CHUNK_SIZE
+ * bytes, a chunk is released when none of its strings is in use anymore. */
+
+typedef struct hasp_str_chunk_t
+{
+    struct hasp_str_chunk_t* next;
+    uint32_t size; // capacity of the chunk data
+    uint32_t used; // bytes handed out
+    uint32_t live; // strings still referenced
+} hasp_str_chunk_t;
+
+typedef struct hasp_str_entry_t
+{
+    struct hasp_str_entry_t* next; // hash bucket chain
+    hasp_str_chunk_t* chunk;
+    uint32_t hash;
+    uint16_t refcnt;
+    char str[1];
+} hasp_str_entry_t;
+
+static hasp_str_entry_t* str_buckets[HASP_STR_BUCKETS];
+static hasp_str_chunk_t* str_chunks = NULL;
+
+static struct
+{
+    uint32_t strings; // unique strings in use
+    uint32_t bytes;   // bytes used by unique strings
+    uint32_t shared;  // intern calls that returned an existing string
+} str_stats;
+
+static uint32_t hasp_str_hash(const char* str)
+{
+    uint32_t hash = 2166136261u; // FNV-1a
+    while(*str) hash = (hash ^ (uint8_t)*str++) * 16777619u;
+    return hash;
+}
+
+static hasp_str_entry_t* hasp_str_alloc_entry(size_t len)
+{
+    size_t size = offsetof(hasp_str_entry_t, str) + len + 1;
+    size        = (size + sizeof(void*) - 1) & ~(sizeof(void*) - 1);
+
+    hasp_str_chunk_t* chunk = str_chunks; // only the newest chunk has free space
+    if(!chunk || chunk->size - chunk->used < size) {
+        size_t chunk_size = size > HASP_STR_CHUNK_SIZE ? size : HASP_STR_CHUNK_SIZE;
+        chunk             = (hasp_str_chunk_t*)hasp_malloc(sizeof(hasp_str_chunk_t) + chunk_size);
+        if(!chunk) return NULL;
+
+        chunk->size = chunk_size;
+        chunk->used = 0;
+        chunk->live = 0;
+        if(size > HASP_STR_CHUNK_SIZE && str_chunks) { // keep the current chunk open for small strings
+            chunk->next      = str_chunks->next;
+            str_chunks->next = chunk;
+        } else {
+            chunk->next = str_chunks;
+            str_chunks  = chunk;
+        }
+    }
+
+    hasp_str_entry_t* entry = (hasp_str_entry_t*)((uint8_t*)(chunk + 1) + chunk->used);
+    entry->chunk            = chunk;
+    chunk->used += size;
+    chunk->live++;
+    return entry;
+}
+
+const char* hasp_str_intern(const char* str)
+{
+    if(!str) return NULL;
+
+    uint32_t hash            = hasp_str_hash(str);
+    hasp_str_entry_t** chain = &str_buckets[hash & (HASP_STR_BUCKETS - 1)];
+
+    for(hasp_str_entry_t* entry = *chain; entry; entry = entry->next) {
+        if(entry->hash == hash && entry->refcnt < UINT16_MAX && !strcmp(entry->str, str)) {
+            entry->refcnt++;
+            str_stats.shared++;
+            return entry->str;
+        }
+    }
+
+    size_t len              = strlen(str);
+    hasp_str_entry_t* entry = hasp_str_alloc_entry(len);
+    if(!entry) return NULL;
+
+    memcpy(entry->str, str, len + 1);
+    entry->hash   = hash;
+    entry->refcnt = 1;
+    entry->next   = *chain;
+    *chain        = entry;
+
+    str_stats.strings++;
+    str_stats.bytes += len + 1;
+    return entry->str;
+}
+
+void hasp_str_release(const char* str)
+{
+    if(!str) return;
+
+    hasp_str_entry_t* entry = (hasp_str_entry_t*)(str - offsetof(hasp_str_entry_t, str));
+    if(--entry->refcnt > 0) return;
+
+    hasp_str_entry_t** link = &str_buckets[entry->hash & (HASP_STR_BUCKETS - 1)];
+    while(*link && *link != entry) link = &(*link)->next;
+    if(*link) *link = entry->next;
+
+    str_stats.strings--;
+    str_stats.bytes -= strlen(entry->str) + 1;
+
+    hasp_str_chunk_t* chunk = entry->chunk;
+    if(--chunk->live > 0) return;
+
+    if(chunk == str_chunks) { // reuse the open chunk from the start
+        chunk->used = 0;
+        return;
+    }
+
+    hasp_str_chunk_t** chunk_link = &str_chunks;
+    while(*chunk_link && *chunk_link != chunk) chunk_link = &(*chunk_link)->next;
+    if(*chunk_link) *chunk_link = chunk->next;
+    hasp_free(chunk);
+}
+
+void hasp_pool_get_info(JsonDocument& doc)
+{
+    uint16_t chunks = 0;
+    uint32_t size   = 0;
+    for(hasp_str_chunk_t* chunk = str_chunks; chunk; chunk = chunk->next) {
+        chunks++;
+        size += chunk->size;
+    }
+
+    JsonObject info              = doc.createNestedObject(F("Memory Pools"));
+    info[F("extObjects")]        = ext_pool.used;
+    info[F("extPeak")]           = ext_pool.peak;
+    info[F("extSlabs")]          = ext_pool.slab_count;
+    info[F("strings")]           = str_stats.strings;
+    info[F("stringBytes")]       = str_stats.bytes;
+    info[F("stringShared")]      = str_stats.shared;
+    info[F("arenaChunks")]       = chunks;
+    info[F("arenaSize")]         = size;
+    info[F("heapFragmentation")] = haspDevice.get_heap_fragmentation();
+}
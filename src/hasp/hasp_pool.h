@@ -0,0 +1,53 @@
+/* MIT License - Copyright (c) 2019-2024 Francis Van Roie
+   For full license information read the LICENSE file in the project folder */
+
+#ifndef HASP_POOL_H
+#define HASP_POOL_H
+
+#include "hasplib.h"
+
+#ifndef HASP_POOL_SLAB_ITEMS
+#define HASP_POOL_SLAB_ITEMS 32 // objects per slab of the extended user_data pool
+#endif
+
+#ifndef HASP_STR_CHUNK_SIZE
+#define HASP_STR_CHUNK_SIZE 1024 // bytes per chunk of the string arena
+#endif
+
+#ifndef HASP_STR_BUCKETS
+#define HASP_STR_BUCKETS 64 // hash buckets of the string arena, must be a power of 2
+#endif
+
+/* ===== Fixed size object pool ===== */
+typedef struct hasp_pool_slab_t
+{
+    struct hasp_pool_slab_t* next;
+    void* free_list; // free items in this slab
+    uint16_t used;   // allocated items in this slab
+} hasp_pool_slab_t;
+
+typedef struct
+{
+    hasp_pool_slab_t* slabs;
+    uint16_t item_size;
+    uint16_t items_per_slab;
+    uint16_t slab_count;
+    uint32_t used;
+    uint32_t peak;
+} hasp_pool_t;
+
+void hasp_pool_init(hasp_pool_t* pool, size_t item_size, uint16_t items_per_slab);
+void* hasp_pool_alloc(hasp_pool_t* pool);
+void hasp_pool_free(hasp_pool_t* pool, void* item);
+
+/* ===== Extended user_data objects ===== */
+hasp_ext_user_data_t* hasp_ext_alloc(void);
+void hasp_ext_free(hasp_ext_user_data_t* ext);
+
+/* ===== Interned strings ===== */
+const char* hasp_str_intern(const char* str);
+void hasp_str_release(const char* str);
+
+void hasp_pool_get_info(JsonDocument& doc);
+
+#endif
@@ -0,0 +1,271 @@
+/* MIT License - Copyright (c) 2019-2024 Francis Van Roie
+   For full license information read the LICENSE file in the project folder */
+
+/* Local rules run commands on object events without a round trip through the home automation server.
+ * Each line of the rules file is a json object with optional conditions and the commands to run:
+ *   {"page":1,"id":2,"event":"up","do":"page 2"}
+ *   {"page":1,"id":3,"event":"up","val":1,"do":["p1b4.hidden=0","output1=on"]}
+ *   {"page":2,"id":5,"event":"changed","min":50,"max":100,"do":"p2b6.text=High"}
+ * The conditions and commands are compiled when the file is loaded. */
+
+#include "hasplib.h"
+
+#include <fstream>
+
+#if defined(ARDUINO)
+#if HASP_USE_SPIFFS > 0 || HASP_USE_LITTLEFS > 0
+#include "hasp_filesystem.h"
+#endif
+#endif // ARDUINO
+
+static hasp_rule_t* rules  = NULL; // compiled rules, in file order
+static uint16_t rule_count = 0;
+static bool rules_busy     = false; // rules are being executed
+
+static struct
+{
+    uint32_t events;    // events checked against the rules
+    uint32_t matches;   // rules executed
+    uint32_t time;      // ms spent executing rules
+    uint32_t load_time; // ms spent loading and compiling the rules file
+} rules_stats;
+
+static bool rules_get_event_id(const char* name, uint8_t& eventid)
+{
+    static const uint8_t ids[] = {HASP_EVENT_ON,      HASP_EVENT_OFF,  HASP_EVENT_UP,   HASP_EVENT_DOWN,
+                                  HASP_EVENT_RELEASE, HASP_EVENT_LONG, HASP_EVENT_HOLD, HASP_EVENT_LOST,
+                                  HASP_EVENT_CHANGED};
+    char buffer[8];
+
+    for(uint8_t id : ids) {
+        Parser::get_event_name(id, buffer, sizeof(buffer));
+        if(!strcasecmp(name, buffer)) {
+            eventid = id;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Read the conditions and compile the commands of one rule
+static bool rules_compile(hasp_rule_t* rule, JsonObject json, uint16_t line)
+{
+    memset(rule, 0, sizeof(hasp_rule_t)); // the slot may hold the conditions of a rule that failed to compile
+
+    if(json.isNull() || json["do"].isNull()) {
+        LOG_WARNING(TAG_HASP, F("Rule %u has no commands"), line);
+        return false;
+    }
+
+    rule->page  = json["page"].isNull() ? HASP_RULE_ANY : json["page"].as<uint8_t>();
+    rule->id    = json["id"].isNull() ? HASP_RULE_ANY : json["id"].as<uint8_t>();
+    rule->event = HASP_RULE_ANY;
+    rule->min   = INT32_MIN;
+    rule->max   = INT32_MAX;
+
+    if(const char* event = json["event"]) {
+        if(!rules_get_event_id(event, rule->event)) {
+            LOG_WARNING(TAG_HASP, F("Rule %u has an unknown event %s"), line, event);
+            return false;
+        }
+    }
+
+    if(!json["val"].isNull()) {
+        rule->min = rule->max = json["val"].as<int32_t>();
+        rule->has_value       = true;
+    }
+    if(!json["min"].isNull()) {
+        rule->min       = json["min"].as<int32_t>();
+        rule->has_value = true;
+    }
+    if(!json["max"].isNull()) {
+        rule->max       = json["max"].as<int32_t>();
+        rule->has_value = true;
+    }
+
+    // Only the commands are left, they are compiled as the "do" event of a script
+    static const char* conditions[] = {"page", "id", "event", "val", "min", "max"};
+    for(const char* key : conditions) json.remove(key);
+
+    rule->script = dispatch_script_compile(json);
+    if(!rule->script) {
+        LOG_WARNING(TAG_HASP, F("Rule %u could not be compiled"), line);
+        return false;
+    }
+
+    return true;
+}
+
+template <typename T> static void rules_parse(T& stream)
+{
+    DynamicJsonDocument doc(1024);
+    DeserializationError jsonError;
+    uint16_t line = 1;
+
+    rules = (hasp_rule_t*)hasp_calloc(HASP_RULES_MAX, sizeof(hasp_rule_t));
+    if(!rules) {
+        LOG_ERROR(TAG_HASP, D_ERROR_OUT_OF_MEMORY);
+        return;
+    }
+
+    while((jsonError = deserializeJson(doc, stream)) == DeserializationError::Ok) {
+        if(rule_count >= HASP_RULES_MAX) {
+            LOG_WARNING(TAG_HASP, F("Too many rules, only %d are loaded"), HASP_RULES_MAX);
+            break;
+        }
+        if(rules_compile(&rules[rule_count], doc.as<JsonObject>(), line)) rule_count++;
+        line++;
+    }
+
+    if(jsonError != DeserializationError::Ok && jsonError != DeserializationError::EmptyInput) {
+        LOG_ERROR(TAG_HASP, F("Rule %u: %s"), line, jsonError.c_str());
+    }
+
+    if(rule_count == 0) {
+        hasp_free(rules);
+        rules = NULL;
+    } else if(hasp_rule_t* shrunk = (hasp_rule_t*)hasp_realloc(rules, rule_count * sizeof(hasp_rule_t))) {
+        rules = shrunk;
+    }
+}
+
+/**
+ * Replace the current rules with the rules from a file
+ * @param filename path of the rules file
+ */
+void hasp_rules_load(const char* filename)
+{
+    if(rules_busy) {
+        LOG_WARNING(TAG_HASP, F("Rules can't be reloaded by a rule"));
+        return;
+    }
+
+    hasp_rules_clear();
+    uint32_t start = millis();
+
+#if HASP_USE_SPIFFS > 0 || HASP_USE_LITTLEFS > 0
+    if(!HASP_FS.exists(filename)) {
+        LOG_VERBOSE(TAG_HASP, F(D_FILE_NOT_FOUND ": %s"), filename);
+        return;
+    }
+
+    File file = HASP_FS.open(filename, "r");
+    if(!file) {
+        LOG_ERROR(TAG_HASP, F(D_FILE_LOAD_FAILED), filename);
+        return;
+    }
+    file.setTimeout(25);
+    rules_parse(file);
+    file.close();
+
+#elif HASP_TARGET_PC
+    char path[strlen(filename) + 4];
+    path[0] = '.';
+    path[1] = '\0';
+    strcat(path, filename);
+#if defined(WINDOWS)
+    path[1] = '\\';
+#elif defined(POSIX)
+    path[1] = '/';
+#endif
+
+    std::ifstream f(path); // taking file as inputstream
+    if(!f) {
+        LOG_VERBOSE(TAG_HASP, F(D_FILE_NOT_FOUND ": %s"), path);
+        return;
+    }
+    rules_parse(f);
+    f.close();
+
+#else
+    return; // no filesystem
+#endif
+
+    rules_stats.load_time = millis() - start;
+    LOG_INFO(TAG_HASP, F("Loaded %u rules from %s in %u ms"), rule_count, filename, rules_stats.load_time);
+}
+
+void hasp_rules_clear()
+{
+    if(rules_busy) return;
+
+    for(uint16_t i = 0; i < rule_count; i++) dispatch_script_free(rules[i].script);
+    hasp_free(rules);
+    rules      = NULL;
+    rule_count = 0;
+}
+
+/**
+ * Run the commands of all rules that match an object event
+ * @param obj the object that sent the event
+ * @param eventid hasp event id
+ * @param has_value the event carries a value
+ * @param val the value of the object
+ */
+void hasp_rules_process(lv_obj_t* obj, uint8_t eventid, bool has_value, int32_t val)
+{
+    if(rule_count == 0 || rules_busy) return; // events caused by the rules themselves are not matched
+
+    uint8_t pageid;
+    uint8_t objid;
+    if(!hasp_find_id_from_obj(obj, &pageid, &objid)) return;
+
+    rules_stats.events++;
+    rules_busy = true;
+
+    for(uint16_t i = 0; i < rule_count; i++) {
+        hasp_rule_t* rule = &rules[i];
+        if(rule->page != HASP_RULE_ANY && rule->page != pageid) continue;
+        if(rule->id != HASP_RULE_ANY && rule->id != objid) continue;
+        if(rule->event != HASP_RULE_ANY && rule->event != eventid) continue;
+        if(rule->has_value && (!has_value || val < rule->min || val > rule->max)) continue;
+
+        uint32_t start = millis();
+        dispatch_script_run(rule->script, "do", TAG_EVENT);
+        uint32_t elapsed = millis() - start;
+
+        rule->hits++;
+        rule->time += elapsed;
+        if(elapsed > rule->max_time) rule->max_time = elapsed;
+        rules_stats.matches++;
+        rules_stats.time += elapsed;
+    }
+
+    rules_busy = false;
+}
+
+// rules reload | rules clear | rules
+void hasp_rules_command(const char*, const char* payload, uint8_t source)
+{
+    if(!strcasecmp_P(payload, PSTR("reload"))) {
+        hasp_rules_load(HASP_RULES_FILE);
+
+    } else if(!strcasecmp_P(payload, PSTR("clear"))) {
+        hasp_rules_clear();
+
+    } else {
+        for(uint16_t i = 0; i < rule_count; i++) {
+            LOG_VERBOSE(TAG_HASP, F("Rule %u: %u hits, %u ms, max %u ms"), i + 1, rules[i].hits, rules[i].time,
+                        rules[i].max_time);
+        }
+    }
+}
+
+void hasp_rules_get_info(JsonDocument& doc)
+{
+    JsonObject info     = doc.createNestedObject(F("Rules"));
+    info[F("rules")]    = rule_count;
+    info[F("events")]   = rules_stats.events;
+    info[F("matches")]  = rules_stats.matches;
+    info[F("time")]     = rules_stats.time;
+    info[F("loadTime")] = rules_stats.load_time;
+
+    uint32_t max_time = 0;
+    uint16_t busiest  = 0;
+    for(uint16_t i = 0; i < rule_count; i++) {
+        if(rules[i].max_time > max_time) max_time = rules[i].max_time;
+        if(rules[i].hits > rules[busiest].hits) busiest = i;
+    }
+    info[F("maxTime")] = max_time;
+    if(rule_count > 0) info[F("mostHits")] = busiest + 1;
+}
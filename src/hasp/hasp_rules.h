@@ -0,0 +1,39 @@
+/* MIT License - Copyright (c) 2019-2024 Francis Van Roie
+   For full license information read the LICENSE file in the project folder */
+
+#ifndef HASP_RULES_H
+#define HASP_RULES_H
+
+#include "hasplib.h"
+
+#ifndef HASP_RULES_FILE
+#define HASP_RULES_FILE "/rules.jsonl"
+#endif
+
+#ifndef HASP_RULES_MAX
+#define HASP_RULES_MAX 64 // maximum number of rules loaded from the rules file
+#endif
+
+#define HASP_RULE_ANY 0xFF
+
+typedef struct
+{
+    struct dispatch_script_t* script; // compiled commands
+    int32_t min;                      // lowest value that matches
+    int32_t max;                      // highest value that matches
+    uint8_t page;                     // HASP_RULE_ANY matches all pages
+    uint8_t id;                       // HASP_RULE_ANY matches all objects
+    uint8_t event;                    // HASP_RULE_ANY matches all events
+    bool has_value;                   // only events that carry a value can match
+    uint32_t hits;                    // times the rule was executed
+    uint32_t time;                    // ms spent executing the rule
+    uint32_t max_time;                // ms spent in the longest execution
+} hasp_rule_t;
+
+void hasp_rules_load(const char* filename);
+void hasp_rules_clear();
+void hasp_rules_process(lv_obj_t* obj, uint8_t eventid, bool has_value, int32_t val);
+void hasp_rules_command(const char*, const char* payload, uint8_t source);
+void hasp_rules_get_info(JsonDocument& doc);
+
+#endif
@@ -0,0 +1,273 @@
+/* MIT License - Copyright (c) 2019-2024 Francis Van Roie
+   For full license information read the LICENSE file in the project folder */
+
+/* Shadow mask cache
+ * lvgl blurs the shadow of every rectangle again on each redraw. lv_draw_rect is wrapped at link time with
+ * -Wl,--wrap=lv_draw_rect so shadows are drawn from a cached opacity mask instead. A mask only depends on the size and
+ * radius of the shadow rectangle and the shadow width, so objects with the same style share one mask. Color, opacity,
+ * offset and position are applied when the mask is blended. The masks are kept in a pool of at most `budget` bytes,
+ * the least recently used mask is freed first. */
+
+#include <math.h>
+
+#include "hasplib.h"
+
+#if HASP_USE_SHADOW_CACHE > 0 && LV_USE_SHADOW
+
+#include "src/lv_draw/lv_draw_blend.h"
+#include "src/lv_draw/lv_draw_mask.h"
+
+#include "hasp_debug.h"
+#include "hasp_shadow.h"
+
+typedef struct hasp_shadow_t
+{
+    struct hasp_shadow_t* next;
+    lv_coord_t width;  // shadow rectangle, before blurring
+    lv_coord_t height;
+    lv_coord_t radius;
+    lv_coord_t blur; // shadow width
+    uint32_t used;   // lv_tick_get() of the last draw
+    uint32_t size;   // bytes of the mask
+    lv_opa_t mask[]; // (width + 2 * margin) x (height + 2 * margin)
+} hasp_shadow_t;
+
+static hasp_shadow_t* shadow_cache;
+static hasp_shadow_stats_t shadow_stats;
+
+extern "C" void __real_lv_draw_rect(const lv_area_t* coords, const lv_area_t* clip, const lv_draw_rect_dsc_t* dsc);
+
+// Same margin lvgl uses around the shadow rectangle
+static inline lv_coord_t shadow_margin(lv_coord_t blur)
+{
+    return blur / 2 + 1;
+}
+
+static void shadow_free(hasp_shadow_t* entry)
+{
+    shadow_stats.bytes -= entry->size;
+    shadow_stats.entries--;
+    hasp_free(entry);
+}
+
+// Free the least recently used mask
+static bool shadow_evict()
+{
+    hasp_shadow_t** victim = NULL;
+    for(hasp_shadow_t** e = &shadow_cache; *e; e = &(*e)->next) {
+        if(!victim || (*e)->used - (*victim)->used > UINT32_MAX / 2) victim = e; // older, also across a tick rollover
+    }
+    if(!victim) return false;
+
+    hasp_shadow_t* entry = *victim;
+    *victim              = entry->next;
+    shadow_free(entry);
+    shadow_stats.evictions++;
+    return true;
+}
+
+// Box blur one line of the mask in place
+static void shadow_blur_line(lv_opa_t* line, lv_coord_t len, lv_coord_t stride, lv_coord_t k, uint8_t* tmp)
+{
+    for(lv_coord_t i = 0; i < len; i++) tmp[i] = line[i * stride];
+
+    uint32_t window = 2 * k + 1;
+    uint32_t sum    = 0;
+    for(lv_coord_t i = 0; i < k && i < len; i++) sum += tmp[i];
+
+    for(lv_coord_t i = 0; i < len; i++) {
+        if(i + k < len) sum += tmp[i + k];
+        if(i - k - 1 >= 0) sum -= tmp[i - k - 1];
+        line[i * stride] = sum / window;
+    }
+}
+
+// Rounded rectangle with anti-aliased edges, blurred horizontally and vertically
+static void shadow_render(hasp_shadow_t* entry, uint8_t* tmp)
+{
+    lv_coord_t m = shadow_margin(entry->blur);
+    lv_coord_t w = entry->width + 2 * m;
+    lv_coord_t h = entry->height + 2 * m;
+    float r      = entry->radius;
+    float half_w = entry->width / 2.0f;
+    float half_h = entry->height / 2.0f;
+
+    for(lv_coord_t y = 0; y < h; y++) {
+        float qy = fabsf(y + 0.5f - m - half_h) - (half_h - r);
+        for(lv_coord_t x = 0; x < w; x++) {
+            float qx   = fabsf(x + 0.5f - m - half_w) - (half_w - r);
+            float ox   = qx > 0 ? qx : 0;
+            float oy   = qy > 0 ? qy : 0;
+            float dist = sqrtf(ox * ox + oy * oy) + (qx > qy ? (qx < 0 ? qx : 0) : (qy < 0 ? qy : 0)) - r;
+            float cov  = 0.5f - dist;
+            entry->mask[y * w + x] = cov >= 1.0f ? LV_OPA_COVER : cov <= 0.0f ? LV_OPA_TRANSP : (lv_opa_t)(cov * 255);
+        }
+    }
+
+    lv_coord_t k = entry->blur / 2;
+    if(k == 0) return;
+    for(lv_coord_t y = 0; y < h; y++) shadow_blur_line(entry->mask + y * w, w, 1, k, tmp);
+    for(lv_coord_t x = 0; x < w; x++) shadow_blur_line(entry->mask + x, h, w, k, tmp);
+}
+
+static hasp_shadow_t* shadow_get(lv_coord_t width, lv_coord_t height, lv_coord_t radius, lv_coord_t blur)
+{
+    for(hasp_shadow_t* entry = shadow_cache; entry; entry = entry->next) {
+        if(entry->width == width && entry->height == height && entry->radius == radius && entry->blur == blur) {
+            entry->used = lv_tick_get();
+            shadow_stats.hits++;
+            return entry;
+        }
+    }
+
+    lv_coord_t m  = shadow_margin(blur);
+    uint32_t size = (uint32_t)(width + 2 * m) * (height + 2 * m);
+    if(size > shadow_stats.budget) {
+        shadow_stats.bypassed++;
+        return NULL;
+    }
+    while(shadow_stats.bytes + size > shadow_stats.budget && shadow_evict()) {
+    }
+
+    hasp_shadow_t* entry = (hasp_shadow_t*)hasp_malloc(sizeof(hasp_shadow_t) + size);
+    uint8_t* tmp         = (uint8_t*)_lv_mem_buf_get(LV_MATH_MAX(width, height) + 2 * m);
+    if(!entry || !tmp) {
+        hasp_free(entry);
+        if(tmp) _lv_mem_buf_release(tmp);
+        shadow_stats.bypassed++;
+        return NULL;
+    }
+
+    entry->width  = width;
+    entry->height = height;
+    entry->radius = radius;
+    entry->blur   = blur;
+    entry->size   = size;
+    entry->used   = lv_tick_get();
+    shadow_render(entry, tmp);
+    _lv_mem_buf_release(tmp);
+
+    entry->next  = shadow_cache;
+    shadow_cache = entry;
+    shadow_stats.bytes += size;
+    shadow_stats.entries++;
+    shadow_stats.misses++;
+    return entry;
+}
+
+// Draw the shadow of a rectangle from the cache, returns false if lvgl has to draw it
+static bool shadow_draw(const lv_area_t* coords, const lv_area_t* clip, const lv_draw_rect_dsc_t* dsc)
+{
+    lv_area_t sh_rect;
+    sh_rect.x1 = coords->x1 + dsc->shadow_ofs_x - dsc->shadow_spread;
+    sh_rect.x2 = coords->x2 + dsc->shadow_ofs_x + dsc->shadow_spread;
+    sh_rect.y1 = coords->y1 + dsc->shadow_ofs_y - dsc->shadow_spread;
+    sh_rect.y2 = coords->y2 + dsc->shadow_ofs_y + dsc->shadow_spread;
+
+    lv_coord_t width  = lv_area_get_width(&sh_rect);
+    lv_coord_t height = lv_area_get_height(&sh_rect);
+    if(width <= 0 || height <= 0) return false;
+
+    lv_coord_t radius = LV_MATH_MIN(dsc->radius, LV_MATH_MIN(width, height) / 2);
+    lv_coord_t m      = shadow_margin(dsc->shadow_width);
+
+    lv_area_t sh_area;
+    sh_area.x1 = sh_rect.x1 - m;
+    sh_area.x2 = sh_rect.x2 + m;
+    sh_area.y1 = sh_rect.y1 - m;
+    sh_area.y2 = sh_rect.y2 + m;
+
+    lv_area_t draw_area;
+    if(!_lv_area_intersect(&draw_area, &sh_area, clip)) return true; // nothing to draw
+
+    hasp_shadow_t* entry = shadow_get(width, height, radius, dsc->shadow_width);
+    if(!entry) return false;
+
+    // The shadow is not drawn under the object itself
+    lv_coord_t obj_side   = LV_MATH_MIN(lv_area_get_width(coords), lv_area_get_height(coords));
+    lv_coord_t obj_radius = LV_MATH_MIN(dsc->radius, obj_side / 2);
+    lv_draw_mask_radius_param_t mask_obj;
+    lv_draw_mask_radius_init(&mask_obj, coords, obj_radius, true);
+    int16_t mask_obj_id = lv_draw_mask_add(&mask_obj, NULL);
+
+    lv_coord_t len      = lv_area_get_width(&draw_area);
+    lv_coord_t stride   = lv_area_get_width(&sh_area);
+    lv_opa_t* line      = (lv_opa_t*)_lv_mem_buf_get(len);
+    lv_opa_t opa        = dsc->shadow_opa > LV_OPA_MAX ? LV_OPA_COVER : dsc->shadow_opa;
+    const lv_opa_t* src = entry->mask + (draw_area.y1 - sh_area.y1) * stride + (draw_area.x1 - sh_area.x1);
+
+    for(lv_coord_t y = draw_area.y1; y <= draw_area.y2; y++, src += stride) {
+        memcpy(line, src, len);
+        lv_draw_mask_res_t res = lv_draw_mask_apply(line, draw_area.x1, y, len);
+        if(res == LV_DRAW_MASK_RES_TRANSP) continue;
+
+        lv_area_t fill = {draw_area.x1, y, draw_area.x2, y};
+        _lv_blend_fill(clip, &fill, dsc->shadow_color, line, LV_DRAW_MASK_RES_CHANGED, opa, dsc->shadow_blend_mode);
+    }
+
+    _lv_mem_buf_release(line);
+    lv_draw_mask_remove_id(mask_obj_id);
+    return true;
+}
+
+extern "C" void __wrap_lv_draw_rect(const lv_area_t* coords, const lv_area_t* clip, const lv_draw_rect_dsc_t* dsc)
+{
+    if(shadow_stats.budget == 0 || dsc->shadow_width == 0 || dsc->shadow_opa <= LV_OPA_MIN ||
+       !shadow_draw(coords, clip, dsc)) {
+        __real_lv_draw_rect(coords, clip, dsc);
+        return;
+    }
+
+    // Shadow is done, let lvgl draw the rest
+    lv_draw_rect_dsc_t rest = *dsc;
+    rest.shadow_opa         = LV_OPA_TRANSP;
+    __real_lv_draw_rect(coords, clip, &rest);
+}
+
+/**
+ * Start caching shadow masks
+ * @param budget maximum bytes of masks to keep, 0 lets lvgl draw all shadows
+ */
+void hasp_shadow_cache_init(uint32_t budget)
+{
+    shadow_stats.budget = budget;
+    while(shadow_stats.bytes > shadow_stats.budget && shadow_evict()) {
+    }
+    LOG_VERBOSE(TAG_LVGL, F("Shadow cache: %u bytes"), budget);
+}
+
+// Free all masks, e.g. to release memory for a large page
+void hasp_shadow_cache_clear()
+{
+    while(shadow_cache) {
+        hasp_shadow_t* entry = shadow_cache;
+        shadow_cache         = entry->next;
+        shadow_free(entry);
+    }
+}
+
+void hasp_shadow_cache_get_info(JsonDocument& doc)
+{
+    JsonObject info      = doc.createNestedObject(F("Shadow Cache"));
+    info[F("entries")]   = shadow_stats.entries;
+    info[F("bytes")]     = shadow_stats.bytes;
+    info[F("budget")]    = shadow_stats.budget;
+    info[F("hits")]      = shadow_stats.hits;
+    info[F("misses")]    = shadow_stats.misses;
+    info[F("evictions")] = shadow_stats.evictions;
+    info[F("bypassed")]  = shadow_stats.bypassed;
+}
+
+#else
+
+// The build flags wrap lv_draw_rect unconditionally, so keep the symbol when the cache is disabled.
+// The weak reference also lets the file link in builds without -Wl,--wrap=lv_draw_rect.
+extern "C" void __real_lv_draw_rect(const lv_area_t* coords, const lv_area_t* clip, const lv_draw_rect_dsc_t* dsc)
+    __attribute__((weak));
+
+extern "C" void __wrap_lv_draw_rect(const lv_area_t* coords, const lv_area_t* clip, const lv_draw_rect_dsc_t* dsc)
+{
+    __real_lv_draw_rect(coords, clip, dsc);
+}
+
+#endif
@@ -0,0 +1,32 @@
+/* MIT License - Copyright (c) 2019-2024 Francis Van Roie
+   For full license information read the LICENSE file in the project folder */
+
+#ifndef HASP_SHADOW_H
+#define HASP_SHADOW_H
+
+#include "hasplib.h"
+
+#ifndef HASP_SHADOW_CACHE_SIZE
+#define HASP_SHADOW_CACHE_SIZE 32768 // bytes of shadow masks kept in internal ram
+#endif
+
+#ifndef HASP_SHADOW_CACHE_SIZE_PSRAM
+#define HASP_SHADOW_CACHE_SIZE_PSRAM 262144 // bytes of shadow masks kept when PSRAM is available
+#endif
+
+typedef struct
+{
+    uint32_t hits;      // shadows drawn from a cached mask
+    uint32_t misses;    // masks computed and added to the cache
+    uint32_t evictions; // masks freed to stay within the budget
+    uint32_t bypassed;  // shadows too large for the budget, drawn by lvgl
+    uint32_t bytes;     // mask bytes in the cache
+    uint32_t budget;    // maximum number of mask bytes
+    uint16_t entries;   // masks in the cache
+} hasp_shadow_stats_t;
+
+void hasp_shadow_cache_init(uint32_t budget);
+void hasp_shadow_cache_clear();
+void hasp_shadow_cache_get_info(JsonDocument& doc);
+
+#endif
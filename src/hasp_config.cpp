@@ -385,8 +385,52 @@ void configBackupToEeprom()
 #endif
 }
 */
-void configWrite()
+static uint16_t config_dirty_sections = CONFIG_SECTION_NONE;
+static uint32_t config_dirty_first    = 0; // millis of the first pending change
+static uint32_t config_dirty_last     = 0; // millis of the most recent pending change
+static hasp_config_stats_t config_stats;
+
+#if HASP_USE_SPIFFS > 0 || HASP_USE_LITTLEFS > 0
+// Write the settings to a temporary file first and only replace config.json when the new file is complete
+static size_t configWriteFile(String& configFile, JsonDocument& doc)
+{
+    String tempFile((char*)0);
+    tempFile.reserve(40);
+    tempFile = configFile;
+    tempFile += F(".tmp");
+
+    File file = HASP_FS.open(tempFile, "w");
+    if(!file) return 0;
+
+    LOG_TRACE(TAG_CONF, F(D_FILE_SAVING), configFile.c_str());
+    WriteBufferingStream bufferedFile(file, 256);
+    size_t size = serializeJson(doc, bufferedFile);
+    bufferedFile.flush();
+    file.close();
+
+    if(size == 0) {
+        HASP_FS.remove(tempFile);
+        return 0;
+    }
+
+    if(!HASP_FS.rename(tempFile, configFile)) {
+        // SPIFFS refuses to rename onto an existing file
+        HASP_FS.remove(configFile);
+        if(!HASP_FS.rename(tempFile, configFile)) {
+            HASP_FS.remove(tempFile);
+            return 0;
+        }
+    }
+
+    return size;
+}
+#endif
+
+// Query only the dirty modules and rewrite config.json if any of their settings differ from the file
+static void configWriteSections(uint16_t sections)
 {
+    uint32_t start = millis();
+
     String configFile;
     configFile.reserve(32);
     configFile = String(FPSTR(FP_HASP_CONFIG_FILE));
@@ -414,126 +458,140 @@ void configWrite()
     const __FlashStringHelper* module;
 
 #if HASP_USE_WIFI > 0
-    module = FPSTR(FP_WIFI);
-    if(settings[module].as<JsonObject>().isNull()) settings.createNestedObject(module);
-    changed = wifiGetConfig(settings[module]);
-    if(changed) {
-        LOG_VERBOSE(TAG_WIFI, settingsChanged.c_str());
-        configOutput(settings[module], TAG_WIFI);
-        writefile = true;
+    if(sections & CONFIG_SECTION_WIFI) {
+        module = FPSTR(FP_WIFI);
+        if(settings[module].as<JsonObject>().isNull()) settings.createNestedObject(module);
+        changed = wifiGetConfig(settings[module]);
+        if(changed) {
+            LOG_VERBOSE(TAG_WIFI, settingsChanged.c_str());
+            configOutput(settings[module], TAG_WIFI);
+            writefile = true;
+        }
     }
 #endif
 
 #if HASP_USE_WIREGUARD > 0
-    module = FPSTR(FP_WG);
-    if(settings[module].as<JsonObject>().isNull()) settings.createNestedObject(module);
-    changed = wgGetConfig(settings[module]);
-    if(changed) {
-        LOG_VERBOSE(TAG_WG, settingsChanged.c_str());
-        configOutput(settings[module], TAG_WG);
-        writefile = true;
+    if(sections & CONFIG_SECTION_WG) {
+        module = FPSTR(FP_WG);
+        if(settings[module].as<JsonObject>().isNull()) settings.createNestedObject(module);
+        changed = wgGetConfig(settings[module]);
+        if(changed) {
+            LOG_VERBOSE(TAG_WG, settingsChanged.c_str());
+            configOutput(settings[module], TAG_WG);
+            writefile = true;
+        }
     }
 #endif
 
 #if HASP_USE_MQTT > 0
-    module = FPSTR(FP_MQTT);
-    if(settings[module].as<JsonObject>().isNull()) settings.createNestedObject(module);
-    changed = mqttGetConfig(settings[module]);
-    if(changed) {
-        LOG_VERBOSE(TAG_MQTT, settingsChanged.c_str());
-        configOutput(settings[module], TAG_MQTT);
-        writefile = true;
+    if(sections & CONFIG_SECTION_MQTT) {
+        module = FPSTR(FP_MQTT);
+        if(settings[module].as<JsonObject>().isNull()) settings.createNestedObject(module);
+        changed = mqttGetConfig(settings[module]);
+        if(changed) {
+            LOG_VERBOSE(TAG_MQTT, settingsChanged.c_str());
+            configOutput(settings[module], TAG_MQTT);
+            writefile = true;
+        }
     }
 #endif
 
 #if HASP_USE_TELNET > 0
-    module = F("telnet");
-    if(settings[module].as<JsonObject>().isNull()) settings.createNestedObject(module);
-    changed = telnetGetConfig(settings[module]);
-    if(changed) {
-        LOG_VERBOSE(TAG_TELN, settingsChanged.c_str());
-        configOutput(settings[module], TAG_TELN);
-        writefile = true;
+    if(sections & CONFIG_SECTION_TELNET) {
+        module = F("telnet");
+        if(settings[module].as<JsonObject>().isNull()) settings.createNestedObject(module);
+        changed = telnetGetConfig(settings[module]);
+        if(changed) {
+            LOG_VERBOSE(TAG_TELN, settingsChanged.c_str());
+            configOutput(settings[module], TAG_TELN);
+            writefile = true;
+        }
     }
 #endif
 
 #if HASP_USE_MDNS > 0
-    module = FPSTR(FP_MDNS);
-    if(settings[module].as<JsonObject>().isNull()) settings.createNestedObject(module);
-    changed = mdnsGetConfig(settings[module]);
-    if(changed) {
-        LOG_VERBOSE(TAG_MDNS, settingsChanged.c_str());
-        configOutput(settings[module], TAG_MDNS);
-        writefile = true;
+    if(sections & CONFIG_SECTION_MDNS) {
+        module = FPSTR(FP_MDNS);
+        if(settings[module].as<JsonObject>().isNull()) settings.createNestedObject(module);
+        changed = mdnsGetConfig(settings[module]);
+        if(changed) {
+            LOG_VERBOSE(TAG_MDNS, settingsChanged.c_str());
+            configOutput(settings[module], TAG_MDNS);
+            writefile = true;
+        }
     }
 #endif
 
 #if HASP_USE_HTTP > 0
-    if(settings[FPSTR(FP_HTTP)].as<JsonObject>().isNull()) settings.createNestedObject(F("http"));
-    changed = httpGetConfig(settings[FPSTR(FP_HTTP)]);
-    if(changed) {
-        LOG_VERBOSE(TAG_HTTP, settingsChanged.c_str());
-        configOutput(settings[FPSTR(FP_HTTP)], TAG_HTTP);
-        writefile = true;
+    if(sections & CONFIG_SECTION_HTTP) {
+        if(settings[FPSTR(FP_HTTP)].as<JsonObject>().isNull()) settings.createNestedObject(F("http"));
+        changed = httpGetConfig(settings[FPSTR(FP_HTTP)]);
+        if(changed) {
+            LOG_VERBOSE(TAG_HTTP, settingsChanged.c_str());
+            configOutput(settings[FPSTR(FP_HTTP)], TAG_HTTP);
+            writefile = true;
+        }
     }
 #endif
 
 #if HASP_USE_GPIO > 0
-    module = FPSTR(FP_GPIO);
-    if(settings[module].as<JsonObject>().isNull()) settings.createNestedObject(module);
-    changed = gpioGetConfig(settings[module]);
-    if(changed) {
-        LOG_VERBOSE(TAG_GPIO, settingsChanged.c_str());
-        configOutput(settings[module], TAG_GPIO);
-        writefile = true;
+    if(sections & CONFIG_SECTION_GPIO) {
+        module = FPSTR(FP_GPIO);
+        if(settings[module].as<JsonObject>().isNull()) settings.createNestedObject(module);
+        changed = gpioGetConfig(settings[module]);
+        if(changed) {
+            LOG_VERBOSE(TAG_GPIO, settingsChanged.c_str());
+            configOutput(settings[module], TAG_GPIO);
+            writefile = true;
+        }
     }
 #endif
 
 #if HASP_TARGET_ARDUINO
-    module = FPSTR(FP_DEBUG);
-    if(settings[module].as<JsonObject>().isNull()) settings.createNestedObject(module);
-    changed = debugGetConfig(settings[module]);
-    if(changed) {
-        LOG_VERBOSE(TAG_DEBG, settingsChanged.c_str());
-        configOutput(settings[module], TAG_DEBG);
-        writefile = true;
+    if(sections & CONFIG_SECTION_DEBUG) {
+        module = FPSTR(FP_DEBUG);
+        if(settings[module].as<JsonObject>().isNull()) settings.createNestedObject(module);
+        changed = debugGetConfig(settings[module]);
+        if(changed) {
+            LOG_VERBOSE(TAG_DEBG, settingsChanged.c_str());
+            configOutput(settings[module], TAG_DEBG);
+            writefile = true;
+        }
     }
 #endif
 
-    if(settings[FPSTR(FP_GUI)].as<JsonObject>().isNull()) settings.createNestedObject(FPSTR(FP_GUI));
-    changed = guiGetConfig(settings[FPSTR(FP_GUI)]);
-    if(changed) {
-        LOG_VERBOSE(TAG_GUI, settingsChanged.c_str());
-        configOutput(settings[FPSTR(FP_GUI)], TAG_GUI);
-        writefile = true;
+    if(sections & CONFIG_SECTION_GUI) {
+        if(settings[FPSTR(FP_GUI)].as<JsonObject>().isNull()) settings.createNestedObject(FPSTR(FP_GUI));
+        changed = guiGetConfig(settings[FPSTR(FP_GUI)]);
+        if(changed) {
+            LOG_VERBOSE(TAG_GUI, settingsChanged.c_str());
+            configOutput(settings[FPSTR(FP_GUI)], TAG_GUI);
+            writefile = true;
+        }
     }
 
-    if(settings[FPSTR(FP_HASP)].as<JsonObject>().isNull()) settings.createNestedObject(FPSTR(FP_HASP));
-    changed = haspGetConfig(settings[FPSTR(FP_HASP)]);
-    if(changed) {
-        LOG_VERBOSE(TAG_HASP, settingsChanged.c_str());
-        configOutput(settings[FPSTR(FP_HASP)], TAG_HASP);
-        writefile = true;
+    if(sections & CONFIG_SECTION_HASP) {
+        if(settings[FPSTR(FP_HASP)].as<JsonObject>().isNull()) settings.createNestedObject(FPSTR(FP_HASP));
+        changed = haspGetConfig(settings[FPSTR(FP_HASP)]);
+        if(changed) {
+            LOG_VERBOSE(TAG_HASP, settingsChanged.c_str());
+            configOutput(settings[FPSTR(FP_HASP)], TAG_HASP);
+            writefile = true;
+        }
     }
 
     // changed |= otaGetConfig(settings[F("ota")].as<JsonObject>());
 
     if(writefile) {
 #if HASP_USE_SPIFFS > 0 || HASP_USE_LITTLEFS > 0
-        File file = HASP_FS.open(configFile, "w");
-        if(file) {
-            LOG_TRACE(TAG_CONF, F(D_FILE_SAVING), configFile.c_str());
-            WriteBufferingStream bufferedFile(file, 256);
-            size_t size = serializeJson(doc, bufferedFile);
-            bufferedFile.flush();
-            file.close();
-            if(size > 0) {
-                LOG_INFO(TAG_CONF, F(D_FILE_SAVED), configFile.c_str());
-                // configBackupToEeprom();
-            } else {
-                LOG_ERROR(TAG_CONF, F(D_FILE_SAVE_FAILED), configFile.c_str());
-            }
+        size_t size = configWriteFile(configFile, doc);
+        if(size > 0) {
+            config_stats.writes++;
+            config_stats.bytes = size;
+            LOG_INFO(TAG_CONF, F(D_FILE_SAVED), configFile.c_str());
+            // configBackupToEeprom();
         } else {
+            config_stats.failed++;
             LOG_ERROR(TAG_CONF, F(D_FILE_SAVE_FAILED), configFile.c_str());
         }
 #endif
@@ -563,9 +621,98 @@ void configWrite()
 #endif
 
     } else {
+        config_stats.unchanged++;
         LOG_INFO(TAG_CONF, F(D_CONFIG_NOT_CHANGED));
     }
     configOutput(settings, TAG_CONF);
+
+    uint32_t elapsed     = millis() - start;
+    config_stats.last_ms = elapsed;
+    config_stats.total_ms += elapsed;
+    if(elapsed > config_stats.max_ms) config_stats.max_ms = elapsed;
+}
+
+void configWrite()
+{
+    config_dirty_sections = CONFIG_SECTION_NONE;
+    configWriteSections(CONFIG_SECTION_ALL);
+}
+
+// Mark settings as changed, they are written to flash after CONFIG_WRITE_DEBOUNCE ms without new changes
+void configSetDirty(uint16_t sections)
+{
+    if(sections == CONFIG_SECTION_NONE) return;
+
+    uint32_t now = millis();
+    if(config_dirty_sections == CONFIG_SECTION_NONE) {
+        config_dirty_first = now;
+    } else {
+        config_stats.coalesced++;
+    }
+    config_dirty_sections |= sections;
+    config_dirty_last = now;
+}
+
+void configSetDirty(const char* section)
+{
+    if(!section) return;
+
+    if(!strcasecmp_P(section, FP_WIFI))
+        configSetDirty(CONFIG_SECTION_WIFI);
+    else if(!strcasecmp_P(section, FP_WG))
+        configSetDirty(CONFIG_SECTION_WG);
+    else if(!strcasecmp_P(section, FP_MQTT))
+        configSetDirty(CONFIG_SECTION_MQTT);
+    else if(!strcasecmp_P(section, PSTR("telnet")))
+        configSetDirty(CONFIG_SECTION_TELNET);
+    else if(!strcasecmp_P(section, FP_MDNS))
+        configSetDirty(CONFIG_SECTION_MDNS);
+    else if(!strcasecmp_P(section, FP_HTTP))
+        configSetDirty(CONFIG_SECTION_HTTP);
+    else if(!strcasecmp_P(section, FP_GPIO))
+        configSetDirty(CONFIG_SECTION_GPIO);
+    else if(!strcasecmp_P(section, FP_DEBUG))
+        configSetDirty(CONFIG_SECTION_DEBUG);
+    else if(!strcasecmp_P(section, FP_GUI))
+        configSetDirty(CONFIG_SECTION_GUI);
+    else if(!strcasecmp_P(section, FP_HASP))
+        configSetDirty(CONFIG_SECTION_HASP);
+    else if(strcasecmp_P(section, FP_TIME) && strcasecmp_P(section, FP_FTP) && strcasecmp_P(section, FP_OTA))
+        LOG_WARNING(TAG_CONF, F("Unknown config section %s"), section); // time, ftp and ota are stored in nvs
+}
+
+bool configIsDirty()
+{
+    return config_dirty_sections != CONFIG_SECTION_NONE;
+}
+
+// Write pending changes immediately
+void configFlush()
+{
+    if(!configIsDirty()) return;
+
+    uint16_t sections     = config_dirty_sections;
+    config_dirty_sections = CONFIG_SECTION_NONE;
+    configWriteSections(sections);
+}
+
+const hasp_config_stats_t* configGetStats()
+{
+    return &config_stats;
+}
+
+void config_get_info(JsonDocument& doc)
+{
+    JsonObject info         = doc.createNestedObject(F("Config"));
+    info[F("writes")]       = config_stats.writes;
+    info[F("unchanged")]    = config_stats.unchanged;
+    info[F("coalesced")]    = config_stats.coalesced;
+    info[F("failed")]       = config_stats.failed;
+    info[F("size")]         = config_stats.bytes;
+    info[F("lastWriteMs")]  = config_stats.last_ms;
+    info[F("maxWriteMs")]   = config_stats.max_ms;
+    info[F("totalWriteMs")] = config_stats.total_ms;
+    info[F("pending")]      = configIsDirty();
 }
 
 void configSetup()
@@ -647,7 +794,13 @@ void configSetup()
 }
 
 void configLoop(void)
-{}
+{
+    if(!configIsDirty()) return;
+
+    uint32_t now = millis();
+    if(now - config_dirty_last >= CONFIG_WRITE_DEBOUNCE || now - config_dirty_first >= CONFIG_WRITE_MAX_DELAY)
+        configFlush();
+}
 
 void configOutput(const JsonObject& settings, uint8_t tag)
 {
@@ -10,6 +10,42 @@
 
 #define MAX_CONFIG_JSON_ALLOC_SIZE (2048)
 
+#ifndef CONFIG_WRITE_DEBOUNCE
+#define CONFIG_WRITE_DEBOUNCE 3000 // ms of quiet time before dirty settings are flushed
+#endif
+
+#ifndef CONFIG_WRITE_MAX_DELAY
+#define CONFIG_WRITE_MAX_DELAY 30000 // ms after the first change, flush even if changes keep coming
+#endif
+
+/* Sections of config.json that can be marked dirty independently */
+enum hasp_config_section_t : uint16_t {
+    CONFIG_SECTION_NONE   = 0,
+    CONFIG_SECTION_WIFI   = 1 << 0,
+    CONFIG_SECTION_WG     = 1 << 1,
+    CONFIG_SECTION_MQTT   = 1 << 2,
+    CONFIG_SECTION_TELNET = 1 << 3,
+    CONFIG_SECTION_MDNS   = 1 << 4,
+    CONFIG_SECTION_HTTP   = 1 << 5,
+    CONFIG_SECTION_GPIO   = 1 << 6,
+    CONFIG_SECTION_DEBUG  = 1 << 7,
+    CONFIG_SECTION_GUI    = 1 << 8,
+    CONFIG_SECTION_HASP   = 1 << 9,
+    CONFIG_SECTION_ALL    = 0xFFFF,
+};
+
+typedef struct
+{
+    uint32_t writes;    // number of times config.json was written
+    uint32_t unchanged; // flushes where no section had actually changed
+    uint32_t coalesced; // change notifications merged into a pending write
+    uint32_t failed;    // failed writes
+    uint32_t bytes;     // size of the last written file
+    uint32_t last_ms;   // duration of the last flush
+    uint32_t max_ms;    // longest flush
+    uint32_t total_ms;  // accumulated flush time
+} hasp_config_stats_t;
+
 /* ===== Default Event Processors ===== */
 void configSetup(void);
 void configLoop(void);
@@ -21,6 +57,12 @@ void configStop(void);
 DeserializationError configParseFile(String& configFile, JsonDocument& settings);
 DeserializationError configRead(JsonDocument& settings, bool setupdebug);
 void configWrite(void);
+void configSetDirty(uint16_t sections);
+void configSetDirty(const char* section);
+bool configIsDirty(void);
+void configFlush(void);
+const hasp_config_stats_t* configGetStats(void);
+void config_get_info(JsonDocument& doc);
 void configOutput(const JsonObject& settings, uint8_t tag);
 bool configClearEeprom(void);
 
@@ -37,9 +37,80 @@ extern const uint8_t PAGES_JSONL_END[] asm("_binary_data_pages_pages_jsonl_end")
 
 #include "hasp_debug.h"
 #include "hasp_filesystem.h"
+#include "hasp_mem.h"
 
 #if defined(ARDUINO_ARCH_ESP32)
 #include "rom/crc.h"
+#include "rom/miniz.h"
+
+#define ZIP_READ_BUFFER_SIZE 512
+#define ZIP_FLAG_DATA_DESCRIPTOR 0x0008 // sizes and crc are stored after the data
+
+// Copy a stored entry to the destination file
+static bool filesystem_unzip_stored(File& zipfile, File& f, const zip_file_header_t& fh, uint32_t& crc32)
+{
+    uint8_t buffer[ZIP_READ_BUFFER_SIZE];
+    uint32_t remaining = fh.compressed_size;
+
+    while(remaining > 0) {
+        size_t len = zipfile.read(buffer, remaining < sizeof(buffer) ? remaining : sizeof(buffer));
+        if(len == 0) return false;
+        remaining -= len;
+        crc32 = crc32_le(crc32, buffer, len);
+        if(f.write(buffer, len) != len) return false;
+    }
+
+    return true;
+}
+
+// Inflate a deflated entry straight into the destination file
+// The decompressed data is written out of the circular LZ dictionary, so no extra output buffer is needed
+static bool filesystem_unzip_deflate(File& zipfile, File& f, const zip_file_header_t& fh, uint32_t& crc32,
+                                     tinfl_decompressor* inflator, uint8_t* dict)
+{
+    uint8_t buffer[ZIP_READ_BUFFER_SIZE];
+    uint32_t remaining = fh.compressed_size;
+    uint32_t written   = 0;
+    size_t in_len      = 0;
+    size_t in_ofs      = 0;
+    size_t dict_ofs    = 0;
+    bool result        = false;
+
+    tinfl_init(inflator);
+    while(true) {
+        if(in_ofs == in_len && remaining > 0) {
+            in_len = zipfile.read(buffer, remaining < sizeof(buffer) ? remaining : sizeof(buffer));
+            if(in_len == 0) break;
+            remaining -= in_len;
+            in_ofs = 0;
+        }
+
+        size_t in_size      = in_len - in_ofs;
+        size_t out_size     = TINFL_LZ_DICT_SIZE - dict_ofs;
+        tinfl_status status = tinfl_decompress(inflator, buffer + in_ofs, &in_size, dict, dict + dict_ofs, &out_size,
+                                               remaining > 0 ? TINFL_FLAG_HAS_MORE_INPUT : 0);
+        in_ofs += in_size;
+
+        if(out_size > 0) {
+            crc32 = crc32_le(crc32, dict + dict_ofs, out_size);
+            if(f.write(dict + dict_ofs, out_size) != out_size) break;
+            written += out_size;
+            dict_ofs = (dict_ofs + out_size) & (TINFL_LZ_DICT_SIZE - 1);
+        }
+
+        if(status == TINFL_STATUS_DONE) {
+            result = written == fh.uncompressed_size;
+            break;
+        }
+        if(status < TINFL_STATUS_DONE) {
+            LOG_WARNING(TAG_FILE, F("Inflate failed %d"), status);
+            break;
+        }
+    }
+
+    if(remaining > 0) zipfile.seek(remaining, SeekCur); // position at the next header
+    return result;
+}
 
 void filesystemUnzip(const char*, const char* filename, uint8_t source)
 {
@@ -52,6 +123,11 @@ void filesystemUnzip(const char*, const char* filename, uint8_t source)
     size_t len;
     bool done = false;
 
+    tinfl_decompressor* inflator = NULL; // allocated on the first deflated entry
+    uint8_t* dict                = NULL;
+    uint32_t total_size          = 0;
+    uint32_t start               = millis();
+
     zipfile.seek(0);
     while(!done) {
         len = zipfile.read((uint8_t*)&head, sizeof(head));
@@ -89,7 +165,23 @@ void filesystemUnzip(const char*, const char* filename, uint8_t source)
                 }
                 zipfile.seek(fh.extra_length, SeekCur); // skip extra field
 
-                if(fh.compression_method != ZIP_NO_COMPRESSION) {
+                if(fh.flags & ZIP_FLAG_DATA_DESCRIPTOR) {
+                    LOG_WARNING(TAG_FILE, F("Streamed zip files are not supported"));
+                    done = true;
+                    continue;
+                }
+
+                if(fh.compression_method == ZIP_DEFLTATE && !inflator) {
+                    inflator = (tinfl_decompressor*)hasp_malloc(sizeof(tinfl_decompressor));
+                    dict     = (uint8_t*)hasp_malloc(TINFL_LZ_DICT_SIZE);
+                    if(!inflator || !dict) {
+                        LOG_ERROR(TAG_FILE, F(D_ERROR_OUT_OF_MEMORY));
+                        done = true;
+                        continue;
+                    }
+                }
+
+                if(fh.compression_method != ZIP_NO_COMPRESSION && fh.compression_method != ZIP_DEFLTATE) {
                     LOG_WARNING(TAG_FILE, F("Compression is not supported %d"), fh.compression_method);
                     zipfile.seek(fh.compressed_size, SeekCur); // skip compressed file
                 } else {
@@ -98,35 +190,26 @@ void filesystemUnzip(const char*, const char* filename, uint8_t source)
 
                     File f = HASP_FS.open(name, FILE_WRITE);
                     if(f) {
-                        uint8_t buffer[512];
-                        uint32_t crc32 = 0;
-
-                        while(!done && fh.compressed_size >= 512) {
-                            len = zipfile.readBytes((char*)&buffer, 512);
-                            if(len != 512) done = true;
-                            fh.compressed_size -= len;
-                            crc32 = crc32_le(crc32, buffer, len);
-                            f.write(buffer, len);
-                        }
-
-                        if(!done && fh.compressed_size > 0) {
-                            len = zipfile.readBytes((char*)&buffer, fh.compressed_size);
-                            if(len != fh.compressed_size) done = true;
-                            fh.compressed_size -= len;
-                            crc32 = crc32_le(crc32, buffer, len);
-                            f.write(buffer, len);
-                        }
-
-                        if(crc32 != fh.crc) done = true;
+                        uint32_t crc32      = 0;
+                        uint32_t file_start = millis();
+                        bool ok;
+
+                        if(fh.compression_method == ZIP_DEFLTATE)
+                            ok = filesystem_unzip_deflate(zipfile, f, fh, crc32, inflator, dict);
+                        else
+                            ok = filesystem_unzip_stored(zipfile, f, fh, crc32);
+                        f.close();
 
-                        if(!done) {
-                            Parser::format_bytes(fh.uncompressed_size, (char*)buffer, sizeof(buffer));
-                            LOG_VERBOSE(TAG_FILE, F(D_BULLET "%s (%s)"), name, buffer);
+                        if(ok && crc32 == fh.crc) {
+                            char size_buf[16];
+                            Parser::format_bytes(fh.uncompressed_size, size_buf, sizeof(size_buf));
+                            LOG_VERBOSE(TAG_FILE, F(D_BULLET "%s (%s) %ums"), name, size_buf, millis() - file_start);
+                            total_size += fh.uncompressed_size;
                         } else {
                             LOG_ERROR(TAG_FILE, F(D_FILE_SAVE_FAILED), name);
+                            HASP_FS.remove(name); // don't leave a corrupt file behind
+                            done = true;
                         }
-
-                        f.close();
                     }
                 }
 
@@ -148,7 +231,13 @@ void filesystemUnzip(const char*, const char* filename, uint8_t source)
         }
     }
     zipfile.close();
+    hasp_free(inflator);
+    hasp_free(dict);
+
+    uint32_t elapsed = millis() - start;
     LOG_VERBOSE(TAG_FILE, F("extracting %s complete"), filename);
+    LOG_VERBOSE(TAG_FILE, F("%u bytes in %ums (%u kB/s)"), total_size, elapsed,
+                elapsed > 0 ? total_size / elapsed : total_size / 1000);
 }
 #endif
 
@@ -204,10 +293,11 @@ void filesystemList()
 }
 
 #if defined(ARDUINO_ARCH_ESP32)
-String filesystem_list(fs::FS& fs, const char* dirname, uint8_t levels)
+// Write the directory tree as json to out, without building it in memory first
+void filesystem_list(fs::FS& fs, const char* dirname, uint8_t levels, Print& out)
 {
     LOG_VERBOSE(TAG_FILE, "Listing directory: %s\n", dirname);
-    String data = "[";
+    out.print('[');
 
     File root = fs.open(dirname);
     if(!root) {
@@ -215,35 +305,35 @@ String filesystem_list(fs::FS& fs, const char* dirname, uint8_t levels)
     } else if(!root.isDirectory()) {
         LOG_WARNING(TAG_FILE, "Not a directory");
     } else {
-        File file = root.openNextFile();
+        bool first = true;
+        File file  = root.openNextFile();
         while(file) {
 
-            if(data != "[") {
-                data += ",";
-            }
-            data += "{\"name\":\"";
-            data += file.name();
-            data += "\"";
+            if(!first) out.print(',');
+            first = false;
+
+            out.print("{\"name\":\"");
+            out.print(file.name());
+            out.print('"');
 
             if(file.isDirectory()) {
-                data += ",\"children\":";
+                out.print(",\"children\":");
                 if(levels) {
                     String dir = dirname;
                     dir += file.name();
                     dir += '/';
-                    data += filesystem_list(fs, dir.c_str(), levels - 1);
+                    filesystem_list(fs, dir.c_str(), levels - 1, out);
                 } else {
-                    data += "[]";
+                    out.print("[]");
                 }
             }
-            data += "}";
+            out.print('}');
             file = root.openNextFile();
         }
         root.close();
     }
 
-    data += "]";
-    return data;
+    out.print(']');
 }
 #endif
 
@@ -65,7 +65,7 @@ typedef struct
 
 #if defined(ARDUINO_ARCH_ESP32)
 void filesystemUnzip(const char*, const char* filename, uint8_t source);
-String filesystem_list(fs::FS& fs, const char* dirname, uint8_t levels);
+void filesystem_list(fs::FS& fs, const char* dirname, uint8_t levels, Print& out);
 #endif
 
 #endif // HASP_FILESYSTEM_H
\ No newline at end of file
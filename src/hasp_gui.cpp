@@ -93,6 +93,22 @@ static inline void gui_init_lvgl()
     LOG_VERBOSE(TAG_LVGL, F("MEM size   : %d"), LV_MEM_SIZE);
 #endif
     LOG_VERBOSE(TAG_LVGL, F("VFB size   : %d"), (size_t)sizeof(lv_color_t) * guiVDBsize);
+
+#if HASP_USE_SHADOW_CACHE > 0 && LV_USE_SHADOW
+#if defined(ARDUINO_ARCH_ESP32)
+    hasp_shadow_cache_init(hasp_use_psram() ? HASP_SHADOW_CACHE_SIZE_PSRAM : HASP_SHADOW_CACHE_SIZE);
+#else
+    hasp_shadow_cache_init(HASP_SHADOW_CACHE_SIZE);
+#endif
+#endif
+
+#if HASP_USE_LABEL_CACHE > 0
+#if defined(ARDUINO_ARCH_ESP32)
+    hasp_label_cache_init(hasp_use_psram() ? HASP_LABEL_CACHE_SIZE_PSRAM : HASP_LABEL_CACHE_SIZE);
+#else
+    hasp_label_cache_init(HASP_LABEL_CACHE_SIZE);
+#endif
+#endif
 }
 
 void gui_hide_pointer(bool hidden)
@@ -104,6 +120,9 @@ IRAM_ATTR void gui_flush_cb(lv_disp_drv_t* disp, const lv_area_t* area, lv_color
 {
     haspTft.flush_pixels(disp, area, color_p);
     screenshotIsDirty = true;
+#if HASP_USE_WEBSOCKET > 0
+    websocket_invalidate_area(area->x1, area->y1, area->x2, area->y2);
+#endif
 }
 
 void gui_antiburn_cb(lv_disp_drv_t* disp, const lv_area_t* area, lv_color_t* color_p)
@@ -187,6 +206,10 @@ static inline void gui_init_images()
     lv_png_init(); // Initialize PNG decoder
 #endif
 
+#if HASP_USE_PNG_STREAM > 0
+    hasp_png_stream_init(); // Initialize line by line PNG decoder, tried before lv_png
+#endif
+
 #if HASP_USE_BMPDECODE > 0
     lv_bmp_init(); // Initialize BMP decoder
 #endif
@@ -201,6 +224,9 @@ static inline void gui_init_images()
 
 #if defined(ARDUINO_ARCH_ESP32)
     if(hasp_use_psram()) lv_img_cache_set_size(LV_IMG_CACHE_DEF_SIZE_PSRAM);
+    hasp_img_cache_init(hasp_use_psram() ? HASP_IMG_CACHE_SIZE_PSRAM : HASP_IMG_CACHE_SIZE);
+#else
+    hasp_img_cache_init(HASP_IMG_CACHE_SIZE);
 #endif
 }
 
@@ -209,6 +235,9 @@ static inline void gui_init_filesystems()
 #if LV_USE_FS_IF != 0
     LOG_VERBOSE(TAG_LVGL, F("Filesystem : " D_SETTING_ENABLED));
     lv_fs_if_init(); // auxiliary file system drivers
+#if LV_FS_IF_PC != '\0'
+    lvfs_cache_init(LV_FS_IF_PC); // read-ahead buffer for the local filesystem
+#endif
 #else
     LOG_VERBOSE(TAG_LVGL, F("Filesystem : " D_SETTING_DISABLED));
 #endif
@@ -25,14 +25,21 @@
 #include "lv_fs_if.h"
 
 #include "hasp/hasp.h"
+#include "hasp/hasp_anim.h"
 #include "hasp/hasp_attribute.h"
 #include "hasp/hasp_dispatch.h"
 #include "hasp/hasp_event.h"
 #include "hasp/hasp_font.h"
+#include "hasp/hasp_img_cache.h"
+#include "hasp/hasp_jsonl.h"
+#include "hasp/hasp_label_cache.h"
 #include "hasp/hasp_object.h"
 #include "hasp/hasp_page.h"
 #include "hasp/hasp_parser.h"
 #include "hasp/hasp_lvfs.h"
+#include "hasp/hasp_pool.h"
+#include "hasp/hasp_rules.h"
+#include "hasp/hasp_shadow.h"
 
 #include "hasp/lv_theme_hasp.h"
 
@@ -52,6 +59,10 @@
 #include "lv_png.h"
 #endif
 
+#if HASP_USE_PNG_STREAM > 0
+#include "hasp/hasp_png_stream.h"
+#endif
+
 #if HASP_USE_BMPDECODE > 0
 #include "lv_bmp.h"
 #endif
@@ -188,6 +188,10 @@ IRAM_ATTR void loop()
     mqttLoop();
 #endif
 
+#if HASP_USE_CONFIG > 0
+    configLoop(); // flush debounced config changes
+#endif
+
     // haspDevice.loop();
 
 #if HASP_USE_CONSOLE > 0
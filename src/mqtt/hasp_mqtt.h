@@ -8,6 +8,7 @@
 #include "hasplib.h"
 
 typedef enum {
+    MQTT_ERR_QUEUED   = 1, // kept in the outbox until the connection is restored
     MQTT_ERR_OK       = 0,
     MQTT_ERR_DISABLED = -1,
     MQTT_ERR_NO_CONN  = -2,
@@ -26,6 +27,8 @@ void mqttStop();
 int mqtt_send_state(const char* subtopic, const char* payload);
 int mqtt_send_discovery(const char* payload, size_t len);
 int mqttPublish(const char* topic, const char* payload, size_t len, bool retain);
+int mqttSubscribe(const char* topic);
+int mqttUnsubscribe(const char* topic);
 
 bool mqttIsConnected();
 void mqtt_get_info(JsonDocument& doc);
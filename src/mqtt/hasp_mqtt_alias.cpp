@@ -0,0 +1,149 @@
+/* MIT License - Copyright (c) 2019-2024 Francis Van Roie
+   For full license information read the LICENSE file in the project folder */
+
+/* MQTT v5 topic aliases
+ * Outbound topics get an alias from a small table, the least recently used alias is reassigned when it is full.
+ * The first publish sends the topic and the alias, later publishes only send the alias with an empty topic.
+ * Inbound aliases assigned by the broker are remembered and resolved before the message is dispatched. */
+
+#include "hasplib.h"
+
+#if HASP_USE_MQTT > 0 && HASP_USE_MQTT_V5 > 0
+
+#include "hasp_mqtt_alias.h"
+
+#define MQTT_ALIAS_PROPERTY_SIZE 3 // property identifier and 2 byte alias
+
+typedef struct
+{
+    char* topic;
+    uint32_t hash;
+    uint32_t used; // tick of the last publish
+} mqtt_alias_t;
+
+static mqtt_alias_t alias_out[HASP_MQTT_ALIAS_MAX]; // index + 1 is the alias
+static char* alias_in[HASP_MQTT_ALIAS_MAX];
+static uint32_t alias_tick;
+static mqtt_alias_stats_t alias_stats;
+
+static uint32_t alias_hash(const char* str)
+{
+    uint32_t hash = 2166136261u; // FNV-1a
+    while(*str) hash = (hash ^ (uint8_t)*str++) * 16777619u;
+    return hash;
+}
+
+static char* alias_strdup(const char* str, size_t length)
+{
+    char* copy = (char*)hasp_malloc(length + 1);
+    if(copy) {
+        memcpy(copy, str, length);
+        copy[length] = '\0';
+    }
+    return copy;
+}
+
+/**
+ * Forget all aliases, they are only valid for one connection
+ * @param maximum topic alias maximum sent by the broker in the CONNACK
+ */
+void mqtt_alias_reset(uint16_t maximum)
+{
+    for(uint16_t i = 0; i < HASP_MQTT_ALIAS_MAX; i++) {
+        hasp_free(alias_out[i].topic);
+        alias_out[i].topic = NULL;
+        alias_out[i].used  = 0;
+        hasp_free(alias_in[i]);
+        alias_in[i] = NULL;
+    }
+    alias_stats.maximum = maximum < HASP_MQTT_ALIAS_MAX ? maximum : HASP_MQTT_ALIAS_MAX;
+}
+
+/**
+ * Get the alias to publish a topic with
+ * @param topic full topic
+ * @param known set when the broker already knows the alias and the topic can be left empty
+ * @return alias, or 0 to publish without an alias
+ */
+uint16_t mqtt_alias_outbound(const char* topic, bool& known)
+{
+    known = false;
+
+    size_t length = strlen(topic);
+    if(alias_stats.maximum == 0 || length <= MQTT_ALIAS_PROPERTY_SIZE) return 0;
+
+    uint32_t hash   = alias_hash(topic);
+    uint16_t victim = 0;
+    alias_tick++;
+
+    for(uint16_t i = 0; i < alias_stats.maximum; i++) {
+        mqtt_alias_t* entry = &alias_out[i];
+        if(entry->topic && entry->hash == hash && !strcmp(entry->topic, topic)) {
+            entry->used = alias_tick;
+            known       = true;
+            alias_stats.hits++;
+            alias_stats.saved += length - MQTT_ALIAS_PROPERTY_SIZE;
+            return i + 1;
+        }
+        if(entry->used < alias_out[victim].used) victim = i; // unused entries have used = 0
+    }
+
+    char* copy = alias_strdup(topic, length);
+    if(!copy) return 0;
+
+    hasp_free(alias_out[victim].topic);
+    alias_out[victim].topic = copy;
+    alias_out[victim].hash  = hash;
+    alias_out[victim].used  = alias_tick;
+    alias_stats.misses++;
+    alias_stats.saved -= MQTT_ALIAS_PROPERTY_SIZE;
+    return victim + 1;
+}
+
+// Drop an alias that was not received by the broker
+void mqtt_alias_forget(uint16_t alias)
+{
+    if(alias == 0 || alias > HASP_MQTT_ALIAS_MAX) return;
+    hasp_free(alias_out[alias - 1].topic);
+    alias_out[alias - 1].topic = NULL;
+    alias_out[alias - 1].used  = 0;
+}
+
+/**
+ * Resolve the topic of an incoming message
+ * @param topic topic of the message, empty when only the alias was sent
+ * @param length length of the topic
+ * @param alias topic alias property of the message
+ * @return full topic, or NULL if the alias is unknown
+ */
+const char* mqtt_alias_inbound(const char* topic, size_t length, uint16_t alias)
+{
+    if(alias == 0 || alias > HASP_MQTT_ALIAS_MAX) return NULL;
+    char** entry = &alias_in[alias - 1];
+
+    if(length > 0) { // the broker (re)assigns the alias
+        hasp_free(*entry);
+        *entry = alias_strdup(topic, length);
+        return *entry;
+    }
+
+    if(*entry) {
+        alias_stats.inbound++;
+    } else {
+        alias_stats.unknown++;
+    }
+    return *entry;
+}
+
+void mqtt_alias_get_info(JsonDocument& doc)
+{
+    JsonObject info       = doc.createNestedObject(F("MQTT Aliases"));
+    info[F("maximum")]    = alias_stats.maximum;
+    info[F("hits")]       = alias_stats.hits;
+    info[F("misses")]     = alias_stats.misses;
+    info[F("inbound")]    = alias_stats.inbound;
+    info[F("unknown")]    = alias_stats.unknown;
+    info[F("bytesSaved")] = alias_stats.saved;
+}
+
+#endif
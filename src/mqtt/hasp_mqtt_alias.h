@@ -0,0 +1,30 @@
+/* MIT License - Copyright (c) 2019-2024 Francis Van Roie
+   For full license information read the LICENSE file in the project folder */
+
+#ifndef HASP_MQTT_ALIAS_H
+#define HASP_MQTT_ALIAS_H
+
+#include "hasplib.h"
+
+#ifndef HASP_MQTT_ALIAS_MAX
+#define HASP_MQTT_ALIAS_MAX 10 // topic aliases in each direction, mosquitto allows 10 by default
+#endif
+
+typedef struct
+{
+    uint16_t maximum; // outbound aliases allowed by the broker
+    uint32_t hits;    // publishes sent with an empty topic
+    uint32_t misses;  // publishes that (re)assigned an alias
+    uint32_t inbound; // incoming messages resolved from an alias
+    uint32_t unknown; // incoming aliases that were never assigned
+    int32_t saved;    // topic bytes not sent, minus the alias properties
+} mqtt_alias_stats_t;
+
+void mqtt_alias_reset(uint16_t maximum);
+uint16_t mqtt_alias_outbound(const char* topic, bool& known);
+void mqtt_alias_forget(uint16_t alias);
+const char* mqtt_alias_inbound(const char* topic, size_t length, uint16_t alias);
+
+void mqtt_alias_get_info(JsonDocument& doc);
+
+#endif
@@ -0,0 +1,513 @@
+/* MIT License - Copyright (c) 2019-2024 Francis Van Roie
+   For full license information read the LICENSE file in the project folder */
+
+/* Data bindings subscribe objects directly to an MQTT topic:
+ *   "bind":"zigbee2mqtt/livingroom"
+ *   "bind":{"topic":"zigbee2mqtt/livingroom","field":"temperature","attr":"text","format":"%.1f °C"}
+ *   "bind":{"topic":"sensors/power","attr":"val","map":[0,3000,0,100]}
+ * Incoming messages are looked up in a topic index and written to the bound attributes, without a round trip through
+ * the home automation server. */
+
+#include <cmath>
+
+#include "hasplib.h"
+
+#if HASP_USE_MQTT > 0
+
+#include "hasp_mqtt.h"
+#include "hasp_mqtt_binding.h"
+
+enum binding_format_type_t {
+    BINDING_FORMAT_NONE = 0,
+    BINDING_FORMAT_INT,
+    BINDING_FORMAT_FLOAT,
+    BINDING_FORMAT_STR,
+};
+
+typedef struct mqtt_binding_topic_t
+{
+    struct mqtt_binding_topic_t* next; // next topic in the same bucket or in the wildcard list
+    const char* topic;                 // interned string
+    mqtt_binding_t* bindings;          // objects bound to this topic
+    uint32_t hash;
+    uint16_t count;  // bindings on this topic
+    uint16_t fields; // bindings that need the payload parsed as json
+    bool subscribed; // false while a bound wildcard filter already receives the messages of this topic
+} mqtt_binding_topic_t;
+
+struct mqtt_binding_t
+{
+    mqtt_binding_t* next;        // next binding on the same topic
+    mqtt_binding_topic_t* entry; // topic index entry
+    lv_obj_t* obj;
+    const char* spec;   // interned json, returned by the getter
+    const char* field;  // interned path of keys separated by dots, NULL uses the whole payload
+    const char* attr;   // interned attribute name
+    const char* format; // interned printf template, NULL writes the value as-is
+    float map[4];       // in_min, in_max, out_min, out_max
+    uint8_t format_type;
+    bool has_map;
+};
+
+static mqtt_binding_topic_t* binding_buckets[HASP_BINDING_BUCKETS];
+static mqtt_binding_topic_t* binding_wildcards; // filters with + or # can't be hashed and are matched one by one
+static mqtt_binding_stats_t binding_stats;
+
+static uint32_t binding_hash(const char* str)
+{
+    uint32_t hash = 2166136261u; // FNV-1a
+    while(*str) hash = (hash ^ (uint8_t)*str++) * 16777619u;
+    return hash;
+}
+
+static inline bool binding_is_wildcard(const char* topic)
+{
+    return strchr(topic, '+') || strchr(topic, '#');
+}
+
+// MQTT topic filter matching, + matches one level and # all remaining levels
+static bool binding_topic_matches(const char* filter, const char* topic)
+{
+    while(*filter) {
+        if(*filter == '#') return true;
+        if(*filter == '+') {
+            while(*topic && *topic != '/') topic++;
+            filter++;
+        } else {
+            if(*filter != *topic) return false;
+            filter++;
+            topic++;
+        }
+    }
+    return *topic == '\0';
+}
+
+static mqtt_binding_topic_t* binding_find_topic(const char* topic, uint32_t hash)
+{
+    for(mqtt_binding_topic_t* entry = binding_buckets[hash & (HASP_BINDING_BUCKETS - 1)]; entry; entry = entry->next) {
+        if(entry->hash == hash && !strcmp(entry->topic, topic)) return entry;
+    }
+    return NULL;
+}
+
+static mqtt_binding_topic_t** binding_topic_list(const char* topic, uint32_t hash)
+{
+    return binding_is_wildcard(topic) ? &binding_wildcards : &binding_buckets[hash & (HASP_BINDING_BUCKETS - 1)];
+}
+
+// A filter is covered when another bound wildcard filter receives all of its messages, subscribing both would make
+// the broker deliver every message twice. Filters ending in # are always subscribed.
+static bool binding_is_covered(const mqtt_binding_topic_t* entry)
+{
+    if(strchr(entry->topic, '#')) return false;
+
+    for(const mqtt_binding_topic_t* wildcard = binding_wildcards; wildcard; wildcard = wildcard->next) {
+        if(wildcard != entry && binding_topic_matches(wildcard->topic, entry->topic)) return true;
+    }
+    return false;
+}
+
+static void binding_set_subscribed(mqtt_binding_topic_t* entry, bool subscribed)
+{
+    if(entry->subscribed == subscribed) return;
+    entry->subscribed = subscribed;
+
+    if(!mqttIsConnected()) return; // mqtt_binding_subscribe_all() runs after connecting
+    if(subscribed)
+        mqttSubscribe(entry->topic);
+    else
+        mqttUnsubscribe(entry->topic);
+}
+
+// Update the broker subscriptions after a wildcard filter was added or removed
+static void binding_sync_subscriptions()
+{
+    // Subscribe the uncovered filters first so no message is lost while a wider filter is replaced
+    for(uint8_t pass = 0; pass < 2; pass++) {
+        const bool subscribe = pass == 0;
+
+        for(uint16_t i = 0; i <= HASP_BINDING_BUCKETS; i++) {
+            mqtt_binding_topic_t* entry = i < HASP_BINDING_BUCKETS ? binding_buckets[i] : binding_wildcards;
+            for(; entry; entry = entry->next) {
+                if(binding_is_covered(entry) != subscribe) binding_set_subscribed(entry, subscribe);
+            }
+        }
+    }
+}
+
+// Find or create the index entry of a topic, a new topic is subscribed unless a bound wildcard filter covers it
+static mqtt_binding_topic_t* binding_get_topic(const char* topic)
+{
+    uint32_t hash                = binding_hash(topic);
+    mqtt_binding_topic_t** chain = binding_topic_list(topic, hash);
+
+    for(mqtt_binding_topic_t* entry = *chain; entry; entry = entry->next) {
+        if(entry->hash == hash && !strcmp(entry->topic, topic)) return entry;
+    }
+
+    mqtt_binding_topic_t* entry = (mqtt_binding_topic_t*)hasp_calloc(1, sizeof(mqtt_binding_topic_t));
+    if(!entry) return NULL;
+
+    entry->topic = hasp_str_intern(topic);
+    if(!entry->topic) {
+        hasp_free(entry);
+        return NULL;
+    }
+    entry->hash = hash;
+    entry->next = *chain;
+    *chain      = entry;
+    binding_stats.topics++;
+
+    if(binding_is_wildcard(entry->topic))
+        binding_sync_subscriptions(); // topics inside the new filter no longer need their own subscription
+    else
+        binding_set_subscribed(entry, !binding_is_covered(entry));
+    return entry;
+}
+
+static void binding_release_topic(mqtt_binding_topic_t* entry)
+{
+    mqtt_binding_topic_t** link = binding_topic_list(entry->topic, entry->hash);
+    while(*link && *link != entry) link = &(*link)->next;
+    if(*link) *link = entry->next;
+
+    // Topics that were covered by this filter need their own subscription before it is dropped
+    if(binding_is_wildcard(entry->topic)) binding_sync_subscriptions();
+    binding_set_subscribed(entry, false);
+    binding_stats.topics--;
+
+    hasp_str_release(entry->topic);
+    hasp_free(entry);
+}
+
+/**
+ * Get the argument type of a printf template, it must contain exactly one conversion so a value of the wrong type is
+ * never passed to snprintf
+ */
+static uint8_t binding_format_type(const char* format)
+{
+    uint8_t type = BINDING_FORMAT_NONE;
+
+    for(const char* p = format; *p; p++) {
+        if(*p != '%') continue;
+        if(*++p == '%') continue; // literal percent sign
+        if(type != BINDING_FORMAT_NONE) return BINDING_FORMAT_NONE; // only one value is available
+
+        while(*p && strchr("-+ #0", *p)) p++; // flags
+        while(isdigit(*p)) p++;               // width
+        if(*p == '.') {
+            p++;
+            while(isdigit(*p)) p++; // precision
+        }
+
+        if(*p == '\0') return BINDING_FORMAT_NONE;
+        if(strchr("diuoxX", *p))
+            type = BINDING_FORMAT_INT;
+        else if(strchr("fFeEgG", *p))
+            type = BINDING_FORMAT_FLOAT;
+        else if(*p == 's')
+            type = BINDING_FORMAT_STR;
+        else
+            return BINDING_FORMAT_NONE; // length modifiers and other conversions are not supported
+    }
+
+    return type;
+}
+
+// serialize the json document and store it in the string arena
+static const char* binding_intern_json(JsonDocument& doc)
+{
+    const size_t size = measureJson(doc) + 1;
+    char* buffer      = (char*)lv_mem_buf_get(size);
+    if(!buffer) return NULL;
+
+    serializeJson(doc, buffer, size);
+    const char* str = hasp_str_intern(buffer);
+    lv_mem_buf_release(buffer);
+    return str;
+}
+
+static void binding_release_strings(mqtt_binding_t* binding)
+{
+    hasp_str_release(binding->spec);
+    hasp_str_release(binding->field);
+    hasp_str_release(binding->attr);
+    hasp_str_release(binding->format);
+}
+
+/**
+ * Parse a binding and add the object to the topic index
+ * @param obj the object to update
+ * @param payload a topic or a json object with the topic, field, attr, format and map keys
+ * @return the new binding or NULL if the payload is invalid
+ */
+mqtt_binding_t* mqtt_binding_create(lv_obj_t* obj, const char* payload)
+{
+    StaticJsonDocument<512> doc;
+    DeserializationError res = deserializeJson(doc, payload);
+    if(res != DeserializationError::Ok) doc.set(payload); // use the payload as the topic
+
+    JsonVariantConst spec = doc.as<JsonVariantConst>();
+    const char* topic     = spec.is<const char*>() ? spec.as<const char*>() : spec["topic"].as<const char*>();
+    const char* field     = spec["field"].as<const char*>();
+    const char* attr      = spec["attr"] | "text";
+    const char* format    = spec["format"].as<const char*>();
+    JsonArrayConst map    = spec["map"].as<JsonArrayConst>();
+
+    if(!topic || !*topic) {
+        LOG_WARNING(TAG_MQTT, F("Binding has no topic"));
+        return NULL;
+    }
+
+    // Methods that delete or rebind objects would invalidate the index while a message is applied
+    uint16_t attr_hash = Parser::get_sdbm(attr);
+    if(attr_hash == ATTR_BIND || attr_hash == ATTR_DELETE || attr_hash == ATTR_CLEAR || attr_hash == ATTR_JSONL) {
+        LOG_WARNING(TAG_MQTT, F("Attribute %s can't be bound"), attr);
+        return NULL;
+    }
+
+    uint8_t format_type = format ? binding_format_type(format) : BINDING_FORMAT_NONE;
+    if(format && format_type == BINDING_FORMAT_NONE) {
+        LOG_WARNING(TAG_MQTT, F("Invalid binding format %s"), format);
+        return NULL;
+    }
+
+    if(!map.isNull() && map.size() != 4) {
+        LOG_WARNING(TAG_MQTT, F("Binding map needs [in_min,in_max,out_min,out_max]"));
+        return NULL;
+    }
+
+    mqtt_binding_t* binding = (mqtt_binding_t*)hasp_calloc(1, sizeof(mqtt_binding_t));
+    if(!binding) return NULL;
+
+    binding->obj         = obj;
+    binding->format_type = format_type;
+    binding->has_map     = !map.isNull();
+    for(uint8_t i = 0; binding->has_map && i < 4; i++) binding->map[i] = map[i].as<float>();
+
+    binding->spec   = binding_intern_json(doc);
+    binding->attr   = hasp_str_intern(attr);
+    binding->field  = field && *field ? hasp_str_intern(field) : NULL;
+    binding->format = format ? hasp_str_intern(format) : NULL;
+    binding->entry  = binding_get_topic(topic);
+
+    if(!binding->spec || !binding->attr || (field && *field && !binding->field) || (format && !binding->format) ||
+       !binding->entry) {
+        LOG_WARNING(TAG_MQTT, D_ERROR_OUT_OF_MEMORY);
+        binding_release_strings(binding);
+        if(binding->entry && binding->entry->count == 0) binding_release_topic(binding->entry);
+        hasp_free(binding);
+        return NULL;
+    }
+
+    mqtt_binding_topic_t* entry = binding->entry;
+    binding->next               = entry->bindings;
+    entry->bindings             = binding;
+    entry->count++;
+    if(binding->field) entry->fields++;
+    binding_stats.bindings++;
+
+    LOG_VERBOSE(TAG_MQTT, F("Bound %s to %s"), binding->attr, entry->topic);
+    return binding;
+}
+
+/**
+ * Remove a binding from the topic index, the topic is unsubscribed when no other object uses it and topics covered
+ * by a removed wildcard filter are subscribed again
+ */
+void mqtt_binding_free(mqtt_binding_t* binding)
+{
+    if(!binding) return;
+
+    mqtt_binding_topic_t* entry = binding->entry;
+    mqtt_binding_t** link       = &entry->bindings;
+    while(*link && *link != binding) link = &(*link)->next;
+    if(*link) *link = binding->next;
+
+    if(binding->field) entry->fields--;
+    binding_stats.bindings--;
+    if(--entry->count == 0) binding_release_topic(entry);
+
+    binding_release_strings(binding);
+    hasp_free(binding);
+}
+
+const char* mqtt_binding_get_spec(const mqtt_binding_t* binding)
+{
+    return binding ? binding->spec : NULL;
+}
+
+// Walk a path of keys separated by dots, numeric keys index into arrays
+static JsonVariantConst binding_get_field(JsonVariantConst json, const char* path)
+{
+    char key[64];
+
+    while(*path && !json.isNull()) {
+        const char* end = strchr(path, '.');
+        size_t len      = end ? (size_t)(end - path) : strlen(path);
+        if(len >= sizeof(key)) return JsonVariantConst();
+
+        memcpy(key, path, len);
+        key[len] = '\0';
+
+        if(json.is<JsonArrayConst>() && Parser::is_only_digits(key))
+            json = json[atoi(key)];
+        else
+            json = json[key];
+
+        path += len;
+        if(*path == '.') path++;
+    }
+
+    return json;
+}
+
+// Convert the message to the attribute value and write it
+static void binding_apply(const mqtt_binding_t* binding, const char* payload, JsonVariantConst json)
+{
+    char source[64];
+    char value[128];
+    const char* text = payload;
+    double number    = 0;
+    bool is_number   = false;
+
+    if(binding->field) {
+        JsonVariantConst field = binding_get_field(json, binding->field);
+        if(field.isNull()) {
+            binding_stats.skipped++;
+            return;
+        }
+
+        if(field.is<const char*>()) {
+            text = field.as<const char*>();
+        } else {
+            is_number = field.is<bool>() || field.is<double>();
+            number    = field.is<bool>() ? (field.as<bool>() ? 1 : 0) : field.as<double>();
+            serializeJson(field, source, sizeof(source));
+            text = source;
+        }
+    }
+
+    // The mapping and numeric templates need a number
+    if(!is_number && (binding->has_map || binding->format_type == BINDING_FORMAT_INT ||
+                      binding->format_type == BINDING_FORMAT_FLOAT)) {
+        char* end;
+        number = strtod(text, &end);
+        if(end == text) {
+            LOG_WARNING(TAG_MQTT, F("Binding %s expects a number"), binding->entry->topic);
+            binding_stats.skipped++;
+            return;
+        }
+        is_number = true;
+    }
+
+    if(binding->has_map) {
+        const float* m = binding->map;
+        if(m[1] != m[0]) number = m[2] + (number - m[0]) * (m[3] - m[2]) / (m[1] - m[0]);
+        snprintf_P(source, sizeof(source), PSTR("%ld"), lround(number));
+        text = source;
+    }
+
+    switch(binding->format_type) {
+        case BINDING_FORMAT_INT:
+            snprintf(value, sizeof(value), binding->format, (int)lround(number));
+            text = value;
+            break;
+        case BINDING_FORMAT_FLOAT:
+            snprintf(value, sizeof(value), binding->format, number);
+            text = value;
+            break;
+        case BINDING_FORMAT_STR:
+            snprintf(value, sizeof(value), binding->format, text);
+            text = value;
+            break;
+        default:; // write the value as-is
+    }
+
+    hasp_process_obj_attribute(binding->obj, binding->attr, text, true);
+    binding_stats.updates++;
+}
+
+static void binding_apply_topic(const mqtt_binding_topic_t* entry, const char* payload, JsonVariantConst json)
+{
+    for(const mqtt_binding_t* binding = entry->bindings; binding; binding = binding->next)
+        binding_apply(binding, payload, json);
+}
+
+static void binding_apply_all(mqtt_binding_topic_t* exact, const char* topic, const char* payload,
+                              JsonVariantConst json)
+{
+    if(exact) binding_apply_topic(exact, payload, json);
+
+    for(mqtt_binding_topic_t* entry = binding_wildcards; entry; entry = entry->next) {
+        if(binding_topic_matches(entry->topic, topic)) binding_apply_topic(entry, payload, json);
+    }
+}
+
+/**
+ * Write an incoming message to all objects bound to its topic
+ * @param topic full topic of the message
+ * @param payload null terminated payload
+ * @param length length of the payload
+ * @return true if at least one object is bound to the topic
+ */
+bool mqtt_binding_process(const char* topic, const char* payload, size_t length)
+{
+    if(binding_stats.bindings == 0) return false;
+
+    mqtt_binding_topic_t* exact = binding_find_topic(topic, binding_hash(topic));
+    bool found                  = exact != NULL;
+    uint16_t fields             = exact ? exact->fields : 0;
+
+    for(mqtt_binding_topic_t* entry = binding_wildcards; entry; entry = entry->next) {
+        if(binding_topic_matches(entry->topic, topic)) {
+            found = true;
+            fields += entry->fields;
+        }
+    }
+    if(!found) return false;
+
+    uint32_t start = millis();
+    binding_stats.messages++;
+    hasp_attribute_begin(); // one refresh for all bound objects
+
+    if(fields > 0) { // parse the payload once for all bindings
+        size_t maxsize = (128u * ((length / 128) + 1)) + 512;
+        DynamicJsonDocument doc(maxsize);
+        DeserializationError jsonError = deserializeJson(doc, payload, length);
+        if(jsonError) LOG_WARNING(TAG_MQTT, F("Binding %s: %s"), topic, jsonError.c_str());
+        binding_apply_all(exact, topic, payload, doc.as<JsonVariantConst>());
+    } else {
+        binding_apply_all(exact, topic, payload, JsonVariantConst());
+    }
+
+    hasp_attribute_commit();
+    binding_stats.time += millis() - start;
+    return true;
+}
+
+/**
+ * Subscribe all bound topics again after (re)connecting, topics covered by a bound wildcard filter are skipped
+ */
+void mqtt_binding_subscribe_all()
+{
+    for(uint16_t i = 0; i < HASP_BINDING_BUCKETS; i++) {
+        for(mqtt_binding_topic_t* entry = binding_buckets[i]; entry; entry = entry->next)
+            if(entry->subscribed) mqttSubscribe(entry->topic);
+    }
+    for(mqtt_binding_topic_t* entry = binding_wildcards; entry; entry = entry->next)
+        if(entry->subscribed) mqttSubscribe(entry->topic);
+}
+
+void mqtt_binding_get_info(JsonDocument& doc)
+{
+    JsonObject info     = doc.createNestedObject(F("Data Bindings"));
+    info[F("topics")]   = binding_stats.topics;
+    info[F("bindings")] = binding_stats.bindings;
+    info[F("messages")] = binding_stats.messages;
+    info[F("updates")]  = binding_stats.updates;
+    info[F("skipped")]  = binding_stats.skipped;
+    info[F("time")]     = binding_stats.time;
+}
+
+#endif
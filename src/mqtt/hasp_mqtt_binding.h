@@ -0,0 +1,34 @@
+/* MIT License - Copyright (c) 2019-2024 Francis Van Roie
+   For full license information read the LICENSE file in the project folder */
+
+#ifndef HASP_MQTT_BINDING_H
+#define HASP_MQTT_BINDING_H
+
+#include "hasplib.h"
+
+#ifndef HASP_BINDING_BUCKETS
+#define HASP_BINDING_BUCKETS 32 // hash buckets of the topic index, must be a power of 2
+#endif
+
+typedef struct mqtt_binding_t mqtt_binding_t;
+
+typedef struct
+{
+    uint16_t topics;   // distinct topics subscribed
+    uint16_t bindings; // objects bound to a topic
+    uint32_t messages; // messages routed to bindings
+    uint32_t updates;  // attribute updates written
+    uint32_t skipped;  // bindings skipped because the value could not be converted
+    uint32_t time;     // ms spent applying messages
+} mqtt_binding_stats_t;
+
+mqtt_binding_t* mqtt_binding_create(lv_obj_t* obj, const char* payload);
+void mqtt_binding_free(mqtt_binding_t* binding);
+const char* mqtt_binding_get_spec(const mqtt_binding_t* binding);
+
+bool mqtt_binding_process(const char* topic, const char* payload, size_t length);
+void mqtt_binding_subscribe_all();
+
+void mqtt_binding_get_info(JsonDocument& doc);
+
+#endif
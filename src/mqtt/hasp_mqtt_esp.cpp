@@ -13,6 +13,9 @@
 #include "hasp/hasp.h"
 #include "hasp_mqtt.h"
 #include "hasp_mqtt_ha.h"
+#include "hasp_mqtt_binding.h"
+#include "hasp_mqtt_alias.h"
+#include "hasp_mqtt_outbox.h"
 
 #include "hal/hasp_hal.h"
 #include "hasp_debug.h"
@@ -35,6 +38,7 @@ typedef struct
 {
     char* topic;   //[64];
     char* payload; //[512];
+    bool binding;  // full topic bound to objects, not a command
 } mqtt_message_t;
 
 char mqttClientId[64];
@@ -49,6 +53,10 @@ bool mqttHAautodiscover = true;
 uint32_t mqttPublishCount;
 uint32_t mqttReceiveCount;
 uint32_t mqttFailedCount;
+static bool mqttBindingResubscribe = false; // bound topics are subscribed again from the gui thread
+#if HASP_USE_MQTT_V5 > 0 && defined(CONFIG_MQTT_PROTOCOL_5)
+static volatile bool mqttAliasReset = false; // topic aliases are cleared before the next publish
+#endif
 
 String mqttServer   = MQTT_HOSTNAME;
 String mqttUsername = MQTT_USERNAME;
@@ -122,6 +130,19 @@ int mqttPublish(const char* topic, const char* payload, size_t len, bool retain)
 {
     if(!mqttEnabled) return MQTT_ERR_DISABLED;
 
+#if HASP_USE_MQTT_V5 > 0 && defined(CONFIG_MQTT_PROTOCOL_5)
+    if(mqttAliasReset) {
+        mqttAliasReset = false;
+        mqtt_alias_reset(HASP_MQTT_ALIAS_MAX); // the broker maximum is not exposed by esp_mqtt
+    }
+
+    bool known;
+    esp_mqtt5_publish_property_config_t property = {};
+    property.topic_alias                         = mqtt_alias_outbound(topic, known);
+    esp_mqtt5_client_set_publish_property(mqttClient, &property);
+    if(known) topic = ""; // the broker already maps the alias to the topic
+#endif
+
     // Write directly to the client, don't use the buffer
     if(current_mqtt_state && esp_mqtt_client_publish(mqttClient, topic, payload, len, mqttQos, retain) != ESP_FAIL) {
 
@@ -132,6 +153,9 @@ int mqttPublish(const char* topic, const char* payload, size_t len, bool retain)
         return MQTT_ERR_OK;
     }
 
+#if HASP_USE_MQTT_V5 > 0 && defined(CONFIG_MQTT_PROTOCOL_5)
+    mqtt_alias_forget(property.topic_alias); // the broker may not have seen the alias
+#endif
     mqttFailedCount++;
     return current_mqtt_state ? MQTT_ERR_PUB_FAIL : MQTT_ERR_NO_CONN;
 }
@@ -174,7 +198,13 @@ int mqtt_send_state(const char* subtopic, const char* payload)
     // tmp_topic += "/";
     tmp_topic += subtopic;
 
-    return mqttPublish(tmp_topic.c_str(), payload, false);
+    // Keep the order of the messages while the outbox is not empty
+    size_t len = strlen(payload);
+    if(!mqtt_outbox_is_empty() && mqtt_outbox_push(tmp_topic.c_str(), payload, len)) return MQTT_ERR_QUEUED;
+
+    int rc = mqttPublish(tmp_topic.c_str(), payload, len, false);
+    if(rc == MQTT_ERR_NO_CONN && mqtt_outbox_push(tmp_topic.c_str(), payload, len)) return MQTT_ERR_QUEUED;
+    return rc;
 }
 
 int mqtt_send_discovery(const char* payload, size_t len)
@@ -190,10 +220,11 @@ static inline size_t mqtt_msg_length(size_t len)
     return (len / 64) * 64 + 64;
 }
 
-void mqtt_enqueue_message(const char* topic, const char* payload, size_t payload_len)
+void mqtt_enqueue_message(const char* topic, const char* payload, size_t payload_len, bool binding = false)
 {
     // Add new message to the queue
     mqtt_message_t data;
+    data.binding = binding;
 
     size_t topic_len = strlen(topic);
     data.topic       = (char*)hasp_calloc(sizeof(char), mqtt_msg_length(topic_len + 1));
@@ -232,6 +263,20 @@ void mqtt_process_topic_payload(const char* topic, const char* payload, unsigned
     }
 }
 
+void mqtt_process_binding_payload(const char* topic, const char* payload, unsigned int length)
+{
+    if(gui_acquire(pdMS_TO_TICKS(30))) {
+        mqttLoop(); // First empty the MQTT queue
+        LOG_TRACE(TAG_MQTT_RCV, F("%s = %s"), topic, payload);
+        if(!mqtt_binding_process(topic, payload, length)) {
+            LOG_ERROR(TAG_MQTT, F(D_MQTT_INVALID_TOPIC ": %s"), topic); // Other topic
+        }
+        gui_release();
+    } else {
+        mqtt_enqueue_message(topic, payload, length, true);
+    }
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 // Receive incoming messages
 static void mqtt_message_cb(const char* topic, byte* payload, unsigned int length)
@@ -265,7 +310,7 @@ static void mqtt_message_cb(const char* topic, byte* payload, unsigned int lengt
         return;
 
     } else {
-        LOG_ERROR(TAG_MQTT, F(D_MQTT_INVALID_TOPIC ": %s"), topic); // Other topic
+        mqtt_process_binding_payload(topic, (const char*)payload, length); // Topic bound to objects or invalid
         return;
     }
 
@@ -320,6 +365,24 @@ static int mqttSubscribeTo(String topic)
     return err;
 }
 
+int mqttSubscribe(const char* topic)
+{
+    if(!mqttIsConnected()) return MQTT_ERR_NO_CONN;
+    return mqttSubscribeTo(topic) == ESP_FAIL ? MQTT_ERR_SUB_FAIL : MQTT_ERR_OK;
+}
+
+int mqttUnsubscribe(const char* topic)
+{
+    if(!mqttIsConnected()) return MQTT_ERR_NO_CONN;
+
+    if(esp_mqtt_client_unsubscribe(mqttClient, topic) == ESP_FAIL) {
+        mqttFailedCount++;
+        return MQTT_ERR_SUB_FAIL;
+    }
+    LOG_VERBOSE(TAG_MQTT, F(D_BULLET "Unsubscribed from %s"), topic);
+    return MQTT_ERR_OK;
+}
+
 /*
 String mqttGetTopic(Preferences preferences, String subtopic, String key, String value, bool add_slash)
 {
@@ -389,6 +452,7 @@ void onMqttConnect(esp_mqtt_client_handle_t client)
 #endif
 
     mqttSubscribeTo(mqttHassLwtTopic);
+    mqttBindingResubscribe = true; // topics bound to objects
 
     // Force any subscribed clients to toggle offline/online when we first connect to
     // make sure we get a full panel refresh at power on.  Sending offline,
@@ -436,6 +500,9 @@ static esp_err_t mqtt_event_handler(esp_mqtt_event_handle_t event)
         case MQTT_EVENT_CONNECTED:
             LOG_INFO(TAG_MQTT, F(D_SERVICE_STARTED));
             mqtt_connected();
+#if HASP_USE_MQTT_V5 > 0 && defined(CONFIG_MQTT_PROTOCOL_5)
+            mqttAliasReset = true;
+#endif
             onMqttConnect(event->client);
             break;
         case MQTT_EVENT_SUBSCRIBED:
@@ -496,13 +563,23 @@ IRAM_ATTR void mqttLoop(void)
 {
     // mqttClient.loop();
 
+    if(mqttBindingResubscribe) {
+        mqttBindingResubscribe = false;
+        mqtt_binding_subscribe_all();
+    }
+
+    if(current_mqtt_state && !mqtt_outbox_is_empty()) mqtt_outbox_drain(HASP_MQTT_OUTBOX_RATE);
+
     if(!uxQueueMessagesWaiting(queue)) return;
 
     mqtt_message_t data;
     while(xQueueReceive(queue, &data, (TickType_t)0)) {
         LOG_WARNING(TAG_MQTT, F("[%d] QUE %s => %s"), uxQueueMessagesWaiting(queue), data.topic, data.payload);
         size_t length = strlen(data.payload);
-        dispatch_topic_payload(data.topic, data.payload, length > 0, TAG_MQTT);
+        if(data.binding)
+            mqtt_binding_process(data.topic, data.payload, length);
+        else
+            dispatch_topic_payload(data.topic, data.payload, length > 0, TAG_MQTT);
         hasp_free(data.topic);
         hasp_free(data.payload);
         // delay(1);
@@ -589,7 +666,11 @@ void mqttStart()
     mqtt_cfg.keepalive              = 15; /* seconds */
     mqtt_cfg.disable_clean_session  = true;
 
+#if HASP_USE_MQTT_V5 > 0 && defined(CONFIG_MQTT_PROTOCOL_5)
+    mqtt_cfg.protocol_ver = MQTT_PROTOCOL_V_5;
+#else
     mqtt_cfg.protocol_ver = MQTT_PROTOCOL_V_3_1_1;
+#endif
     mqtt_cfg.transport    = MQTT_TRANSPORT_OVER_TCP;
     mqtt_cfg.host         = mqttServer.c_str();
     mqtt_cfg.port         = mqttPort;
@@ -693,6 +774,11 @@ void mqtt_get_info(JsonDocument& doc)
     info[F(D_INFO_RECEIVED)]  = mqttReceiveCount;
     info[F(D_INFO_PUBLISHED)] = mqttPublishCount;
     info[F(D_INFO_FAILED)]    = mqttFailedCount;
+
+#if HASP_USE_MQTT_V5 > 0 && defined(CONFIG_MQTT_PROTOCOL_5)
+    mqtt_alias_get_info(doc);
+#endif
+    mqtt_outbox_get_info(doc);
 }
 
 #if HASP_USE_CONFIG > 0
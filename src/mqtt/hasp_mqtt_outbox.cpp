@@ -0,0 +1,221 @@
+/* MIT License - Copyright (c) 2019-2024 Francis Van Roie
+   For full license information read the LICENSE file in the project folder */
+
+/* Outbox for state messages published while the broker is unreachable
+ * Messages are kept in a ring buffer, the oldest message is dropped when it is full. A value or state replaces the
+ * queued message of the same topic and moves to the end, button events are all kept. After a reconnect the messages
+ * are published in order, a few per loop, with their age in ms added to json payloads.
+ *
+ * The mqtt task queues states on connect while the gui loop drains the outbox, so the ring buffer is locked. The lock
+ * is not held while publishing, the client may be waiting for the mqtt task. */
+
+#include "hasplib.h"
+
+#if HASP_USE_MQTT > 0
+
+#include "hasp_mqtt.h"
+#include "hasp_mqtt_outbox.h"
+
+#if defined(ARDUINO_ARCH_ESP8266)
+#define OUTBOX_LOCK() // single threaded
+#else
+#include <mutex>
+static std::mutex outbox_mtx;
+#define OUTBOX_LOCK() std::lock_guard<std::mutex> lock(outbox_mtx)
+#endif
+
+#define OUTBOX_AGE_SIZE 24 // room after a json payload for ,"age":4294967295}
+
+typedef struct
+{
+    char* topic;
+    char* payload; // json payloads have OUTBOX_AGE_SIZE spare bytes to add the age without a copy
+    uint32_t time; // millis() when queued
+    uint16_t len;
+    bool state; // superseded by a newer message on the same topic
+    bool json;  // payload is a json object
+} mqtt_outbox_msg_t;
+
+static mqtt_outbox_msg_t* outbox; // ring buffer, allocated when the first message is queued
+static uint16_t outbox_head;      // oldest message
+static mqtt_outbox_stats_t outbox_stats;
+
+static char* outbox_strdup(const char* str, size_t len, size_t spare = 0)
+{
+    char* copy = (char*)hasp_malloc(len + 1 + spare);
+    if(copy) {
+        memcpy(copy, str, len);
+        copy[len] = '\0';
+    }
+    return copy;
+}
+
+static void outbox_free(mqtt_outbox_msg_t* msg)
+{
+    hasp_free(msg->topic);
+    hasp_free(msg->payload);
+    msg->topic   = NULL;
+    msg->payload = NULL;
+}
+
+// Every button event must be delivered, for values and other states only the latest one matters
+static bool outbox_is_state(const char* payload)
+{
+    return !strstr(payload, "\"event\":") || strstr(payload, "\"event\":\"changed\"");
+}
+
+static bool outbox_is_json(const char* payload, size_t len)
+{
+    return len > 2 && payload[len - 1] == '}';
+}
+
+#if HASP_MQTT_OUTBOX_SIZE > 0
+static mqtt_outbox_msg_t* outbox_at(uint16_t index)
+{
+    return &outbox[(outbox_head + index) % HASP_MQTT_OUTBOX_SIZE];
+}
+
+// Free a queued message and close the gap, the messages after it keep their order
+static void outbox_remove(uint16_t index)
+{
+    outbox_free(outbox_at(index));
+    if(index == 0) {
+        outbox_head = (outbox_head + 1) % HASP_MQTT_OUTBOX_SIZE;
+    } else {
+        for(uint16_t i = index + 1; i < outbox_stats.depth; i++) *outbox_at(i - 1) = *outbox_at(i);
+        memset(outbox_at(outbox_stats.depth - 1), 0, sizeof(mqtt_outbox_msg_t));
+    }
+    outbox_stats.depth--;
+}
+#endif
+
+/**
+ * Keep a message to publish after the reconnect
+ * @param topic full topic
+ * @param payload message
+ * @param len length of the message
+ * @return true if the message was queued
+ */
+bool mqtt_outbox_push(const char* topic, const char* payload, size_t len)
+{
+#if HASP_MQTT_OUTBOX_SIZE > 0
+    if(len > UINT16_MAX) return false;
+
+    OUTBOX_LOCK();
+    if(!outbox) {
+        outbox = (mqtt_outbox_msg_t*)hasp_calloc(HASP_MQTT_OUTBOX_SIZE, sizeof(mqtt_outbox_msg_t));
+        if(!outbox) return false;
+    }
+
+    bool state     = outbox_is_state(payload);
+    bool json      = outbox_is_json(payload, len);
+    bool collapsed = false;
+    if(state) { // the new state is published after the events queued since the old one
+        for(uint16_t i = 0; i < outbox_stats.depth; i++) {
+            mqtt_outbox_msg_t* msg = outbox_at(i);
+            if(!msg->state || strcmp(msg->topic, topic)) continue;
+
+            outbox_remove(i);
+            collapsed = true;
+            break;
+        }
+    }
+
+    if(outbox_stats.depth == HASP_MQTT_OUTBOX_SIZE) { // full, drop the oldest message
+        outbox_remove(0);
+        outbox_stats.dropped++;
+    }
+
+    mqtt_outbox_msg_t* msg = outbox_at(outbox_stats.depth);
+    msg->topic             = outbox_strdup(topic, strlen(topic));
+    msg->payload           = outbox_strdup(payload, len, json ? OUTBOX_AGE_SIZE : 0);
+    if(!msg->topic || !msg->payload) {
+        outbox_free(msg);
+        if(collapsed) outbox_stats.dropped++; // the old state is gone too
+        return false;
+    }
+    msg->len   = len;
+    msg->time  = millis();
+    msg->state = state;
+    msg->json  = json;
+
+    outbox_stats.depth++;
+    if(collapsed)
+        outbox_stats.collapsed++;
+    else
+        outbox_stats.queued++;
+    if(outbox_stats.depth > outbox_stats.peak) outbox_stats.peak = outbox_stats.depth;
+    return true;
+#else
+    return false;
+#endif
+}
+
+/**
+ * Publish queued messages, oldest first
+ * @param count maximum number of messages to publish
+ * @return true if the outbox is empty
+ */
+bool mqtt_outbox_drain(uint16_t count)
+{
+#if HASP_MQTT_OUTBOX_SIZE > 0
+    while(count-- > 0) {
+        mqtt_outbox_msg_t msg;
+        {
+            OUTBOX_LOCK();
+            if(outbox_stats.depth == 0) break;
+
+            msg = outbox[outbox_head]; // take the message out while it is being published
+            memset(&outbox[outbox_head], 0, sizeof(mqtt_outbox_msg_t));
+            outbox_head = (outbox_head + 1) % HASP_MQTT_OUTBOX_SIZE;
+            outbox_stats.depth--;
+        }
+
+        size_t len = msg.len;
+        if(msg.json) { // replace the closing bracket, a retry writes the age at the same place again
+            len--;
+            len += snprintf_P(msg.payload + len, OUTBOX_AGE_SIZE + 1, PSTR(",\"age\":%u}"),
+                              (uint32_t)(millis() - msg.time));
+        }
+
+        bool sent = mqttPublish(msg.topic, msg.payload, len, false) == MQTT_ERR_OK;
+
+        OUTBOX_LOCK();
+        if(sent) {
+            outbox_free(&msg);
+            outbox_stats.sent++;
+        } else if(outbox_stats.depth < HASP_MQTT_OUTBOX_SIZE) { // put it back in front and try again later
+            outbox_head         = (outbox_head + HASP_MQTT_OUTBOX_SIZE - 1) % HASP_MQTT_OUTBOX_SIZE;
+            outbox[outbox_head] = msg;
+            outbox_stats.depth++;
+            break;
+        } else { // filled up while publishing
+            outbox_free(&msg);
+            outbox_stats.dropped++;
+            break;
+        }
+    }
+#endif
+    return mqtt_outbox_is_empty();
+}
+
+bool mqtt_outbox_is_empty()
+{
+    OUTBOX_LOCK();
+    return outbox_stats.depth == 0;
+}
+
+void mqtt_outbox_get_info(JsonDocument& doc)
+{
+    OUTBOX_LOCK();
+    JsonObject info      = doc.createNestedObject(F("MQTT Outbox"));
+    info[F("depth")]     = outbox_stats.depth;
+    info[F("peak")]      = outbox_stats.peak;
+    info[F("queued")]    = outbox_stats.queued;
+    info[F("collapsed")] = outbox_stats.collapsed;
+    info[F("dropped")]   = outbox_stats.dropped;
+    info[F("sent")]      = outbox_stats.sent;
+    if(outbox_stats.depth > 0) info[F("oldest")] = millis() - outbox[outbox_head].time;
+}
+
+#endif
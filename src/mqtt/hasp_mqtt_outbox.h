@@ -0,0 +1,33 @@
+/* MIT License - Copyright (c) 2019-2024 Francis Van Roie
+   For full license information read the LICENSE file in the project folder */
+
+#ifndef HASP_MQTT_OUTBOX_H
+#define HASP_MQTT_OUTBOX_H
+
+#include "hasplib.h"
+
+#ifndef HASP_MQTT_OUTBOX_SIZE
+#define HASP_MQTT_OUTBOX_SIZE 32 // state messages kept while disconnected, 0 disables the outbox
+#endif
+
+#ifndef HASP_MQTT_OUTBOX_RATE
+#define HASP_MQTT_OUTBOX_RATE 4 // queued messages published per loop after a reconnect
+#endif
+
+typedef struct
+{
+    uint16_t depth;     // messages waiting
+    uint16_t peak;      // highest depth
+    uint32_t queued;    // messages added
+    uint32_t collapsed; // messages that replaced an older state of the same topic
+    uint32_t dropped;   // oldest messages overwritten because the outbox was full
+    uint32_t sent;      // messages published after a reconnect
+} mqtt_outbox_stats_t;
+
+bool mqtt_outbox_push(const char* topic, const char* payload, size_t len);
+bool mqtt_outbox_drain(uint16_t count);
+bool mqtt_outbox_is_empty();
+
+void mqtt_outbox_get_info(JsonDocument& doc);
+
+#endif
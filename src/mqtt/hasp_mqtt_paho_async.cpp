@@ -45,6 +45,9 @@ const char FP_CONFIG_GROUP[] PROGMEM = "group";
 #include "MQTTAsync.h"
 
 #include "hasp_mqtt.h" // functions to implement here
+#include "hasp_mqtt_binding.h"
+#include "hasp_mqtt_alias.h"
+#include "hasp_mqtt_outbox.h"
 
 #include "hasp/hasp_dispatch.h" // for dispatch_topic_payload
 #include "hasp_debug.h" // for logging
@@ -65,6 +68,10 @@ const char FP_CONFIG_GROUP[] PROGMEM = "group";
 #define QOS 1
 #define TIMEOUT 10000L
 
+#ifndef HASP_MQTT_QUEUE_SIZE
+#define HASP_MQTT_QUEUE_SIZE 32 // incoming messages waiting for the gui thread
+#endif
+
 std::string mqttNodeTopic;
 std::string mqttGroupTopic;
 std::string mqttLwtTopic;
@@ -76,6 +83,20 @@ uint32_t mqttFailedCount;
 
 std::recursive_mutex dispatch_mtx;
 std::recursive_mutex publish_mtx;
+static std::mutex queue_mtx; // protects the incoming message queue
+
+/* Incoming messages are queued by the paho thread and dispatched by the gui thread */
+typedef struct
+{
+    char* topic;
+    MQTTAsync_message* message;
+} mqtt_queued_message_t;
+
+static mqtt_queued_message_t mqtt_queue[HASP_MQTT_QUEUE_SIZE];
+static uint16_t mqtt_queue_head;
+static uint16_t mqtt_queue_count;
+static uint16_t mqttQueuePeak;
+static uint32_t mqttQueueFullCount;
 
 std::string mqttServer    = MQTT_HOSTNAME;
 std::string mqttUsername  = MQTT_USERNAME;
@@ -102,6 +123,18 @@ static void onConnectFailure(void* context, MQTTAsync_failureData* response)
     LOG_ERROR(TAG_MQTT, "Connection failed, return code %d (%s)", response->code, response->message);
 }
 
+#if HASP_USE_MQTT_V5 > 0
+static void onConnectFailure5(void* context, MQTTAsync_failureData5* response)
+{
+#if HASP_TARGET_PC
+    dispatch_run_script(NULL, "L:/offline.cmd", TAG_HASP);
+#endif
+    mqttConnecting = false;
+    mqttConnected  = false;
+    LOG_ERROR(TAG_MQTT, "Connection failed, reason code %d (%s)", response->reasonCode, response->message);
+}
+#endif
+
 static void onDisconnect(void* context, MQTTAsync_successData* response)
 {
 #if HASP_TARGET_PC
@@ -190,8 +223,11 @@ static void mqtt_message_cb(char* topic, char* payload, size_t length)
 #endif
 
     } else {
-        // Other topic
-        LOG_ERROR(TAG_MQTT, F(D_MQTT_INVALID_TOPIC));
+        // Topic bound to objects or other topic
+        dispatch_mtx.lock();
+        bool bound = mqtt_binding_process(topic, (const char*)payload, length);
+        dispatch_mtx.unlock();
+        if(!bound) LOG_ERROR(TAG_MQTT, F(D_MQTT_INVALID_TOPIC));
         return;
     }
 
@@ -214,17 +250,74 @@ static void mqtt_message_cb(char* topic, char* payload, size_t length)
     }
 }
 
+// Paho thread: hand the message over to the gui thread and return immediately
 static int mqtt_message_arrived(void* context, char* topicName, int topicLen, MQTTAsync_message* message)
 {
-    char msg[message->payloadlen + 1];
-    memcpy(msg, (char*)message->payload, message->payloadlen);
-    msg[message->payloadlen] = '\0';
+    std::lock_guard<std::mutex> lock(queue_mtx);
+
+    if(mqtt_queue_count >= HASP_MQTT_QUEUE_SIZE) {
+        mqttQueueFullCount++;
+        return 0; // not accepted, paho delivers the message again later
+    }
+
+    mqtt_queued_message_t* item = &mqtt_queue[(mqtt_queue_head + mqtt_queue_count) % HASP_MQTT_QUEUE_SIZE];
+    item->topic                 = topicName;
+    item->message               = message;
+    mqtt_queue_count++;
+    if(mqtt_queue_count > mqttQueuePeak) mqttQueuePeak = mqtt_queue_count;
+
+    return 1; // the gui thread frees the message
+}
+
+static bool mqtt_message_pop(mqtt_queued_message_t& item)
+{
+    std::lock_guard<std::mutex> lock(queue_mtx);
+    if(mqtt_queue_count == 0) return false;
+
+    item            = mqtt_queue[mqtt_queue_head];
+    mqtt_queue_head = (mqtt_queue_head + 1) % HASP_MQTT_QUEUE_SIZE;
+    mqtt_queue_count--;
+    return true;
+}
 
-    mqtt_message_cb(topicName, msg, message->payloadlen);
+// Gui thread: dispatch a queued message and free it
+static void mqtt_message_process(char* topicName, MQTTAsync_message* message)
+{
+    size_t length = message->payloadlen;
+    char* topic   = topicName;
+
+    dispatch_mtx.lock();
+#if HASP_USE_MQTT_V5 > 0
+    std::string resolved; // full topic of a message that only has an alias
+    if(MQTTProperties_hasProperty(&message->properties, MQTTPROPERTY_CODE_TOPIC_ALIAS)) {
+        int alias               = MQTTProperties_getNumericValue(&message->properties, MQTTPROPERTY_CODE_TOPIC_ALIAS);
+        size_t topic_length     = strlen(topicName);
+        const char* alias_topic = mqtt_alias_inbound(topicName, topic_length, alias);
+        if(topic_length == 0 && alias_topic) {
+            resolved = alias_topic;
+            topic    = &resolved[0];
+        } else if(topic_length == 0) {
+            LOG_WARNING(TAG_MQTT_RCV, F("Unknown topic alias %d"), alias);
+        }
+    }
+#endif
+
+    // The paho payload has no room for a terminating NUL, it is copied to the heap instead of the stack
+    if(length + 1 >= MQTT_MAX_PACKET_SIZE) {
+        mqttFailedCount++;
+        LOG_ERROR(TAG_MQTT_RCV, F(D_MQTT_PAYLOAD_TOO_LONG), (uint32_t)length);
+    } else if(char* payload = (char*)hasp_malloc(length + 1)) {
+        memcpy(payload, message->payload, length);
+        mqtt_message_cb(topic, payload, length);
+        hasp_free(payload);
+    } else {
+        mqttFailedCount++;
+        LOG_ERROR(TAG_MQTT_RCV, D_ERROR_OUT_OF_MEMORY);
+    }
+    dispatch_mtx.unlock();
 
     MQTTAsync_freeMessage(&message);
     MQTTAsync_free(topicName);
-    return 1; // the message was received properly
 }
 
 static void mqtt_subscribe(void* context, const char* topic)
@@ -242,6 +335,21 @@ static void mqtt_subscribe(void* context, const char* topic)
     }
 }
 
+static void mqtt_unsubscribe(void* context, const char* topic)
+{
+    MQTTAsync client               = (MQTTAsync)context;
+    MQTTAsync_responseOptions opts = MQTTAsync_responseOptions_initializer;
+    int rc;
+
+    opts.onFailure = onSubscribeFailure;
+    opts.context   = client;
+    if((rc = MQTTAsync_unsubscribe(client, topic, &opts)) != MQTTASYNC_SUCCESS) {
+        LOG_WARNING(TAG_MQTT, D_BULLET "Failed to unsubscribe from %s", topic); // error code rc
+    } else {
+        LOG_VERBOSE(TAG_MQTT, D_BULLET "Unsubscribed from %s", topic);
+    }
+}
+
 /* ===== Local HASP MQTT functions ===== */
 
 int mqttPublish(const char* topic, const char* payload, size_t len, bool retain)
@@ -264,7 +372,24 @@ int mqttPublish(const char* topic, const char* payload, size_t len, bool retain)
     pubmsg.retained   = 0;
 
     dispatch_mtx.lock();
+#if HASP_USE_MQTT_V5 > 0
+    bool known;
+    const char* full_topic = topic;
+    uint16_t alias         = mqtt_alias_outbound(topic, known);
+    if(alias) {
+        MQTTProperty property;
+        property.identifier     = MQTTPROPERTY_CODE_TOPIC_ALIAS;
+        property.value.integer2 = alias;
+        MQTTProperties_add(&pubmsg.properties, &property);
+        if(known) topic = ""; // the broker already maps the alias to the topic
+    }
+#endif
     int rc = MQTTAsync_sendMessage(mqtt_client, topic, &pubmsg, &opts);
+#if HASP_USE_MQTT_V5 > 0
+    MQTTProperties_free(&pubmsg.properties);
+    if(rc != MQTTASYNC_SUCCESS && alias) mqtt_alias_forget(alias); // the broker never saw the new alias
+    topic = full_topic;
+#endif
 
     if(rc != MQTTASYNC_SUCCESS) {
         dispatch_mtx.unlock();
@@ -281,6 +406,20 @@ int mqttPublish(const char* topic, const char* payload, size_t len, bool retain)
 
 /* ===== Public HASP MQTT functions ===== */
 
+int mqttSubscribe(const char* topic)
+{
+    if(!mqttIsConnected()) return MQTT_ERR_NO_CONN;
+    mqtt_subscribe(mqtt_client, topic);
+    return MQTT_ERR_OK;
+}
+
+int mqttUnsubscribe(const char* topic)
+{
+    if(!mqttIsConnected()) return MQTT_ERR_NO_CONN;
+    mqtt_unsubscribe(mqtt_client, topic);
+    return MQTT_ERR_OK;
+}
+
 bool mqttIsConnected()
 {
     return mqttConnected; // MQTTAsync_isConnected(mqtt_client); // <- deadlocking on Linux
@@ -290,7 +429,17 @@ int mqtt_send_state(const __FlashStringHelper* subtopic, const char* payload)
 {
     char tmp_topic[mqttNodeTopic.length() + 20];
     snprintf_P(tmp_topic, sizeof(tmp_topic), ("%s" MQTT_TOPIC_STATE "/%s"), mqttNodeTopic.c_str(), subtopic);
-    return mqttPublish(tmp_topic, payload, strlen(payload), false);
+    size_t len = strlen(payload);
+    int rc     = MQTT_ERR_QUEUED;
+
+    // Keep the order of the messages while the outbox is not empty
+    dispatch_mtx.lock();
+    if(mqtt_outbox_is_empty() || !mqtt_outbox_push(tmp_topic, payload, len)) {
+        rc = mqttPublish(tmp_topic, payload, len, false);
+        if(rc == MQTT_ERR_NO_CONN && mqtt_outbox_push(tmp_topic, payload, len)) rc = MQTT_ERR_QUEUED;
+    }
+    dispatch_mtx.unlock();
+    return rc;
 }
 
 int mqtt_send_discovery(const char* payload, size_t len)
@@ -349,6 +498,11 @@ static void onConnect(void* context, MQTTAsync_successData* response)
     mqtt_subscribe(mqtt_client, topic.c_str());
 #endif
 
+    /* Topics bound to objects */
+    dispatch_mtx.lock();
+    mqtt_binding_subscribe_all();
+    dispatch_mtx.unlock();
+
     mqttPublish(mqttLwtTopic.c_str(), "online", 6, true);
 
 #if HASP_TARGET_PC
@@ -356,15 +510,40 @@ static void onConnect(void* context, MQTTAsync_successData* response)
 #endif
 }
 
+#if HASP_USE_MQTT_V5 > 0
+static void onConnect5(void* context, MQTTAsync_successData5* response)
+{
+    int maximum = MQTTProperties_getNumericValue(&response->properties, MQTTPROPERTY_CODE_TOPIC_ALIAS_MAXIMUM);
+
+    dispatch_mtx.lock();
+    mqtt_alias_reset(maximum > 0 ? maximum : 0); // aliases are not kept across connections
+    dispatch_mtx.unlock();
+
+    onConnect(context, NULL);
+}
+#endif
+
 void mqttStart()
 {
+#if HASP_USE_MQTT_V5 > 0
+    MQTTAsync_connectOptions conn_opts  = MQTTAsync_connectOptions_initializer5;
+    MQTTAsync_createOptions create_opts = MQTTAsync_createOptions_initializer;
+    static MQTTProperties connect_props = MQTTProperties_initializer;
+#else
     MQTTAsync_connectOptions conn_opts = MQTTAsync_connectOptions_initializer;
-    MQTTAsync_willOptions will_opts    = MQTTAsync_willOptions_initializer;
+#endif
+    MQTTAsync_willOptions will_opts = MQTTAsync_willOptions_initializer;
     int rc;
     int ch;
 
+#if HASP_USE_MQTT_V5 > 0
+    create_opts.MQTTVersion = MQTTVERSION_5;
+    if((rc = MQTTAsync_createWithOptions(&mqtt_client, mqttServer.c_str(), haspDevice.get_hostname(),
+                                         MQTTCLIENT_PERSISTENCE_NONE, NULL, &create_opts)) != MQTTASYNC_SUCCESS) {
+#else
     if((rc = MQTTAsync_create(&mqtt_client, mqttServer.c_str(), haspDevice.get_hostname(), MQTTCLIENT_PERSISTENCE_NONE,
                               NULL)) != MQTTASYNC_SUCCESS) {
+#endif
         LOG_ERROR(TAG_MQTT, "Failed to create client, return code %d", rc);
         rc = EXIT_FAILURE;
         return;
@@ -387,12 +566,26 @@ void mqttStart()
         conn_opts.will->topicName = mqttLwtTopic.c_str();
 
         conn_opts.keepAliveInterval = 20;
-        conn_opts.cleansession      = 1;
         conn_opts.connectTimeout    = 2;  // seconds
         conn_opts.retryInterval     = 15; // 0 = no retry
-        conn_opts.onSuccess         = onConnect;
-        conn_opts.onFailure         = onConnectFailure;
         conn_opts.context           = mqtt_client;
+#if HASP_USE_MQTT_V5 > 0
+        conn_opts.cleanstart = 1;
+        conn_opts.onSuccess5 = onConnect5;
+        conn_opts.onFailure5 = onConnectFailure5;
+
+        /* Allow the broker to send topic aliases */
+        MQTTProperty property;
+        property.identifier     = MQTTPROPERTY_CODE_TOPIC_ALIAS_MAXIMUM;
+        property.value.integer2 = HASP_MQTT_ALIAS_MAX;
+        MQTTProperties_free(&connect_props);
+        MQTTProperties_add(&connect_props, &property);
+        conn_opts.connectProperties = &connect_props;
+#else
+        conn_opts.cleansession = 1;
+        conn_opts.onSuccess    = onConnect;
+        conn_opts.onFailure    = onConnectFailure;
+#endif
 
         conn_opts.username = mqttUsername.c_str();
         conn_opts.password = mqttPassword.c_str();
@@ -438,7 +631,20 @@ void mqttSetup()
     mqttLwtTopic += MQTT_TOPIC_LWT;
 }
 
-IRAM_ATTR void mqttLoop(){};
+IRAM_ATTR void mqttLoop()
+{
+    /* Dispatch incoming messages, at most one queue length per loop */
+    mqtt_queued_message_t item;
+    for(uint16_t i = 0; i < HASP_MQTT_QUEUE_SIZE && mqtt_message_pop(item); i++) {
+        mqtt_message_process(item.topic, item.message);
+    }
+
+    if(!mqttIsConnected() || mqtt_outbox_is_empty()) return;
+
+    dispatch_mtx.lock();
+    mqtt_outbox_drain(HASP_MQTT_OUTBOX_RATE);
+    dispatch_mtx.unlock();
+}
 
 void mqttEvery5Seconds(bool wifiIsConnected)
 {
@@ -460,6 +666,13 @@ void mqtt_get_info(JsonDocument& doc)
     info[F(D_INFO_RECEIVED)]  = mqttReceiveCount;
     info[F(D_INFO_PUBLISHED)] = mqttPublishCount;
     info[F(D_INFO_FAILED)]    = mqttFailedCount;
+    info[F("queuePeak")]      = mqttQueuePeak;
+    info[F("queueFull")]      = mqttQueueFullCount;
+
+#if HASP_USE_MQTT_V5 > 0
+    mqtt_alias_get_info(doc);
+#endif
+    mqtt_outbox_get_info(doc);
 }
 
 bool mqttGetConfig(const JsonObject& settings)
@@ -43,6 +43,7 @@ const char FP_CONFIG_GROUP[] PROGMEM = "group";
 
 #include "hasp_mqtt.h"    // functions to implement here
 #include "hasp_mqtt_ha.h" // HA functions
+#include "hasp_mqtt_binding.h"
 
 #include "hasp/hasp_dispatch.h" // for dispatch_topic_payload
 #include "hasp_debug.h"         // for logging
@@ -139,8 +140,8 @@ static void mqtt_message_cb(char* topic, char* payload, size_t length)
 #endif
 
     } else {
-        // Other topic
-        LOG_ERROR(TAG_MQTT, F(D_MQTT_INVALID_TOPIC));
+        // Topic bound to objects or other topic
+        if(!mqtt_binding_process(topic, (const char*)payload, length)) LOG_ERROR(TAG_MQTT, F(D_MQTT_INVALID_TOPIC));
         return;
     }
 
@@ -186,6 +187,18 @@ void mqtt_subscribe(void* context, const char* topic)
     }
 }
 
+void mqtt_unsubscribe(void* context, const char* topic)
+{
+    MQTTClient client = (MQTTClient)context;
+    int rc;
+
+    if((rc = MQTTClient_unsubscribe(client, topic)) != MQTTCLIENT_SUCCESS) {
+        LOG_WARNING(TAG_MQTT, D_BULLET "Failed to unsubscribe from %s", topic); // error code rc
+    } else {
+        LOG_VERBOSE(TAG_MQTT, D_BULLET "Unsubscribed from %s", topic);
+    }
+}
+
 /* ===== Local HASP MQTT functions ===== */
 
 int mqttPublish(const char* topic, const char* payload, size_t len, bool retain)
@@ -226,6 +239,20 @@ bool mqttIsConnected()
     return MQTTClient_isConnected(mqtt_client);
 }
 
+int mqttSubscribe(const char* topic)
+{
+    if(!mqttIsConnected()) return MQTT_ERR_NO_CONN;
+    mqtt_subscribe(mqtt_client, topic);
+    return MQTT_ERR_OK;
+}
+
+int mqttUnsubscribe(const char* topic)
+{
+    if(!mqttIsConnected()) return MQTT_ERR_NO_CONN;
+    mqtt_unsubscribe(mqtt_client, topic);
+    return MQTT_ERR_OK;
+}
+
 int mqtt_send_state(const __FlashStringHelper* subtopic, const char* payload)
 {
     char tmp_topic[mqttNodeTopic.length() + 20];
@@ -288,6 +315,9 @@ static void onConnect(void* context)
     mqtt_subscribe(mqtt_client, topic.c_str());
 #endif
 
+    /* Topics bound to objects */
+    mqtt_binding_subscribe_all();
+
     mqttPublish(mqttLwtTopic.c_str(), "online", 6, true);
 }
 
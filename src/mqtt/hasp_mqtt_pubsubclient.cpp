@@ -11,6 +11,7 @@
 #include "hasp/hasp.h"
 #include "hasp_mqtt.h"
 #include "hasp_mqtt_ha.h"
+#include "hasp_mqtt_binding.h"
 
 #if defined(ARDUINO_ARCH_ESP32)
 #include <WiFi.h>
@@ -177,8 +178,8 @@ static void mqtt_message_cb(char* topic, byte* payload, unsigned int length)
 #endif
 
     } else {
-        // Other topic
-        LOG_ERROR(TAG_MQTT, F(D_MQTT_INVALID_TOPIC));
+        // Topic bound to objects or other topic
+        if(!mqtt_binding_process(topic, (const char*)payload, length)) LOG_ERROR(TAG_MQTT, F(D_MQTT_INVALID_TOPIC));
         return;
     }
 
@@ -216,6 +217,23 @@ static void mqttSubscribeTo(const char* topic)
     }
 }
 
+int mqttSubscribe(const char* topic)
+{
+    if(!mqttIsConnected()) return MQTT_ERR_NO_CONN;
+    if(!mqttClient.subscribe(topic)) {
+        LOG_ERROR(TAG_MQTT, F(D_MQTT_NOT_SUBSCRIBED), topic);
+        return MQTT_ERR_SUB_FAIL;
+    }
+    LOG_VERBOSE(TAG_MQTT, F(D_BULLET D_MQTT_SUBSCRIBED), topic);
+    return MQTT_ERR_OK;
+}
+
+int mqttUnsubscribe(const char* topic)
+{
+    if(!mqttIsConnected()) return MQTT_ERR_NO_CONN;
+    return mqttClient.unsubscribe(topic) ? MQTT_ERR_OK : MQTT_ERR_SUB_FAIL;
+}
+
 void mqttStart()
 {
     char buffer[64];
@@ -334,6 +352,9 @@ void mqttStart()
     }
 #endif
 
+    /* Topics bound to objects */
+    mqtt_binding_subscribe_all();
+
     // Force any subscribed clients to toggle offline/online when we first connect to
     // make sure we get a full panel refresh at power on.  Sending offline,
     // "online" will be sent by the mqttStatusTopic subscription action.
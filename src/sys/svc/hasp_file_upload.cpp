@@ -0,0 +1,270 @@
+/* MIT License - Copyright (c) 2019-2024 Francis Van Roie
+   For full license information read the LICENSE file in the project folder */
+
+/* Buffered file upload
+ * Received data is collected in a buffer of HASP_UPLOAD_BUFFER_SIZE bytes and written to flash one full block at a
+ * time, instead of in the small pieces the network delivers. The file is written under a temporary name and only
+ * renamed to its real name when it is complete, so fonts and images are never loaded from a half written file.
+ * When the temporary name is longer than the filesystem allows, the file is written under its real name.
+ *
+ * When the client sends the md5 of the file, the received data and the file read back from flash are both checked
+ * against it before the rename. */
+
+#include "hasplib.h"
+
+#if(HASP_USE_HTTP > 0 || HASP_USE_HTTP_ASYNC > 0) && (HASP_USE_SPIFFS > 0 || HASP_USE_LITTLEFS > 0) &&              \
+    (defined(ARDUINO_ARCH_ESP32) || defined(ARDUINO_ARCH_ESP8266))
+
+#include <MD5Builder.h>
+
+#include "hasp_debug.h"
+#include "hasp_filesystem.h"
+#include "hasp_file_upload.h"
+
+static struct
+{
+    File file;
+    uint8_t* buffer; // write-behind buffer, NULL when writing through
+    size_t len;      // bytes waiting in the buffer
+    uint32_t start;  // millis() when the upload started
+    uint32_t gui;    // millis() of the last gui refresh
+    MD5Builder md5;
+    bool hashing;
+    bool direct;       // written under the real name, the temporary name is too long
+    char expected[33]; // md5 sent by the client
+    char filename[128];
+    char tempname[sizeof(filename) + sizeof(HASP_UPLOAD_SUFFIX)];
+} file_upload;
+
+static hasp_file_upload_stats_t upload_stats;
+
+static bool file_upload_store(const uint8_t* data, size_t len)
+{
+    uint32_t start = millis();
+    bool success   = file_upload.file.write(data, len) == len;
+    uint32_t time  = millis() - start;
+
+    upload_stats.writes++;
+    upload_stats.stall += time;
+    if(time > upload_stats.longest) upload_stats.longest = time;
+
+#if HASP_USE_HTTP > 0
+    if(millis() - file_upload.gui >= HASP_UPLOAD_GUI_PERIOD) {
+        lv_task_handler(); // the web server does not return to the loop until the upload is complete
+        file_upload.gui = millis();
+    }
+#endif
+
+    return success;
+}
+
+static bool file_upload_flush()
+{
+    if(file_upload.len == 0) return true;
+
+    bool success    = file_upload_store(file_upload.buffer, file_upload.len);
+    file_upload.len = 0;
+    return success;
+}
+
+static void file_upload_release()
+{
+    if(file_upload.file) file_upload.file.close();
+    file_upload.file = File();
+    if(file_upload.buffer) free(file_upload.buffer);
+    file_upload.buffer = NULL;
+    file_upload.len    = 0;
+}
+
+// Compare the md5 of the file on flash with the expected one
+static bool file_upload_verify()
+{
+    File file = HASP_FS.open(file_upload.tempname, "r");
+    if(!file) return false;
+
+    uint8_t stack_buffer[256];
+    uint8_t* buffer = file_upload.buffer ? file_upload.buffer : stack_buffer;
+    size_t size     = file_upload.buffer ? HASP_UPLOAD_BUFFER_SIZE : sizeof(stack_buffer);
+
+    MD5Builder md5;
+    md5.begin();
+    while(file.available()) {
+        size_t len = file.read(buffer, size);
+        if(len == 0) break;
+        md5.add(buffer, len);
+    }
+    file.close();
+    md5.calculate();
+
+    return !strcasecmp(md5.toString().c_str(), file_upload.expected);
+}
+
+/**
+ * Start writing an uploaded file
+ * @param filename char*: full path of the file
+ * @param md5 char*: hex md5 of the complete file to verify the upload, or NULL
+ * @return true if the file was created, under its temporary name when it fits
+ */
+bool file_upload_begin(const char* filename, const char* md5)
+{
+    if(file_upload.file) file_upload_abort();
+
+    if(strlen(filename) >= sizeof(file_upload.filename)) {
+        LOG_ERROR(TAG_HTTP, F("Filename %s is too long"), filename);
+        return false;
+    }
+    strcpy(file_upload.filename, filename);
+
+    // SPIFFS limits the length of the whole path, LittleFS the length of the file name
+    const char* name = strrchr(filename, '/');
+    if(HASP_USE_SPIFFS > 0 || !name)
+        name = filename;
+    else
+        name++;
+
+    file_upload.direct = strlen(name) + strlen(HASP_UPLOAD_SUFFIX) > HASP_UPLOAD_NAME_MAX;
+    if(file_upload.direct)
+        strcpy(file_upload.tempname, filename);
+    else
+        snprintf_P(file_upload.tempname, sizeof(file_upload.tempname), PSTR("%s" HASP_UPLOAD_SUFFIX), filename);
+
+    file_upload.file = HASP_FS.open(file_upload.tempname, "w");
+    if(!file_upload.file || file_upload.file.isDirectory()) {
+        file_upload_release();
+        return false;
+    }
+
+    // Small enough to be allocated from internal ram, which is faster to copy to flash
+    file_upload.buffer = (uint8_t*)malloc(HASP_UPLOAD_BUFFER_SIZE);
+    if(!file_upload.buffer) LOG_WARNING(TAG_HTTP, F("Upload buffer not available, writing unbuffered"));
+
+    file_upload.hashing = md5 && strlen(md5) == 32;
+    if(file_upload.hashing) {
+        strcpy(file_upload.expected, md5);
+        file_upload.md5.begin();
+    }
+
+    upload_stats.bytes   = 0;
+    upload_stats.stall   = 0;
+    upload_stats.longest = 0;
+    upload_stats.writes  = 0;
+    file_upload.start    = millis();
+    file_upload.gui      = file_upload.start;
+    return true;
+}
+
+static bool file_upload_buffer(const uint8_t* data, size_t len)
+{
+    if(!file_upload.buffer) return file_upload_store(data, len);
+
+    while(len > 0) {
+        size_t chunk = HASP_UPLOAD_BUFFER_SIZE - file_upload.len;
+        if(chunk > len) chunk = len;
+
+        memcpy(file_upload.buffer + file_upload.len, data, chunk);
+        file_upload.len += chunk;
+        data += chunk;
+        len -= chunk;
+
+        if(file_upload.len == HASP_UPLOAD_BUFFER_SIZE && !file_upload_flush()) return false;
+    }
+    return true;
+}
+
+// Add received data to the file, the upload is aborted when it can't be written
+bool file_upload_write(const uint8_t* data, size_t len)
+{
+    if(!file_upload.file) return false;
+
+    upload_stats.bytes += len;
+    if(file_upload.hashing) file_upload.md5.add((uint8_t*)data, len);
+
+    if(!file_upload_buffer(data, len)) {
+        LOG_ERROR(TAG_HTTP, F("Failed to write received data to file"));
+        file_upload_abort();
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Write the remaining data, verify the file and give it its real name
+ * @return true if the file was saved, the temporary file is removed otherwise
+ */
+bool file_upload_end()
+{
+    if(!file_upload.file) return false;
+
+    bool success = file_upload_flush();
+    file_upload.file.close();
+    upload_stats.time = millis() - file_upload.start;
+
+    if(success && file_upload.hashing) {
+        file_upload.md5.calculate();
+        if(strcasecmp(file_upload.md5.toString().c_str(), file_upload.expected)) {
+            LOG_ERROR(TAG_HTTP, F("Upload of %s does not match md5 %s"), file_upload.filename, file_upload.expected);
+            success = false;
+        } else if(!file_upload_verify()) {
+            LOG_ERROR(TAG_HTTP, F("Verification of %s on flash failed"), file_upload.filename);
+            success = false;
+        } else {
+            upload_stats.verified++;
+        }
+    }
+
+    if(success && !file_upload.direct && !HASP_FS.rename(file_upload.tempname, file_upload.filename)) {
+        // SPIFFS can't rename over an existing file
+        HASP_FS.remove(file_upload.filename);
+        success = HASP_FS.rename(file_upload.tempname, file_upload.filename);
+    }
+
+    if(success) {
+        hasp_img_cache_invalidate(file_upload.filename); // the cache still holds the pixels of the old file
+        uint32_t speed = upload_stats.bytes / (upload_stats.time > 0 ? upload_stats.time : 1); // bytes/ms = kB/s
+        LOG_INFO(TAG_HTTP, F("Uploaded %s (%u bytes, %u kB/s, %u ms writing)"), file_upload.filename,
+                 upload_stats.bytes, speed, upload_stats.stall);
+        upload_stats.transfers++;
+    } else {
+        LOG_ERROR(TAG_HTTP, D_FILE_SAVE_FAILED, file_upload.filename);
+        HASP_FS.remove(file_upload.tempname);
+        upload_stats.failed++;
+    }
+
+    file_upload_release();
+    return success;
+}
+
+bool file_upload_busy()
+{
+    return file_upload.file;
+}
+
+void file_upload_abort()
+{
+    if(!file_upload.file) return;
+
+    file_upload_release();
+    HASP_FS.remove(file_upload.tempname);
+    upload_stats.failed++;
+}
+
+void file_upload_get_info(JsonDocument& doc)
+{
+    JsonObject info = doc.createNestedObject(F("File Upload"));
+    char buffer[64];
+
+    info[F("Transfers")] = upload_stats.transfers;
+    info[F("Failed")]    = upload_stats.failed;
+    info[F("Verified")]  = upload_stats.verified;
+
+    if(upload_stats.time > 0) {
+        snprintf_P(buffer, sizeof(buffer), PSTR("%u bytes in %u ms, %u kB/s"), upload_stats.bytes, upload_stats.time,
+                   upload_stats.bytes / upload_stats.time);
+        info[F("Last Upload")] = buffer;
+        snprintf_P(buffer, sizeof(buffer), PSTR("%u ms in %u writes, longest %u ms"), upload_stats.stall,
+                   upload_stats.writes, upload_stats.longest);
+        info[F("Flash Writes")] = buffer;
+    }
+}
+
+#endif
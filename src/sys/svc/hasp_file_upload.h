@@ -0,0 +1,48 @@
+/* MIT License - Copyright (c) 2019-2024 Francis Van Roie
+   For full license information read the LICENSE file in the project folder */
+
+#ifndef HASP_FILE_UPLOAD_H
+#define HASP_FILE_UPLOAD_H
+
+#include "hasplib.h"
+
+#ifndef HASP_UPLOAD_BUFFER_SIZE
+#define HASP_UPLOAD_BUFFER_SIZE 4096 // bytes collected before writing, one flash erase block
+#endif
+
+#ifndef HASP_UPLOAD_SUFFIX
+#define HASP_UPLOAD_SUFFIX ".tmp" // the file is written under this name and renamed when complete
+#endif
+
+#ifndef HASP_UPLOAD_NAME_MAX
+#if HASP_USE_SPIFFS > 0
+#define HASP_UPLOAD_NAME_MAX 31 // longest path on the filesystem, SPIFFS_OBJ_NAME_LEN includes the NUL
+#else
+#define HASP_UPLOAD_NAME_MAX 255 // longest file name on the filesystem, LFS_NAME_MAX
+#endif
+#endif
+
+#ifndef HASP_UPLOAD_GUI_PERIOD
+#define HASP_UPLOAD_GUI_PERIOD 50 // ms between two gui refreshes during an upload
+#endif
+
+typedef struct
+{
+    uint32_t transfers; // uploads completed
+    uint32_t failed;    // uploads aborted, failed to write or failed verification
+    uint32_t verified;  // uploads checked against an md5 after writing
+    uint32_t bytes;     // size of the last upload
+    uint32_t time;      // ms from start to end of the last upload
+    uint32_t stall;     // ms spent writing to flash during the last upload
+    uint32_t longest;   // longest single flash write of the last upload
+    uint16_t writes;    // flash writes of the last upload
+} hasp_file_upload_stats_t;
+
+bool file_upload_begin(const char* filename, const char* md5);
+bool file_upload_write(const uint8_t* data, size_t len);
+bool file_upload_end();
+void file_upload_abort();
+bool file_upload_busy();
+void file_upload_get_info(JsonDocument& doc);
+
+#endif
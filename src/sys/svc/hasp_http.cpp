@@ -24,6 +24,10 @@
 #include "hasp_gui.h"
 #include "hasp_debug.h"
 
+#if HASP_USE_MQTT > 0
+#include "mqtt/hasp_mqtt_binding.h"
+#endif
+
 #include "sys/net/hasp_network.h"
 #include "sys/net/hasp_time.h"
 
@@ -32,7 +36,7 @@
 #endif
 
 #if defined(ARDUINO_ARCH_ESP8266) || defined(ARDUINO_ARCH_ESP32)
-File fsUploadFile;
+#include "hasp_file_upload.h"
 #endif
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -50,6 +54,10 @@ hasp_http_config_t http_config;
 
 #define HTTP_PAGE_SIZE (6 * 256)
 
+#ifndef HTTP_CHUNK_SIZE
+#define HTTP_CHUNK_SIZE 512 // bytes buffered before a chunk of a streamed response is sent
+#endif
+
 #if(defined(STM32F4xx) || defined(STM32F7xx)) && HASP_USE_ETHERNET > 0
 #include <EthernetWebServer_STM32.h>
 EthernetWebServer webServer(80);
@@ -205,9 +213,61 @@ static void webHandleHaspConfig();
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
+/* Heap used while serving a request, sampled when it starts and whenever a chunk of the response is sent */
+static struct
+{
+    uint32_t requests;  // requests measured
+    uint32_t start;     // free heap when the current request started
+    uint32_t low;       // lowest free heap during the current request
+    uint32_t last;      // heap used by the previous request
+    uint32_t peak;      // most heap used by a single request
+    char peak_uri[32];  // request that used the most heap
+    bool active;
+} http_heap;
+
+static void http_heap_sample()
+{
+    if(!http_heap.active) return;
+    uint32_t free = haspDevice.get_free_heap();
+    if(free < http_heap.low) http_heap.low = free;
+}
+
+static void http_heap_begin()
+{
+    http_heap.start  = haspDevice.get_free_heap();
+    http_heap.low    = http_heap.start;
+    http_heap.active = true;
+}
+
+static void http_heap_end()
+{
+    if(!http_heap.active) return;
+
+    http_heap_sample();
+    http_heap.active = false;
+    http_heap.requests++;
+    http_heap.last = http_heap.start - http_heap.low;
+    if(http_heap.last >= http_heap.peak) {
+        http_heap.peak = http_heap.last;
+        strncpy(http_heap.peak_uri, webServer.uri().c_str(), sizeof(http_heap.peak_uri) - 1);
+    }
+}
+
+static void http_get_info(JsonDocument& doc)
+{
+    JsonObject info = doc.createNestedObject(F("HTTP"));
+
+    info[F("Requests")]  = http_heap.requests;
+    info[F("Heap Last")] = http_heap.last;
+    info[F("Heap Peak")] = http_heap.peak;
+    info[F("Peak Uri")]  = http_heap.peak_uri;
+}
+
 // Check authentication but only create Log entry if it failed
 bool http_is_authenticated()
 {
+    http_heap_begin();
+
     if(http_config.password[0] != '\0') { // Request HTTP auth if httpPassword is set
         if(!webServer.authenticate(http_config.username, http_config.password)) {
             webServer.requestAuthentication();
@@ -339,6 +399,54 @@ static void webSendHtmlHeader(const char* title, uint32_t httpdatalength, uint8_
 #endif
 }
 
+/* Streams a response without Content-Length through a fixed buffer, each full buffer is sent as one chunk */
+class HttpChunkWriter : public Print {
+  public:
+    uint16_t count = 0; // items written
+
+    HttpChunkWriter(int code, const char* content_type)
+    {
+        webServer.setContentLength(CONTENT_LENGTH_UNKNOWN);
+        webServer.send(code, content_type, "");
+    }
+
+    size_t write(uint8_t c) override
+    {
+        if(len >= sizeof(buffer)) send();
+        buffer[len++] = c;
+        return 1;
+    }
+
+    size_t write(const uint8_t* data, size_t size) override
+    {
+        for(size_t i = 0; i < size; i++) write(data[i]);
+        return size;
+    }
+
+    // Separate the items of a json array or object
+    void next()
+    {
+        if(count++ > 0) write(',');
+    }
+
+    void send()
+    {
+        http_heap_sample();
+        if(len) webServer.sendContent((const char*)buffer, len);
+        len = 0;
+    }
+
+    void end()
+    {
+        send();
+        webServer.sendContent(""); // last chunk
+    }
+
+  private:
+    uint8_t buffer[HTTP_CHUNK_SIZE];
+    size_t len = 0;
+};
+
 static void http_send_content(const char* form[], int count, uint8_t gohome = 0)
 {
     size_t total = 0;
@@ -416,6 +524,10 @@ bool http_save_config()
             updated = wgSetConfig(settings.as<JsonObject>());
 #endif
         }
+
+#if HASP_USE_CONFIG > 0
+        if(updated) configSetDirty(save.c_str());
+#endif
     }
 
     return updated;
@@ -469,6 +581,20 @@ static void http_handle_reboot()
     }
 }
 
+////////////////////////////////////////////////////////////////////////////////////////////////////
+#if HASP_USE_WEBSOCKET > 0
+static void http_handle_websocket()
+{ // ws://plate01/ws
+    if(!http_is_authenticated("ws")) return;
+
+    if(!webServer.header("Upgrade").equalsIgnoreCase("websocket") || !webServer.hasHeader("Sec-WebSocket-Key")) {
+        webServer.send(400, "text/plain", "WebSocket upgrade expected");
+    } else if(!websocket_accept(webServer.client(), webServer.header("Sec-WebSocket-Key").c_str())) {
+        webServer.send(503, "text/plain", "Too many WebSocket clients");
+    }
+}
+#endif
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 static void http_handle_screenshot()
 { // http://plate01/screenshot
@@ -541,15 +667,19 @@ static void http_handle_screenshot()
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
-static void add_json(String& data, JsonDocument& doc)
+// Write the sections of doc as members of the object being streamed
+static void add_json(HttpChunkWriter& writer, JsonDocument& doc)
 {
-    char buffer[800];
-    size_t len = serializeJson(doc, buffer, sizeof(buffer));
     if(doc.isNull()) return; // empty document
 
-    buffer[len - 1] = ',';
-    char* start     = buffer + 1;
-    data += String(start);
+    for(JsonPair section : doc.as<JsonObject>()) {
+        writer.next();
+        writer.print('"');
+        writer.print(section.key().c_str());
+        writer.print("\":");
+        serializeJson(section.value(), writer);
+    }
+    http_heap_sample();
     doc.clear();
 }
 
@@ -563,6 +693,36 @@ static void add_license(JsonObject& obj, const char* title, const char* year, co
     if(allrightsreserved) obj["r"] = allrightsreserved;
 }
 
+static void webHandleApiPageObject(uint8_t, uint8_t, JsonObject& state, void* data)
+{
+    HttpChunkWriter* writer = (HttpChunkWriter*)data;
+    writer->next();
+    serializeJson(state, *writer);
+}
+
+static void webHandleApiPage()
+{ // http://plate01/api/page/1?attr=obj,val,text
+    if(!http_is_authenticated("api")) return;
+
+    String endpoint = webServer.pathArg(0);
+    uint8_t pageid  = endpoint.length() > 0 ? atoi(endpoint.c_str()) : haspPages.get();
+    if(!haspPages.is_valid(pageid) || !haspPages.get_obj(pageid)) {
+        webServer.send(404, "application/json", "Page Not Found");
+        return;
+    }
+
+    String attrs = webServer.arg("attr");
+
+    // The objects are serialized one by one, the response size is not known in advance
+    HttpChunkWriter writer(200, "application/json");
+    writer.printf("{\"page\":%u,\"objects\":[", pageid);
+    hasp_object_page_state(pageid, attrs.c_str(), webHandleApiPageObject, &writer);
+    writer.print("]}");
+    writer.end();
+
+    LOG_VERBOSE(TAG_HTTP, F("Page %u state sent (%u objects)"), pageid, writer.count);
+}
+
 static void webHandleApi()
 { // http://plate01/api
     if(!http_is_authenticated("api")) return;
@@ -574,12 +734,13 @@ static void webHandleApi()
 
     if(!strcasecmp(endpoint.c_str(), "files")) {
         String path = webServer.arg("dir");
-        webServer.send(200, contentType.c_str(), filesystem_list(HASP_FS, path.c_str(), 5).c_str());
+        HttpChunkWriter writer(200, contentType.c_str());
+        filesystem_list(HASP_FS, path.c_str(), 5, writer);
+        writer.end();
 
     } else if(!strcasecmp(endpoint.c_str(), "info")) {
-        String jsondata((char*)0);
-        jsondata.reserve(HTTP_PAGE_SIZE);
-        jsondata = "{";
+        HttpChunkWriter jsondata(200, contentType.c_str());
+        jsondata.print('{');
 
         hasp_get_info(doc);
         add_json(jsondata, doc);
@@ -587,6 +748,9 @@ static void webHandleApi()
 #if HASP_USE_MQTT > 0
         mqtt_get_info(doc);
         add_json(jsondata, doc);
+
+        mqtt_binding_get_info(doc);
+        add_json(jsondata, doc);
 #endif
 
 #if HASP_USE_WIFI > 0 || HASP_USE_EHTERNET > 0
@@ -597,9 +761,64 @@ static void webHandleApi()
         haspDevice.get_info(doc);
         add_json(jsondata, doc);
 
-        jsondata[jsondata.length() - 1] = '}'; // Replace last comma with a bracket
+        hasp_pool_get_info(doc);
+        add_json(jsondata, doc);
+
+        lvfs_get_info(doc);
+        add_json(jsondata, doc);
+
+        hasp_attribute_get_info(doc);
+        add_json(jsondata, doc);
 
-        webServer.send(200, contentType, jsondata);
+        hasp_rules_get_info(doc);
+        add_json(jsondata, doc);
+
+        jsonl_stream_get_info(doc);
+        add_json(jsondata, doc);
+
+        hasp_img_cache_get_info(doc);
+        add_json(jsondata, doc);
+
+#if HASP_USE_PNG_STREAM > 0
+        hasp_png_stream_get_info(doc);
+        add_json(jsondata, doc);
+#endif
+
+#if HASP_USE_SHADOW_CACHE > 0 && LV_USE_SHADOW
+        hasp_shadow_cache_get_info(doc);
+        add_json(jsondata, doc);
+#endif
+
+#if HASP_USE_LABEL_CACHE > 0
+        hasp_label_cache_get_info(doc);
+        add_json(jsondata, doc);
+#endif
+
+#if HASP_USE_WEBSOCKET > 0
+        websocket_get_info(doc);
+        add_json(jsondata, doc);
+#endif
+
+        http_get_info(doc);
+        add_json(jsondata, doc);
+
+#if HASP_USE_SPIFFS > 0 || HASP_USE_LITTLEFS > 0
+        file_upload_get_info(doc);
+        add_json(jsondata, doc);
+#endif
+
+#if LV_USE_ANIMATION
+        my_scr_anim_get_info(doc);
+        add_json(jsondata, doc);
+#endif
+
+#if HASP_USE_CONFIG > 0
+        config_get_info(doc);
+        add_json(jsondata, doc);
+#endif
+
+        jsondata.print('}');
+        jsondata.end();
         return;
 
     } else if(!strcasecmp(endpoint.c_str(), "credits")) {
@@ -647,9 +866,9 @@ static void webHandleApi()
 #endif
         }
         {
-            char output[HTTP_PAGE_SIZE];
-            serializeJson(doc, output, sizeof(output));
-            webServer.send(200, contentType.c_str(), output);
+            HttpChunkWriter writer(200, contentType.c_str());
+            serializeJson(doc, writer);
+            writer.end();
         }
 
     } else if(!strcasecmp(endpoint.c_str(), "config")) {
@@ -736,19 +955,9 @@ static void webHandleApi()
         //     settings[FPSTR(FP_CONFIG_PASS)] = D_PASSWORD_MASK;
         // }
 
-        LOG_DEBUG(TAG_HTTP, "%s - %d", __FILE__, __LINE__);
-        doc.shrinkToFit();
-        LOG_DEBUG(TAG_HTTP, "%s - %d", __FILE__, __LINE__);
-        const size_t size = measureJson(doc) + 1;
-        LOG_DEBUG(TAG_HTTP, "%s - %d", __FILE__, __LINE__);
-        char jsondata[size];
-        LOG_DEBUG(TAG_HTTP, "%s - %d", __FILE__, __LINE__);
-        memset(jsondata, 0, size);
-        LOG_DEBUG(TAG_HTTP, "%s - %d", __FILE__, __LINE__);
-        serializeJson(doc, jsondata, size);
-        LOG_DEBUG(TAG_HTTP, "%s - %d", __FILE__, __LINE__);
-        webServer.send(200, contentType, jsondata);
-        LOG_DEBUG(TAG_HTTP, "%s - %d", __FILE__, __LINE__);
+        HttpChunkWriter writer(200, contentType.c_str());
+        serializeJson(doc, writer);
+        writer.end();
 
     } else {
         webServer.send(400, contentType, "Bad Request");
@@ -834,6 +1043,7 @@ static void webHandleApiConfig()
             LOG_WARNING(TAG_HTTP, F("Invalid module %s"), endpoint_key);
             return;
         }
+        configSetDirty(endpoint_key); // persisted after the debounce period
     }
 
     settings = doc.to<JsonObject>();
@@ -888,24 +1098,9 @@ static void webHandleApiConfig()
         settings[FPSTR(FP_CONFIG_PASS)] = D_PASSWORD_MASK;
     }
 
-    LOG_DEBUG(TAG_HTTP, "%s - %d", __FILE__, __LINE__);
-    // doc.shrinkToFit();
-    LOG_DEBUG(TAG_HTTP, "%s - %d", __FILE__, __LINE__);
-    const size_t size = measureJson(doc);
-    LOG_DEBUG(TAG_HTTP, "%s - %d", __FILE__, __LINE__);
-    char jsondata[size];
-    LOG_DEBUG(TAG_HTTP, "%s - %d", __FILE__, __LINE__);
-    memset(jsondata, 0, size);
-    LOG_DEBUG(TAG_HTTP, "%s - %d", __FILE__, __LINE__);
-    serializeJson(doc, jsondata, size);
-    LOG_DEBUG(TAG_HTTP, "%s - %d", __FILE__, __LINE__);
-    //  webServer.send(200, contentType.c_str(), jsondata);
-    webServer.setContentLength(size);
-    LOG_DEBUG(TAG_HTTP, "%s - %d", __FILE__, __LINE__);
-    webServer.send(200, "application/json", "");
-    LOG_DEBUG(TAG_HTTP, "%s - %d", __FILE__, __LINE__);
-    webServer.sendContent(jsondata, size);
-    LOG_DEBUG(TAG_HTTP, "%s - %d", __FILE__, __LINE__);
+    HttpChunkWriter writer(200, "application/json");
+    serializeJson(doc, writer);
+    writer.end();
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -1210,20 +1405,10 @@ static void handleFileUpload()
                 filename = "/";
                 filename += upload->filename;
             }
-            fsUploadFile = HASP_FS.open(filename, "w");
-            if(fsUploadFile) {
-                if(!fsUploadFile || fsUploadFile.isDirectory()) {
-                    // Clear upload filesize, fix Response Content-Length
-                    webServer.setContentLength(CONTENT_LENGTH_NOT_SET);
-                    webServer.send_P(400, PSTR("text/plain"), PSTR("Invalid filename"));
-                    fsUploadFile.close();
-                    fsUploadFile = File();
-                    LOG_WARNING(TAG_HTTP, D_FILE_SAVE_FAILED, filename.c_str());
-                } else {
-                    LOG_TRACE(TAG_HTTP, F("handleFileUpload Name: %s"), filename.c_str());
-                    haspProgressMsg(fsUploadFile.name());
-                    htppLastLoopTime = millis();
-                }
+            if(file_upload_begin(filename.c_str(), webServer.arg("md5").c_str())) {
+                LOG_TRACE(TAG_HTTP, F("handleFileUpload Name: %s"), filename.c_str());
+                haspProgressMsg(filename.c_str());
+                htppLastLoopTime = millis();
             } else {
                 // Clear upload filesize, fix Response Content-Length
                 webServer.setContentLength(CONTENT_LENGTH_NOT_SET);
@@ -1233,31 +1418,30 @@ static void handleFileUpload()
             break;
         }
         case UPLOAD_FILE_WRITE: {
-            if(fsUploadFile) {
-                if(fsUploadFile.write(upload->buf, upload->currentSize) != upload->currentSize) {
-                    // Clear upload filesize, fix Response Content-Length
-                    webServer.setContentLength(CONTENT_LENGTH_NOT_SET);
-                    webServer.send_P(400, PSTR("text/plain"), PSTR("Failed to write received data to file"));
-                    fsUploadFile.close();
-                    fsUploadFile = File();
-                    LOG_ERROR(TAG_HTTP, "Failed to write received data to file");
-                } else {
-                    http_upload_progress(); // Moved to httpEverySecond Loop
-                }
+            if(!file_upload_busy()) break;
+
+            if(!file_upload_write(upload->buf, upload->currentSize)) {
+                // Clear upload filesize, fix Response Content-Length
+                webServer.setContentLength(CONTENT_LENGTH_NOT_SET);
+                webServer.send_P(400, PSTR("text/plain"), PSTR("Failed to write received data to file"));
+            } else {
+                http_upload_progress(); // Moved to httpEverySecond Loop
             }
             break;
         }
         case UPLOAD_FILE_END: {
-            if(fsUploadFile) {
-                LOG_INFO(TAG_HTTP, F("Uploaded %s (%u bytes)"), fsUploadFile.name(), upload->totalSize);
-                fsUploadFile.close();
+            if(file_upload_busy()) {
+                bool saved = file_upload_end();
 
                 // Redirect to /config/hasp page. This flushes the web buffer and frees the memory
                 // webServer.sendHeader(String("Location"), String(F("/config/hasp")), true);
 
                 // Clear upload filesize, fix Response Content-Length
                 webServer.setContentLength(CONTENT_LENGTH_NOT_SET);
-                webServer.send_P(200, PSTR("text/plain"), PSTR("Upload OK"));
+                if(saved)
+                    webServer.send_P(200, PSTR("text/plain"), PSTR("Upload OK"));
+                else
+                    webServer.send_P(400, PSTR("text/plain"), PSTR("Failed to save file"));
             }
             haspProgressVal(255);
             break;
@@ -1265,8 +1449,7 @@ static void handleFileUpload()
         default:
             LOG_WARNING(TAG_HTTP, "File upload aborted");
             webServer.send_P(400, PSTR("text/plain"), PSTR("File upload aborted"));
-            fsUploadFile.close();
-            fsUploadFile = File();
+            file_upload_abort();
     }
 }
 
@@ -1288,13 +1471,15 @@ static void handleFileDelete()
         return webServer.send(404, mimetype, "FileNotFound");
     }
     bool result;
-    if(path.endsWith("/")) {
+    bool folder = path.endsWith("/");
+    if(folder) {
         path.remove(path.length() - 1);
         result = HASP_FS.rmdir(path);
     } else {
         result = HASP_FS.remove(path);
     }
     if(result) {
+        hasp_img_cache_invalidate(folder ? NULL : path.c_str()); // a folder may hold several cached images
         webServer.send(200, mimetype, String(""));
     } else {
         webServer.send(405, mimetype, "RemoveFailed");
@@ -1358,30 +1543,27 @@ static void handleFileList()
 #if defined(ARDUINO_ARCH_ESP32)
     File root = HASP_FS.open(path.c_str(), FILE_READ);
     File file = root.openNextFile();
-    String output((char*)0);
-    output.reserve(HTTP_PAGE_SIZE);
-    output = "[";
+    HttpChunkWriter output(200, PSTR("text/json"));
+    output.print('[');
 
     while(file) {
-        if(output != "[") {
-            output += ',';
-        }
+        output.next();
         bool isDir = file.isDirectory();
-        output += F("{\"type\":\"");
-        output += (isDir) ? "dir" : "file";
-        output += F("\",\"name\":\"");
+        output.print(F("{\"type\":\""));
+        output.print((isDir) ? "dir" : "file");
+        output.print(F("\",\"name\":\""));
         if(file.name()[0] == '/') {
-            output += &(file.name()[1]);
+            output.print(&(file.name()[1]));
         } else {
-            output += file.name();
+            output.print(file.name());
         }
-        output += F("\"}");
+        output.print(F("\"}"));
 
         // file.close();
         file = root.openNextFile();
     }
-    output += "]";
-    webServer.send(200, PSTR("text/json"), output);
+    output.print(']');
+    output.end();
 #elif defined(ARDUINO_ARCH_ESP8266)
     Dir dir = HASP_FS.openDir(path);
     String output((char*)0);
@@ -2697,8 +2879,8 @@ void httpSetup()
     LOG_DEBUG(TAG_HTTP, F(D_BULLET "Read %s => %s (%d bytes)"), FP_CONFIG_PASS, password.c_str(), password.length());
 
     // ask server to track these headers
-    const char* headerkeys[] = {"Content-Length", "If-None-Match",
-                                "Cookie"}; // "Authentication" is automatically checked
+    const char* headerkeys[] = {"Content-Length", "If-None-Match", "Cookie", "Upgrade",
+                                "Sec-WebSocket-Key"}; // "Authentication" is automatically checked
     size_t headerkeyssize    = sizeof(headerkeys) / sizeof(char*);
     webServer.collectHeaders(headerkeys, headerkeyssize);
 
@@ -2707,6 +2889,7 @@ void httpSetup()
     // webServer.on("/vars.css", webSendCssVars);
     // webServer.on("/js", webSendJavascript);
     webServer.on(UriBraces("/api/config/{}/"), webHandleApiConfig);
+    webServer.on(UriBraces("/api/page/{}"), HTTP_GET, webHandleApiPage);
     webServer.on(UriBraces("/api/{}/"), webHandleApi);
 
     webServer.on(UriBraces("/config/{}/"), HTTP_GET, []() { httpHandleFile(F("/hasp.htm")); }); // SPA Route
@@ -2768,6 +2951,10 @@ void httpSetup()
 
     webServer.on("/", http_handle_root);
     webServer.on("/screenshot", http_handle_screenshot);
+#if HASP_USE_WEBSOCKET > 0
+    webServer.on("/ws", http_handle_websocket);
+    websocket_setup();
+#endif
 #ifdef HTTP_LEGACY
     webServer.on("/info", http_handle_info);
     webServer.on("/reboot", http_handle_reboot);
@@ -2813,6 +3000,10 @@ IRAM_ATTR void httpLoop(void)
     dnsServer.processNextRequest();
 #endif
     webServer.handleClient();
+    http_heap_end();
+#if HASP_USE_WEBSOCKET > 0
+    websocket_loop();
+#endif
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
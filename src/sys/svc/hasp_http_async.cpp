@@ -19,6 +19,10 @@
 #include "hasp_gui.h"
 #include "hasp_debug.h"
 
+#if HASP_USE_MQTT > 0
+#include "mqtt/hasp_mqtt_binding.h"
+#endif
+
 #include "sys/net/hasp_network.h"
 
 /* clang-format off */
@@ -50,7 +54,7 @@
 /* clang-format on */
 
 #if defined(ARDUINO_ARCH_ESP8266) || defined(ARDUINO_ARCH_ESP32)
-File fsUploadFile;
+#include "hasp_file_upload.h"
 #endif
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -563,6 +567,9 @@ void webHandleInfoJson(AsyncWebServerRequest* request)
 #if HASP_USE_MQTT > 0
     mqtt_get_info(doc);
     add_json(htmldata, doc);
+
+    mqtt_binding_get_info(doc);
+    add_json(htmldata, doc);
 #endif
 
     network_get_info(doc);
@@ -571,6 +578,59 @@ void webHandleInfoJson(AsyncWebServerRequest* request)
     haspDevice.get_info(doc);
     add_json(htmldata, doc);
 
+    hasp_pool_get_info(doc);
+    add_json(htmldata, doc);
+
+    lvfs_get_info(doc);
+    add_json(htmldata, doc);
+
+    hasp_attribute_get_info(doc);
+    add_json(htmldata, doc);
+
+    hasp_rules_get_info(doc);
+    add_json(htmldata, doc);
+
+    jsonl_stream_get_info(doc);
+    add_json(htmldata, doc);
+
+    hasp_img_cache_get_info(doc);
+    add_json(htmldata, doc);
+
+#if HASP_USE_PNG_STREAM > 0
+    hasp_png_stream_get_info(doc);
+    add_json(htmldata, doc);
+#endif
+
+#if HASP_USE_SHADOW_CACHE > 0 && LV_USE_SHADOW
+    hasp_shadow_cache_get_info(doc);
+    add_json(htmldata, doc);
+#endif
+
+#if HASP_USE_LABEL_CACHE > 0
+    hasp_label_cache_get_info(doc);
+    add_json(htmldata, doc);
+#endif
+
+#if HASP_USE_WEBSOCKET > 0
+    websocket_get_info(doc);
+    add_json(htmldata, doc);
+#endif
+
+#if HASP_USE_SPIFFS > 0 || HASP_USE_LITTLEFS > 0
+    file_upload_get_info(doc);
+    add_json(htmldata, doc);
+#endif
+
+#if LV_USE_ANIMATION
+    my_scr_anim_get_info(doc);
+    add_json(htmldata, doc);
+#endif
+
+#if HASP_USE_CONFIG > 0
+    config_get_info(doc);
+    add_json(htmldata, doc);
+#endif
+
     htmldata[htmldata.length() - 1] = '}'; // Replace last comma with a bracket
 
     htmldata += "'; data = JSON.parse(data); var table = \"<table>\"; for(let header in data) { "
@@ -986,29 +1046,19 @@ void handleFileUpload(AsyncWebServerRequest* request, String filename, size_t in
         if(!filename.startsWith("/")) {
             filename = "/" + filename;
         }
-        if(filename.length() < 32) {
-            fsUploadFile = HASP_FS.open(filename, "w");
+        if(file_upload_begin(filename.c_str(), request->arg("md5").c_str())) {
             LOG_TRACE(TAG_HTTP, F("handleFileUpload Name: %s"), filename.c_str());
-            haspProgressMsg(fsUploadFile.name());
-        } else {
-            LOG_ERROR(TAG_HTTP, F("Filename %s is too long"), filename.c_str());
+            haspProgressMsg(filename.c_str());
         }
     }
 
     // DBG_OUTPUT_PORT.print("handleFileUpload Data: "); debugPrintln(upload.currentSize);
-    if(fsUploadFile) {
-        if(fsUploadFile.write(data, len) != len) {
-            LOG_ERROR(TAG_HTTP, F("Failed to write received data to file"));
-        } else {
-            webUploadProgress(); // Moved to httpEverySecond Loop
-        }
+    if(file_upload_write(data, len)) {
+        webUploadProgress(); // Moved to httpEverySecond Loop
     }
 
     if(final) { // END
-        if(fsUploadFile) {
-            LOG_INFO(TAG_HTTP, F("Uploaded %s (%u bytes)"), fsUploadFile.name(), index + len);
-            fsUploadFile.close();
-        }
+        file_upload_end();
         haspProgressVal(255);
 
         // Redirect to /config/hasp page. This flushes the web buffer and frees the memory
@@ -1042,6 +1092,7 @@ void handleFileDelete(AsyncWebServerRequest* request)
         return request->send_P(404, mimetype, PSTR("FileNotFound"));
     }
     HASP_FS.remove(path);
+    hasp_img_cache_invalidate(path.c_str());
     request->send_P(200, mimetype, PSTR(""));
     // path.clear();
 }
@@ -2225,6 +2276,10 @@ void httpSetup()
     webServer.on(("/about"), webHandleAbout);
     webServer.on(("/css"), [](AsyncWebServerRequest* request) { request->send_P(200, PSTR("text/css"), HTTP_CSS); });
     webServer.onNotFound(httpHandleNotFound);
+#if HASP_USE_WEBSOCKET > 0
+    websocket_setup(http_config.username, http_config.password);
+    webServer.addHandler(&ws);
+#endif
 
 #if HASP_USE_WIFI > 0
 
@@ -2328,7 +2383,11 @@ void httpReconnect()
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 IRAM_ATTR void httpLoop(void)
-{}
+{
+#if HASP_USE_WEBSOCKET > 0
+    websocket_loop();
+#endif
+}
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 void httpEverySecond()
@@ -0,0 +1,454 @@
+/* MIT License - Copyright (c) 2019-2024 Francis Van Roie
+   For full license information read the LICENSE file in the project folder */
+
+/* WebSocket push channel
+ * Browsers connect to /ws on the web server. Every state message that goes out on mqtt is pushed to them as
+ * {"topic":"p1b2","payload":{...}}, and the area flushed to the display is sent as {"dirty":[x1,y1,x2,y2]} at most
+ * once every HASP_WEBSOCKET_DIRTY_PERIOD ms. Text frames from a client are run as commands.
+ *
+ * Each client has a bounded queue. When a browser does not keep up, its new messages are dropped and counted instead
+ * of blocking the gui loop. The synchronous web server gets a small server here that writes with MSG_DONTWAIT. The
+ * async web server uses the queue of AsyncWebSocket, commands are handed to the gui loop through a queue.
+ *
+ * States sent from other tasks, like the mqtt task on connect, are queued and broadcast by the loop.
+ * The async server keeps its own table of clients, AsyncTCP adds and deletes clients in the list of AsyncWebSocket
+ * on its own task. */
+
+#include "hasplib.h"
+
+#if HASP_USE_WEBSOCKET > 0 && defined(ARDUINO_ARCH_ESP32)
+
+#include <mutex>
+
+#include "hasp_debug.h"
+#include "hasp_websocket.h"
+
+#define WEBSOCKET_FIFO_SIZE 16
+
+// Messages handed from one task to another
+typedef struct
+{
+    std::mutex mtx;
+    char* items[WEBSOCKET_FIFO_SIZE];
+    uint8_t head;
+    uint8_t count;
+} websocket_fifo_t;
+
+static websocket_fifo_t outgoing; // states of other tasks, broadcast by the loop
+static TaskHandle_t loop_task;    // task that runs websocket_loop
+
+#if HASP_USE_HTTP_ASYNC > 0
+#include "AsyncTCP.h"
+#include "ESPAsyncWebServer.h"
+
+extern AsyncWebSocket ws;
+
+static websocket_fifo_t commands; // commands received on the AsyncTCP task
+
+static std::mutex client_mtx; // a client is not deleted while the gui loop sends to it
+static AsyncWebSocketClient* clients[HASP_WEBSOCKET_CLIENTS];
+
+#elif HASP_USE_HTTP > 0
+#include <WiFi.h>
+#include <lwip/sockets.h>
+#include "mbedtls/base64.h"
+#include "mbedtls/sha1.h"
+
+typedef struct
+{
+    WiFiClient client;
+    uint8_t* tx; // ring buffer of outgoing frames, NULL when the slot is free
+    uint16_t tx_head;
+    uint16_t tx_len;
+    uint16_t rx_len;
+    uint8_t rx[HASP_WEBSOCKET_RX_SIZE + 9]; // 8 bytes of frame header and room for a terminating NUL
+} websocket_client_t;
+
+static websocket_client_t clients[HASP_WEBSOCKET_CLIENTS];
+#endif
+
+static hasp_websocket_stats_t ws_stats;
+static int32_t dirty_x1 = INT32_MAX;
+static int32_t dirty_y1;
+static int32_t dirty_x2;
+static int32_t dirty_y2;
+static uint32_t dirty_sent; // millis() of the last dirty notification
+
+// Take over a heap allocated message, it is freed when the queue is full
+static void websocket_fifo_push(websocket_fifo_t* fifo, char* text)
+{
+    std::lock_guard<std::mutex> lock(fifo->mtx);
+    if(fifo->count >= WEBSOCKET_FIFO_SIZE) {
+        hasp_free(text);
+        ws_stats.dropped++;
+        return;
+    }
+    fifo->items[(fifo->head + fifo->count) % WEBSOCKET_FIFO_SIZE] = text;
+    fifo->count++;
+}
+
+static char* websocket_fifo_pop(websocket_fifo_t* fifo)
+{
+    std::lock_guard<std::mutex> lock(fifo->mtx);
+    if(fifo->count == 0) return NULL;
+
+    char* text = fifo->items[fifo->head];
+    fifo->head = (fifo->head + 1) % WEBSOCKET_FIFO_SIZE;
+    fifo->count--;
+    return text;
+}
+
+#if HASP_USE_HTTP_ASYNC > 0
+
+static void websocket_broadcast(const char* msg, size_t len)
+{
+    std::lock_guard<std::mutex> lock(client_mtx);
+    for(AsyncWebSocketClient* client : clients) {
+        if(!client || client->status() != WS_CONNECTED) continue;
+        if(client->queueIsFull()) {
+            ws_stats.dropped++;
+        } else {
+            client->text(msg, len);
+            ws_stats.sent++;
+        }
+    }
+}
+
+static void websocket_add_client(AsyncWebSocketClient* client)
+{
+    std::lock_guard<std::mutex> lock(client_mtx);
+    for(AsyncWebSocketClient*& slot : clients) {
+        if(!slot) {
+            slot = client;
+            ws_stats.clients++;
+            return;
+        }
+    }
+    ws_stats.rejected++;
+    client->close();
+}
+
+// Called from the destructor of the client, waits until the gui loop is done sending to it
+static void websocket_remove_client(AsyncWebSocketClient* client)
+{
+    std::lock_guard<std::mutex> lock(client_mtx);
+    for(AsyncWebSocketClient*& slot : clients) {
+        if(slot == client) {
+            slot = NULL;
+            ws_stats.clients--;
+        }
+    }
+}
+
+// AsyncTCP task: keep track of the clients and queue whole text frames for the gui loop
+static void websocket_event(AsyncWebSocket*, AsyncWebSocketClient* client, AwsEventType type, void* arg,
+                            uint8_t* data, size_t len)
+{
+    switch(type) {
+        case WS_EVT_CONNECT:
+            websocket_add_client(client);
+            return;
+        case WS_EVT_DISCONNECT:
+            websocket_remove_client(client);
+            return;
+        case WS_EVT_DATA:
+            break;
+        default:
+            return;
+    }
+
+    AwsFrameInfo* info = (AwsFrameInfo*)arg;
+    if(!info->final || info->index != 0 || info->len != len || info->opcode != WS_TEXT) return;
+    if(len > HASP_WEBSOCKET_RX_SIZE) return;
+
+    char* text = (char*)hasp_malloc(len + 1);
+    if(!text) return;
+    memcpy(text, data, len);
+    text[len] = '\0';
+    websocket_fifo_push(&commands, text);
+}
+
+static void websocket_poll()
+{
+    while(char* text = websocket_fifo_pop(&commands)) {
+        ws_stats.commands++;
+        dispatch_text_line(text, TAG_HTTP);
+        hasp_free(text);
+    }
+}
+
+/**
+ * Attach the event handler of the async web socket
+ * @param username user of the web interface
+ * @param password password of the web interface, clients must authenticate when it is set
+ */
+void websocket_setup(const char* username, const char* password)
+{
+    loop_task = xTaskGetCurrentTaskHandle();
+    if(password[0] != '\0') ws.setAuthentication(username, password);
+    ws.onEvent(websocket_event);
+}
+
+#elif HASP_USE_HTTP > 0
+
+static void websocket_ring_write(websocket_client_t* c, const uint8_t* data, size_t len)
+{
+    size_t pos   = (c->tx_head + c->tx_len) % HASP_WEBSOCKET_QUEUE_SIZE;
+    size_t first = LV_MATH_MIN(len, HASP_WEBSOCKET_QUEUE_SIZE - pos);
+    memcpy(c->tx + pos, data, first);
+    memcpy(c->tx, data + first, len - first);
+    c->tx_len += len;
+}
+
+// Add a frame to the client queue, drops it if the queue is full
+static bool websocket_queue(websocket_client_t* c, uint8_t opcode, const uint8_t* data, size_t len)
+{
+    uint8_t header[4];
+    size_t header_len = 2;
+
+    header[0] = 0x80 | opcode; // FIN
+    if(len < 126) {
+        header[1] = len;
+    } else {
+        header[1]  = 126;
+        header[2]  = len >> 8;
+        header[3]  = len & 0xFF;
+        header_len = 4;
+    }
+
+    if(len > 0xFFFF || c->tx_len + header_len + len > HASP_WEBSOCKET_QUEUE_SIZE) {
+        ws_stats.dropped++;
+        return false;
+    }
+
+    websocket_ring_write(c, header, header_len);
+    websocket_ring_write(c, data, len);
+    if(c->tx_len > ws_stats.peak) ws_stats.peak = c->tx_len;
+    return true;
+}
+
+static void websocket_close(websocket_client_t* c)
+{
+    c->client.stop();
+    hasp_free(c->tx);
+    c->tx     = NULL;
+    c->rx_len = 0;
+    ws_stats.clients--;
+}
+
+static void websocket_broadcast(const char* msg, size_t len)
+{
+    for(websocket_client_t& c : clients) {
+        if(c.tx && websocket_queue(&c, 0x1, (const uint8_t*)msg, len)) ws_stats.sent++;
+    }
+}
+
+// Run the complete frames in the receive buffer, returns false if the connection has to be closed
+static bool websocket_receive(websocket_client_t* c)
+{
+    while(c->rx_len >= 2) {
+        uint8_t opcode = c->rx[0] & 0x0F;
+        bool final     = c->rx[0] & 0x80;
+        bool masked    = c->rx[1] & 0x80;
+        size_t len     = c->rx[1] & 0x7F;
+        size_t pos     = 2;
+
+        if(len == 127) return false; // 64-bit lengths are too long anyway
+        if(len == 126) {
+            if(c->rx_len < 4) return true;
+            len = (c->rx[2] << 8) | c->rx[3];
+            pos = 4;
+        }
+        if(!masked || len > HASP_WEBSOCKET_RX_SIZE) return false; // clients must mask their frames
+        if(c->rx_len < pos + 4 + len) return true;                // wait for the rest of the frame
+
+        uint8_t* mask = c->rx + pos;
+        uint8_t* data = mask + 4;
+        for(size_t i = 0; i < len; i++) data[i] ^= mask[i & 3];
+
+        switch(opcode) {
+            case 0x1: // text
+                if(final) {
+                    uint8_t next = data[len]; // first byte of the next frame
+                    data[len]    = '\0';
+                    ws_stats.commands++;
+                    dispatch_text_line((const char*)data, TAG_HTTP);
+                    data[len] = next;
+                }
+                break;
+            case 0x8: // close
+                return false;
+            case 0x9: // ping
+                websocket_queue(c, 0xA, data, len);
+                break;
+            default: // continuation, binary and pong frames are ignored
+                break;
+        }
+
+        size_t frame_len = pos + 4 + len;
+        c->rx_len -= frame_len;
+        memmove(c->rx, c->rx + frame_len, c->rx_len);
+    }
+    return true;
+}
+
+static void websocket_poll()
+{
+    for(websocket_client_t& c : clients) {
+        if(!c.tx) continue;
+
+        if(!c.client.connected()) {
+            websocket_close(&c);
+            continue;
+        }
+
+        int available = c.client.available();
+        if(available > 0) {
+            size_t room = sizeof(c.rx) - 1 - c.rx_len;
+            int len     = c.client.read(c.rx + c.rx_len, LV_MATH_MIN((size_t)available, room));
+            if(len > 0) c.rx_len += len;
+            if(!websocket_receive(&c)) {
+                websocket_close(&c);
+                continue;
+            }
+        }
+
+        // Send what the socket takes without blocking, the rest waits for the next loop
+        while(c.tx_len > 0) {
+            size_t len = LV_MATH_MIN(c.tx_len, HASP_WEBSOCKET_QUEUE_SIZE - c.tx_head);
+            int sent   = send(c.client.fd(), c.tx + c.tx_head, len, MSG_DONTWAIT);
+            if(sent <= 0) {
+                if(sent < 0 && errno != EAGAIN && errno != EWOULDBLOCK) websocket_close(&c);
+                break;
+            }
+            c.tx_head = (c.tx_head + sent) % HASP_WEBSOCKET_QUEUE_SIZE;
+            c.tx_len -= sent;
+        }
+    }
+}
+
+/**
+ * Take over an http connection that asked for a websocket upgrade
+ * @param client copy of the connection of the web server, it shares the socket with the server
+ * @param key value of the Sec-WebSocket-Key header
+ * @return false if all client slots are in use
+ * @note the web server keeps its own reference until its close wait (HTTP_MAX_CLOSE_WAIT) expires, it does not
+ *       accept other requests in the meantime
+ */
+bool websocket_accept(WiFiClient client, const char* key)
+{
+    websocket_client_t* c = NULL;
+    for(websocket_client_t& slot : clients) {
+        if(!slot.tx) {
+            c = &slot;
+            break;
+        }
+    }
+    if(!c || !(c->tx = (uint8_t*)hasp_malloc(HASP_WEBSOCKET_QUEUE_SIZE))) {
+        ws_stats.rejected++;
+        return false;
+    }
+
+    // Sec-WebSocket-Accept is base64(sha1(key + guid))
+    char buffer[96];
+    uint8_t hash[20];
+    size_t len;
+    snprintf_P(buffer, sizeof(buffer), PSTR("%s258EAFA5-E914-47DA-95CA-C5AB0DC85B11"), key);
+    mbedtls_sha1_ret((const unsigned char*)buffer, strlen(buffer), hash);
+    mbedtls_base64_encode((unsigned char*)buffer, sizeof(buffer), &len, hash, sizeof(hash));
+    buffer[len] = '\0';
+
+    // The socket stays open as long as one WiFiClient refers to it, stop() would close it for the server too
+    c->client = client;
+    c->client.setNoDelay(true);
+    c->client.printf("HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+                     "Sec-WebSocket-Accept: %s\r\n\r\n",
+                     buffer);
+
+    c->tx_head = 0;
+    c->tx_len  = 0;
+    c->rx_len  = 0;
+    ws_stats.clients++;
+    LOG_VERBOSE(TAG_HTTP, F("WebSocket client %s connected"), c->client.remoteIP().toString().c_str());
+    return true;
+}
+
+void websocket_setup()
+{
+    loop_task = xTaskGetCurrentTaskHandle();
+}
+
+#endif
+
+void websocket_loop()
+{
+    websocket_poll();
+    while(char* msg = websocket_fifo_pop(&outgoing)) {
+        websocket_broadcast(msg, strlen(msg));
+        hasp_free(msg);
+    }
+    if(ws_stats.clients == 0 || dirty_x1 == INT32_MAX || millis() - dirty_sent < HASP_WEBSOCKET_DIRTY_PERIOD) return;
+
+    char buffer[64];
+    int len = snprintf_P(buffer, sizeof(buffer), PSTR("{\"dirty\":[%d,%d,%d,%d]}"), (int)dirty_x1, (int)dirty_y1,
+                         (int)dirty_x2, (int)dirty_y2);
+    websocket_broadcast(buffer, len);
+    dirty_x1   = INT32_MAX;
+    dirty_sent = millis();
+}
+
+// Push a state message to all clients, other tasks leave it to the loop
+void websocket_send_state(const char* subtopic, const char* payload)
+{
+    if(ws_stats.clients == 0) return;
+
+    StaticJsonDocument<JSON_OBJECT_SIZE(2)> doc;
+    doc["topic"] = subtopic;
+    if(payload[0] == '{' || payload[0] == '[') {
+        doc["payload"] = serialized(payload);
+    } else {
+        doc["payload"] = payload;
+    }
+
+    size_t len = measureJson(doc);
+    char* msg  = (char*)hasp_malloc(len + 1);
+    if(!msg) return;
+    serializeJson(doc, msg, len + 1);
+    if(xTaskGetCurrentTaskHandle() == loop_task) {
+        websocket_broadcast(msg, len);
+        hasp_free(msg);
+    } else {
+        websocket_fifo_push(&outgoing, msg);
+    }
+}
+
+// Add a flushed area to the next dirty rectangle notification
+void websocket_invalidate_area(int32_t x1, int32_t y1, int32_t x2, int32_t y2)
+{
+    if(ws_stats.clients == 0) return;
+
+    if(dirty_x1 == INT32_MAX) {
+        dirty_x1 = x1;
+        dirty_y1 = y1;
+        dirty_x2 = x2;
+        dirty_y2 = y2;
+    } else {
+        dirty_x1 = LV_MATH_MIN(dirty_x1, x1);
+        dirty_y1 = LV_MATH_MIN(dirty_y1, y1);
+        dirty_x2 = LV_MATH_MAX(dirty_x2, x2);
+        dirty_y2 = LV_MATH_MAX(dirty_y2, y2);
+    }
+}
+
+void websocket_get_info(JsonDocument& doc)
+{
+    JsonObject info     = doc.createNestedObject(F("WebSocket"));
+    info[F("clients")]  = ws_stats.clients;
+    info[F("sent")]     = ws_stats.sent;
+    info[F("dropped")]  = ws_stats.dropped;
+    info[F("commands")] = ws_stats.commands;
+    info[F("rejected")] = ws_stats.rejected;
+    info[F("peak")]     = ws_stats.peak;
+}
+
+#endif
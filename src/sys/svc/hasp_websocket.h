@@ -0,0 +1,54 @@
+/* MIT License - Copyright (c) 2019-2024 Francis Van Roie
+   For full license information read the LICENSE file in the project folder */
+
+#ifndef HASP_WEBSOCKET_H
+#define HASP_WEBSOCKET_H
+
+#if HASP_USE_WEBSOCKET > 0
+
+#include "hasplib.h"
+
+#ifndef HASP_WEBSOCKET_CLIENTS
+#define HASP_WEBSOCKET_CLIENTS 4 // browser sessions connected at the same time
+#endif
+
+#ifndef HASP_WEBSOCKET_QUEUE_SIZE
+#define HASP_WEBSOCKET_QUEUE_SIZE 4096 // bytes of outgoing frames per client, newer messages are dropped when full
+#endif
+
+#ifndef HASP_WEBSOCKET_RX_SIZE
+#define HASP_WEBSOCKET_RX_SIZE 512 // longest command accepted from a client
+#endif
+
+#ifndef HASP_WEBSOCKET_DIRTY_PERIOD
+#define HASP_WEBSOCKET_DIRTY_PERIOD 100 // ms between two dirty rectangle notifications
+#endif
+
+typedef struct
+{
+    uint32_t sent;     // messages queued to a client
+    uint32_t dropped;  // messages dropped because the client queue was full
+    uint32_t commands; // commands received from clients
+    uint32_t rejected; // connections refused because all client slots were in use
+    uint16_t peak;     // highest number of bytes queued for one client
+    uint8_t clients;   // connected clients
+} hasp_websocket_stats_t;
+
+#if HASP_USE_HTTP_ASYNC > 0
+void websocket_setup(const char* username, const char* password);
+#else
+void websocket_setup();
+#endif
+void websocket_loop();
+
+void websocket_send_state(const char* subtopic, const char* payload);
+void websocket_invalidate_area(int32_t x1, int32_t y1, int32_t x2, int32_t y2);
+void websocket_get_info(JsonDocument& doc);
+
+#if HASP_USE_HTTP > 0
+class WiFiClient;
+bool websocket_accept(WiFiClient client, const char* key);
+#endif
+
+#endif
+#endif